@@ -20,6 +20,12 @@ extern "C" {
 		PORT_NONE	//PORT_NONE always has to be the last item
 	}Port;
 
+	//Reception (circular) buffer size of every port, in bytes (max 65535):
+	#define PORT_RX_BUF_SIZES(X)				\
+		X(PORT_RS485_1,		CB_BUF_LEN)			\
+		X(PORT_USB,			CB_BUF_LEN)			\
+		X(PORT_WIRELESS,	CB_BUF_LEN)
+
 #else
 
 	#if (defined BOARD_SUBTYPE_HABSOLUTE || defined BOARD_SUBTYPE_BMS)
@@ -41,6 +47,10 @@ extern "C" {
 			PORT_NONE	//PORT_NONE always has to be the last item
 		}Port;
 
+		//Reception (circular) buffer size of every port, in bytes (max 65535):
+		#define PORT_RX_BUF_SIZES(X)				\
+			X(PORT_USB,			CB_BUF_LEN)
+
 	#else
 
 		//Default: everything enabled
@@ -64,10 +74,52 @@ extern "C" {
 			PORT_NONE	//PORT_NONE always has to be the last item
 		}Port;
 
+		//Reception (circular) buffer size of every port, in bytes (max 65535).
+		//Size the busy ports large, and the idle ones small:
+		#ifdef BOARD_TYPE_FLEXSEA_PLAN
+			#define RX_BUF_SIZE_USB		16384	//Survives scheduler hiccups
+		#else
+			#define RX_BUF_SIZE_USB		CB_BUF_LEN
+		#endif
+
+		//Low traffic ports (2nd RS-485 bus, SPI, expansion, BWC): room for
+		//a frame and the start of the next one. Every byte saved here is
+		//saved twice (flexsea_buffers and flexsea_comm_multi storage).
+		//The host has RAM to spare and keeps the default everywhere.
+		#ifndef RX_BUF_SIZE_LOW
+			#if (defined BOARD_TYPE_FLEXSEA_PLAN)
+				#define RX_BUF_SIZE_LOW		CB_BUF_LEN
+			#elif (defined CB_BUF_LEN_LOG2)
+				#define RX_BUF_SIZE_LOW		256
+			#else
+				#define RX_BUF_SIZE_LOW		(RX_BUF_LEN * 2)
+			#endif
+		#endif
+
+		#define PORT_RX_BUF_SIZES(X)				\
+			X(PORT_RS485_1,		CB_BUF_LEN)			\
+			X(PORT_RS485_2,		RX_BUF_SIZE_LOW)	\
+			X(PORT_USB,			RX_BUF_SIZE_USB)	\
+			X(PORT_SPI,			RX_BUF_SIZE_LOW)	\
+			X(PORT_WIRELESS,	CB_BUF_LEN)			\
+			X(PORT_EXP,			RX_BUF_SIZE_LOW)	\
+			X(PORT_BWC,			RX_BUF_SIZE_LOW)
+
 	#endif
 
 #endif
 
+//Multi packets (packed) that can wait behind the one being sent, per port.
+//Each one costs MAX_FRAMES_PER_MULTI_PACKET * PACKET_WRAPPER_LEN bytes, for
+//every port: Manage only keeps one.
+#ifndef MULTI_OUT_QUEUE_LEN
+	#ifdef BOARD_TYPE_FLEXSEA_MANAGE
+		#define MULTI_OUT_QUEUE_LEN		1
+	#else
+		#define MULTI_OUT_QUEUE_LEN		2
+	#endif
+#endif
+
 #ifdef __cplusplus
 }
 #endif
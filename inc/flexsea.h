@@ -166,10 +166,77 @@ typedef struct
 	void *parent;
 } PacketWrapper;
 
+//Every HEADER byte opens a candidate frame. The ones that are still
+//incomplete are remembered so that a bogus one can't hold back a valid frame
+//behind it.
+#define DECODER_CANDIDATES				8
+
+//State of the streaming frame decoder (see unpack_payload_stream())
+typedef struct
+{
+	int anchor;				//Circular buffer head when we started scanning
+	int next;				//After a batch: storage index of the head once consumed, -1 if none
+	uint16_t base;			//Where the sweep started (after the last frame of a batch)
+	uint16_t scanned;		//Bytes (from head) already fed to the decoder
+	int overflow;			//First untracked HEADER (candidates full), -1 if none
+	int idle;				//Buffer size when the last sweep found nothing, -1 if none
+	uint8_t pending;		//# of candidates, oldest first
+	uint16_t candidate[DECODER_CANDIDATES];	//Offsets (from head) of their HEADER
+
+	//Errors since the last commStatsRx(). Not cleared by resetCommDecoder().
+	uint16_t checksumErrors;	//HEADER, BYTES and FOOTER fit, bad checksum
+	uint16_t framingErrors;		//Good checksum, no FOOTER
+}CommDecoder;
+
+//Traffic counters of one direction of a port. Not every field applies to
+//both directions.
+typedef struct
+{
+	uint32_t frames;			//Encoded (TX) or decoded (RX)
+	uint32_t bytes;				//On the wire
+	uint32_t escapes;			//ESCAPE bytes added (TX) or removed (RX)
+	uint32_t checksumErrors;	//RX
+	uint32_t framingErrors;		//RX
+	uint32_t resyncBytes;		//RX: bytes skipped to find a frame
+	uint32_t overflowBytes;		//RX: lost to buffer overflows (overwritten or refused)
+	uint32_t multiDrops;		//RX: multi-packet frames dropped in reassembly
+}CommCounters;
+
+//One writer per block (the parser for RX, the sender for TX). Readers use
+//commStatsSnapshot(), the sequence number keeps them from seeing a half
+//updated block.
+typedef struct
+{
+	cb_index_t seq;				//Odd while an update is in progress
+	CommCounters counters;
+}CommStats;
+
+//A complete, valid frame located in a circular buffer (not consumed yet)
+typedef struct
+{
+	uint16_t headerPos;		//Offset (from head) of the HEADER byte
+	uint8_t bytes;			//# of BYTES field (escaped payload)
+}CommFrame;
+
+//Bytes from the head to the end of the frame (FOOTER included)
+#define COMM_FRAME_END(f)				((f).headerPos + (f).bytes + 4)
+
+//Zero-copy access to a received frame (see comm_frame_view()). Points into
+//the receive ring when the frame is contiguous and has no ESCAPE, else to the
+//packed/unpacked copies. Valid until the head moves past the frame.
+typedef struct
+{
+	uint8_t *packed;			//Whole frame, HEADER to FOOTER
+	uint8_t *payload;			//Unescaped payload
+	uint16_t packedLen;
+	uint8_t payloadLen;
+	circularBuffer_t *cb;		//Ring it points into, NULL for a copy
+}CommFrameView;
+
 typedef struct
 {
 	//State:
-	uint8_t bytesReadyFlag;
+	cb_ready_t bytesReadyFlag;		//Producer ++, parser --
 	uint8_t unpackedPacketsAvailable;
 	uint8_t packetReady;
 	uint8_t timeStamp;
@@ -179,6 +246,8 @@ typedef struct
 	uint8_t *unpackedPtr;		//Points to comm_str_
 	uint8_t *packedPtr;			//Points to rx_cmd_
 	circularBuffer_t* circularBuff;
+	CommDecoder decoder;
+	CommStats stats;
 }CommPeriphSub;
 
 //Forward declaration:
@@ -37,28 +37,150 @@ extern "C" {
 #include <flexsea_comm_def.h>
 #include <stdint.h>
 
-#define CB_BUF_LEN (RX_BUF_LEN * 6)
+//Default capacity. Each buffer gets its own storage and capacity (max 65535)
+//with circ_buff_attach(). The per-port sizes are in commStackConfig.h.
+//Optional: power-of-two capacities only. head and tail then become free
+//running 32-bit counters, and wrap around the array with a mask.
+//#define CB_BUF_LEN_LOG2		10		//1024 bytes
 
+#ifdef CB_BUF_LEN_LOG2
+	#if (CB_BUF_LEN_LOG2 > 15)
+		#error "CB_BUF_LEN_LOG2: offsets are 16-bit, 15 max"
+	#endif
+	#define CB_BUF_LEN (1 << CB_BUF_LEN_LOG2)
+#else
+	#define CB_BUF_LEN (RX_BUF_LEN * 6)
+#endif
+
+//Enable this when the producer (ISR or thread calling circ_buff_write()) and
+//the consumer (parser) run concurrently. The producer then never touches
+//head: a full buffer rejects new bytes instead of overwriting the oldest ones.
+//#define CIRC_BUFF_SPSC
+
+//What circ_buff_write() does when the new bytes don't fit:
+typedef enum {
+	CB_OVERWRITE_OLDEST = 0,	//Discard just enough old bytes
+	CB_REJECT_NEW,				//Keep the old bytes, refuse the write
+	CB_DROP_TO_FRAME			//Discard old bytes up to a frame start (HEADER)
+}CircBuffPolicy;
+
+//circ_buff_write() return code: the bytes were written, but old ones were
+//discarded to make room. They are still available to the parser.
+#define CB_OVERWROTE			2
+
+//Optional: circ_buff_write() records where the HEADER bytes are, and the
+//parsers jump from one to the next (circ_buff_search_sof()) instead of
+//scanning. CB_SOF_SLOTS positions are kept (power of two); past that the
+//search falls back to a scan for the unrecorded part.
+//#define CB_SOF_INDEX
+#define CB_SOF_SLOTS			32
+
+//Overwriting moves head: the two other policies need a single thread
+#ifdef CIRC_BUFF_SPSC
+	#define CB_DEFAULT_POLICY		CB_REJECT_NEW
+#else
+	#define CB_DEFAULT_POLICY		CB_OVERWRITE_OLDEST
+#endif
+
+typedef struct {
+	uint32_t overflows;			//Writes that didn't fit
+	uint32_t droppedBytes;		//Old bytes discarded to make room
+	uint32_t rejectedBytes;		//New bytes refused
+	uint32_t highWatermarks;	//# of times size went over highWatermark
+	uint16_t peakSize;
+}CircBuffStats;
+
+//head is only written by the consumer, tail only by the producer. C builds
+//use C11 atomics (acquire/release), older compilers fall back to volatile.
+//cb_ready_t: the ports' bytesReadyFlag, incremented by the producer and
+//decremented by the parser (atomic read-modify-writes).
+#if !defined(__cplusplus) && defined(__STDC_VERSION__) && \
+	(__STDC_VERSION__ >= 201112L) && !defined(__STDC_NO_ATOMICS__)
+	#include <stdatomic.h>
+	#define CB_ATOMICS
+	typedef _Atomic uint32_t cb_index_t;
+	typedef _Atomic uint8_t cb_ready_t;
+#else
+	typedef volatile uint32_t cb_index_t;
+	typedef volatile uint8_t cb_ready_t;
+#endif
+
+//Linux host: the storage can be mapped twice, back to back. Every span of up
+//to 'capacity' bytes is then contiguous (no wrap handling).
+#if defined(BOARD_TYPE_FLEXSEA_PLAN) && defined(__linux__)
+	#define CIRC_BUFF_MIRROR
+#endif
+
+//head and tail count over [0, 2*capacity) (or all 32 bits with
+//CB_BUF_LEN_LOG2): the extra lap tells a full buffer from an empty one, so
+//we don't need a shared size field.
 typedef struct circularBuffer {
-	uint8_t bytes[CB_BUF_LEN];
-	int head;
-	int tail;
-	int size;
+	uint8_t *bytes;			//Storage, provided by the owner
+	uint16_t capacity;
+	uint32_t mapped;		//Bytes addressable at 'bytes': capacity, x2 if mirrored
+	cb_index_t head;
+	cb_index_t tail;
+
+	//Overflow handling. The callback runs in the producer's context (ISR?)
+	//when size goes over highWatermark (0: disabled). Use it to throttle.
+	CircBuffPolicy policy;
+	uint16_t highWatermark;
+	void (*onHighWatermark)(struct circularBuffer *cb, int size);
+	CircBuffStats stats;
+
+	#ifdef CB_SOF_INDEX
+	uint32_t sof[CB_SOF_SLOTS];		//Positions (like head/tail) of the HEADERs
+	uint8_t sofGap[CB_SOF_SLOTS];	//1: HEADERs from there on weren't recorded
+	cb_index_t sofCount;			//Recorded, written by the producer
+	cb_index_t sofRead;				//Released, written by the consumer
+	uint8_t sofProducerGap;
+	uint8_t sofConsumerGap;
+	#endif
 } circularBuffer_t;
 
+//Static initializer, same as circ_buff_attach(): CIRC_BUFF_INIT(array, size)
+//With CB_BUF_LEN_LOG2 a capacity that isn't a power of two doesn't compile
+//(negative array size) instead of being rounded down at run time.
+#ifdef CB_BUF_LEN_LOG2
+	#define CB_POW2_CAPACITY(cap)	((cap) + 0 * sizeof(char[(((cap) & ((cap) - 1)) == 0) ? 1 : -1]))
+#else
+	#define CB_POW2_CAPACITY(cap)	(cap)
+#endif
+#define CIRC_BUFF_INIT(storage, cap)	{ (storage), CB_POW2_CAPACITY(cap), (cap), 0, 0, \
+										  CB_DEFAULT_POLICY }
+
 // Basic Circular Buffer Operations
-void circ_buff_init(circularBuffer_t* cb);
+int circ_buff_attach(circularBuffer_t* cb, uint8_t *storage, uint16_t capacity);
+int circ_buff_init(circularBuffer_t* cb);
+#ifdef CIRC_BUFF_MIRROR
+int circ_buff_attach_mirrored(circularBuffer_t* cb, uint16_t capacity);
+void circ_buff_detach_mirrored(circularBuffer_t* cb);
+#endif
 int circ_buff_write(circularBuffer_t* cb, uint8_t *writeFrom, uint16_t len);
 int circ_buff_read(circularBuffer_t* cb, uint8_t* readInto, uint16_t numBytes);
 int circ_buff_read_section(circularBuffer_t* cb, uint8_t* readInto, uint16_t start, uint16_t numBytes);
 int circ_buff_move_head(circularBuffer_t* cb, uint16_t numBytes);
 int circ_buff_get_size(circularBuffer_t* cb);
 int circ_buff_get_space(circularBuffer_t* cb);
+int circ_buff_get_capacity(circularBuffer_t* cb);
+
+// Overflow Policy and Backpressure
+int circ_buff_set_policy(circularBuffer_t* cb, CircBuffPolicy policy);
+void circ_buff_set_high_watermark(circularBuffer_t* cb, uint16_t level, \
+								void (*callback)(circularBuffer_t *cb, int size));
+uint16_t circ_buff_index_of(circularBuffer_t* cb, uint16_t offset);
+
+// Zero-copy Operations: direct access to the linear spans of the buffer
+int circ_buff_acquire_write(circularBuffer_t* cb, uint8_t **ptr, uint16_t *len);
+int circ_buff_commit_write(circularBuffer_t* cb, uint16_t numBytes);
+int circ_buff_peek_contiguous(circularBuffer_t* cb, uint8_t **ptr, uint16_t *len);
+int circ_buff_consume(circularBuffer_t* cb, uint16_t numBytes);
 
 // Convenience Operations for Parsing Buffer Data
 uint8_t circ_buff_peak(circularBuffer_t* cb, uint16_t offset);
 int32_t circ_buff_search(circularBuffer_t* cb, uint8_t value, uint16_t start);
 int32_t circ_buff_search_not(circularBuffer_t* cb, uint8_t value, uint16_t start);
+int32_t circ_buff_search_sof(circularBuffer_t* cb, uint16_t start);
 uint8_t circ_buff_checksum(circularBuffer_t* cb, uint16_t start, uint16_t end);
 
 #ifdef __cplusplus
@@ -49,6 +49,24 @@ extern "C" {
 uint8_t comm_gen_str(uint8_t payload[], uint8_t *cstr, uint8_t bytes);
 int8_t unpack_payload(uint8_t *buf, uint8_t *packed, uint8_t rx_cmd[PACKAGED_PAYLOAD_LEN]);
 uint16_t unpack_payload_cb(circularBuffer_t *cb, uint8_t *packed, uint8_t rx_cmd[PACKAGED_PAYLOAD_LEN]);
+uint16_t unpack_payload_stream(circularBuffer_t *cb, CommDecoder *d, uint8_t *packed, \
+					uint8_t *unpacked);
+uint8_t unpack_payload_stream_batch(circularBuffer_t *cb, CommDecoder *d, \
+					CommFrame frames[], uint8_t max);
+uint8_t unpack_payload_cb_batch(circularBuffer_t *cb, CommFrame frames[], uint8_t max);
+uint8_t unpack_payload_frame(circularBuffer_t *cb, const CommFrame *frame, uint8_t *packed, \
+					uint8_t *unpacked);
+uint16_t unpack_payload_periph(CommPeriphSub *rx);
+uint8_t comm_frame_view(circularBuffer_t *cb, const CommFrame *frame, CommFrameView *v, \
+					uint8_t *packed, uint8_t *unpacked);
+void resetCommDecoder(CommDecoder *d);
+
+//Statistics:
+void commStatsBegin(CommStats *s);
+void commStatsEnd(CommStats *s);
+uint8_t commStatsSnapshot(CommStats *s, circularBuffer_t *cb, CommCounters *out);
+void commStatsRx(CommPeriphSub *rx, const CommFrame frames[], uint8_t n, uint32_t escapes);
+void commStatsTx(CommStats *s, uint32_t frames, uint32_t bytes, uint32_t escapes);
 
 //int8_t unpack_payload_test(uint8_t *buf, uint8_t *packed, uint8_t rx_cmd[PACKAGED_PAYLOAD_LEN]);
 
@@ -58,6 +76,8 @@ uint8_t generateRandomUint8_t(void);
 void generateRandomUint8_tArray(uint8_t *arr, uint8_t size);
 
 void fillPacketFromCommPeriph(CommPeriph *cp, PacketWrapper *pw);
+void fillPacketPortsFromCommPeriph(CommPeriph *cp, PacketWrapper *pw);
+void fillPacketFromFrameView(const CommFrameView *v, PacketWrapper *pw);
 void copyPacket(PacketWrapper *from, PacketWrapper *to, TravelDirection td);
 void initCommPeriph(CommPeriph *cp, Port port, PortType pt, \
 					uint8_t *unpacked, uint8_t *packed, circularBuffer_t* rx_cb, \
@@ -59,10 +59,15 @@ extern "C" {
 #define COMM_STR_BUF_LEN				48		//Number of bytes in a comm. string
 #define PACKAGED_PAYLOAD_LEN			48		//Temporary
 #define PAYLOAD_BUFFERS					4		//Max # of payload strings we expect to find
+#define COMM_RX_BATCH					16		//Max # of frames dispatched per receive call
 #define MAX_CMD_CODE					127
 #define PACKET_WRAPPER_LEN				RX_BUF_LEN
 #define COMM_PERIPH_ARR_LEN				RX_BUF_LEN
 
+//Debug: zero the buffers at init, and the circular buffer bytes as they are
+//consumed. Nothing reads them, so release builds leave them alone.
+//#define SCRUB_BUFFERS
+
 //Packet types:
 #define RX_PTYPE_READ					0
 #define RX_PTYPE_WRITE					1
@@ -51,8 +51,22 @@ typedef struct MultiWrapper_struct
 	uint8_t unpacked[UNPACKED_BUFF_SIZE];
 	uint16_t unpackedIdx;
 
+	//Traffic of this direction (in: RX, out: TX)
+	CommStats stats;
+
 } MultiWrapper;
 
+//Outgoing packets waiting for the one in 'out' to be sent (same frames as in
+//MultiWrapper.packed)
+typedef struct
+{
+	uint8_t packed[MULTI_OUT_QUEUE_LEN][MAX_FRAMES_PER_MULTI_PACKET][PACKET_WRAPPER_LEN];
+	uint8_t frameMap[MULTI_OUT_QUEUE_LEN];
+	uint8_t head;
+	uint8_t count;
+	uint32_t dropped;		//Queue full
+} MultiOutQueue;
+
 typedef struct MultiCommPeriph_struct
 {
 	//Peripheral state and info:
@@ -60,13 +74,15 @@ typedef struct MultiCommPeriph_struct
 	PortType portType;
 	TransceiverSate transState;
 
-	uint8_t bytesReadyFlag;
+	cb_ready_t bytesReadyFlag;		//Producer ++, parser --
 	uint8_t unpackedPacketsAvailable;
 	uint8_t packetReady;
 	uint8_t timeStamp;
 	int parsingCachedIndex;
 
-	//Data:
+	//Data: the reception path (producer) and the parser (consumer) can share
+	//circularBuff without a lock, see CIRC_BUFF_SPSC. Its storage is set
+	//with circ_buff_attach() (done for comm_multi_periph[], per port).
 	circularBuffer_t circularBuff;
 
 	//A lock for the packed and unpacked structure
@@ -75,9 +91,11 @@ typedef struct MultiCommPeriph_struct
 	MutexFlag data_guard;
 	#endif*/
 		
-	//Attach PacketWrappers:
+	//Attach PacketWrappers. out.packed is the packet being sent, out.unpacked
+	//where the next one is built (see queueMultiPacket()).
 	MultiWrapper in;
 	MultiWrapper out;
+	MultiOutQueue outQueue;
 
 
 } MultiCommPeriph;
@@ -93,13 +111,23 @@ uint8_t parseReadyMultiString(MultiCommPeriph* cp);
 uint8_t receiveAndFillResponse(uint8_t cmd_7bits, uint8_t pType, MultiPacketInfo *info, MultiCommPeriph* cp);
 void setMsgInfo(uint8_t* outbuf, uint8_t xid, uint8_t rid, uint8_t cmdcode, uint8_t cmdtype, uint32_t timestamp);
 uint8_t packMultiPacket(MultiWrapper* p);
+uint8_t queueMultiPacket(MultiCommPeriph *cp, MultiWrapper *src);
+uint8_t dequeueMultiPacket(MultiCommPeriph *cp);
 void resetToPacketId(MultiWrapper* p, uint8_t id);
 int16_t copyIntoMultiPacket(MultiCommPeriph* p, uint8_t *src, uint16_t nb);
+int16_t commitIntoMultiPacket(MultiCommPeriph* p, uint16_t nb);
 void advanceMultiInput(MultiCommPeriph *p, int16_t nb);
+int8_t nextMultiFrame(MultiWrapper *p);
+void markMultiFrameSent(MultiWrapper *p, uint8_t frameId);
 
 //****************************************************************************
 // Definition(s):
 //****************************************************************************
+
+//nextMultiFrame() return values, other than a frame id:
+#define MULTI_FRAME_NONE		-1
+#define MULTI_FRAME_INVALID		-2
+
 //Conditional printf() statement:
 #ifdef DEBUG_COMM_PRINTF_
 	#define DEBUG_COMM_PRINTF(...) printf(__VA_ARGS__)
@@ -36,6 +36,7 @@ extern "C" {
 
 #include <stdint.h>
 #include "flexsea.h"
+#include "flexsea_transport.h"
 
 //****************************************************************************
 // Prototype(s):
@@ -50,8 +51,12 @@ uint8_t receiveFlexSEABytes(uint8_t *d, uint8_t len, uint8_t autoParse);
 
 uint8_t receiveFxPacket(Port p);
 uint8_t transmitFxPacket(Port p);
+uint8_t transmitFxPacketBurst(Port p, uint8_t *framesSent);
 
 uint8_t receiveFxPacketByPeriph(MultiCommPeriph *cp);
+uint8_t transmitFxPacketByPeriph(MultiCommPeriph *cp, const FxTransport *t);
+uint8_t transmitFxPacketBurstByPeriph(MultiCommPeriph *cp, const FxTransport *t, \
+										uint8_t *framesSent);
 
 //****************************************************************************
 // Definition(s):
@@ -0,0 +1,205 @@
+/****************************************************************************
+	[Project] FlexSEA: Flexible & Scalable Electronics Architecture
+	[Sub-project] 'flexsea-comm' Communication stack
+	Copyright (C) 2016 Dephy, Inc. <http://dephy.com/>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************
+	[Lead developper] Jean-Francois (JF) Duval, jfduval at dephy dot com.
+	[Origin] Based on Jean-Francois Duval's work at the MIT Media Lab
+	Biomechatronics research group <http://biomech.media.mit.edu/>
+	[Contributors]
+*****************************************************************************
+	[This file] flexsea_log: message table and deferred (binary) logging
+*****************************************************************************
+	[Change log] (Convention: YYYY-MM-DD | author | comment)
+	* 2026-10-17 | agent | Initial release
+	*
+****************************************************************************/
+
+#ifndef FLEXSEA_COMM_INC_FLEXSEA_LOG_H_
+#define FLEXSEA_COMM_INC_FLEXSEA_LOG_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//****************************************************************************
+// Include(s)
+//****************************************************************************
+
+#include <stdint.h>
+#include "log.h"
+#ifdef BOARD_TYPE_FLEXSEA_PLAN
+#include <stdio.h>
+#endif
+
+//****************************************************************************
+// Definition(s):
+//****************************************************************************
+
+//Least severe level that gets compiled in. Levels go from lerror (most severe)
+//to ldebug4. Calls past FX_LOG_LEVEL are removed at compile time: their
+//arguments aren't even evaluated. Release builds (NDEBUG) keep the warnings
+//and errors only.
+#ifndef FX_LOG_LEVEL
+	#ifdef NDEBUG
+		#define FX_LOG_LEVEL		lwarning
+	#else
+		#define FX_LOG_LEVEL		ldebug4
+	#endif
+#endif
+
+#define FX_LOG(level, ...)		do { \
+									if((level) <= FX_LOG_LEVEL) { LOG((level), __VA_ARGS__); } \
+								} while(0)
+
+//Rate-limited version, for events that can repeat thousands of times per
+//second (overflows): only the 1st occurrence and then one every 'every' are
+//logged, with the total count. There is no time base in the stack, so the
+//limit is a number of occurrences (per call site).
+#define FX_LOG_EVERY(every, level, fmt, ...)	do { \
+									static uint32_t fxLogCount_ = 0; \
+									if((level) <= FX_LOG_LEVEL && (fxLogCount_++ % (every)) == 0) \
+									{ \
+										LOG((level), fmt " (x%lu)", ##__VA_ARGS__, \
+											(unsigned long)fxLogCount_); \
+									} \
+								} while(0)
+
+//Default period of FX_LOG_EVERY()
+#define FX_LOG_PERIOD			1024
+
+//****************************************************************************
+// Deferred (binary) logging:
+//****************************************************************************
+
+//Messages of the RX/TX paths: X(id, level, # of arguments, format). The
+//arguments are 32-bit integers (%u, %d, %x). Never reorder or remove an entry
+//without updating the decoder: binary logs only contain the ids.
+#define FX_LOG_MESSAGES(X)	\
+	X(FXLOG_CB_OVERWRITTEN,			lwarning,	1,	"CB has been overwritten (%u bytes)")	\
+	X(FXLOG_GEN_STR_CALLED,			ldebug3,	0,	"comm_gen_str called")					\
+	X(FXLOG_GEN_STR_TOO_LONG,		lwarning,	1,	"Comm string too long (%u bytes), abort")	\
+	X(FXLOG_UNPACK_CALLED,			ldebug3,	0,	"unpack_payload_cb called")				\
+	X(FXLOG_STRING_FOUND,			ldebug2,	1,	"String found (%u bytes)")				\
+	X(FXLOG_LAST_HEADER,			ldebug2,	0,	"Last possible header")					\
+	X(FXLOG_FRAME_FOUND,			ldebug2,	1,	"Frame found at %u")					\
+	X(FXLOG_FILL_PACKET_CALLED,		ldebug3,	0,	"fillPacketFromCommPeriph called")		\
+	X(FXLOG_COPY_PACKET_CALLED,		ldebug3,	0,	"copyPacket called")					\
+	X(FXLOG_MOVE_HEAD_ERROR,		lerror,		1,	"circ_buff_move_head error %u")			\
+	X(FXLOG_MULTI_BYTES_READY,		ldebug1,	1,	"cp->bytesReadyFlag %u is smaller than 0")	\
+	X(FXLOG_MULTI_PACK_CALLED,		ldebug3,	0,	"packMultiPacket called")				\
+	X(FXLOG_MULTI_DATA_DIDNT_FIT,	lerror,		0,	"Not all the data fit into the frame")	\
+	X(FXLOG_MULTI_RECEIVE_CALLED,	ldebug3,	0,	"receiveAndFillResponse called")		\
+	X(FXLOG_MULTI_TOO_MUCH_DATA,	lerror,		0,	"More data than expected unpacked")		\
+	X(FXLOG_MULTI_EMPTY,			ldebug2,	0,	"Empty unpack array")					\
+	X(FXLOG_MULTI_PARSE_CALLED,		ldebug3,	0,	"parseReadyMultiString called")			\
+	X(FXLOG_MULTI_PARSE_ERROR,		lerror,		0,	"Error recieving string occured")		\
+	X(FXLOG_MULTI_WHOAMI_ERROR,		lerror,		0,	"Error recieving who am i message occured")	\
+	X(FXLOG_MULTI_RESET_CALLED,		ldebug4,	0,	"resetToPacketId called")				\
+	X(FXLOG_MULTI_UNLOADING,		ldebug3,	0,	"Unloading payload")					\
+	X(FXLOG_MULTI_TOO_LONG,			lwarning,	0,	"Multi packet too long, frame dropped")	\
+	X(FXLOG_MULTI_WRAPPER_INIT,		linfo,		0,	"initMultiWrapper called")				\
+	X(FXLOG_MULTI_PERIPH_INIT,		linfo,		0,	"initMultiPeriph called")				\
+	X(FXLOG_MULTI_TOO_MANY_FRAMES,	lerror,		0,	"More frames expected than possible")	\
+	X(FXLOG_MULTI_QUEUE_FULL,		lwarning,	1,	"Port %u: outgoing queue full, packet dropped")
+
+//Ids carry their level in the 3 LSBs, so that FX_LOG_ID() can drop them at
+//compile time like FX_LOG()
+#define FX_LOG_ID_LEVEL_BITS	3
+#define FX_LOG_INDEX_OF(id)		((id) >> FX_LOG_ID_LEVEL_BITS)
+#define FX_LOG_LEVEL_OF(id)		((id) & ((1 << FX_LOG_ID_LEVEL_BITS) - 1))
+
+#define FX_LOG_X_INDEX(id, level, nargs, fmt)	id##_INDEX,
+#define FX_LOG_X_ID(id, level, nargs, fmt)		id = (id##_INDEX << FX_LOG_ID_LEVEL_BITS) | (level),
+enum { FX_LOG_MESSAGES(FX_LOG_X_INDEX) FX_LOG_NUM_MESSAGES };
+typedef enum { FX_LOG_MESSAGES(FX_LOG_X_ID) }FxLogId;
+
+//Enable this to record FX_LOG_ID() messages in a lock-free ring instead of
+//formatting them on the spot. fx_log_process() (idle loop) or the host thread
+//(fx_log_start_thread()) formats them later, or fx_log_read() gets the binary
+//records for a file that fx_log_decode() turns into text.
+//#define FX_LOG_DEFERRED
+#define FX_LOG_RING_LEN			64		//Records, power of two
+#define FX_LOG_MAX_ARGS			4
+
+//Time base of the records. Define it to your tick counter on MCUs (ex.:
+//HAL_GetTick()). The host uses a monotonic clock (us).
+//#define FX_LOG_TIMESTAMP()	HAL_GetTick()
+
+#if defined(BOARD_TYPE_FLEXSEA_PLAN) && defined(__linux__)
+	#define FX_LOG_THREAD
+#endif
+
+//Binary record (native endianness, 24 bytes)
+typedef struct
+{
+	uint32_t timestamp;
+	uint16_t id;				//FxLogId
+	uint16_t seq;				//Counts the records, shows the drops
+	uint32_t args[FX_LOG_MAX_ARGS];
+}FxLogRecord;
+
+//Formats of the FX_LOG_MESSAGES() table, indexed by FX_LOG_INDEX_OF(id)
+extern const char * const fxLogFormats[FX_LOG_NUM_MESSAGES];
+
+//FX_LOG_ID(id, args...): first argument is a FxLogId, then the integer
+//arguments of its format. Without FX_LOG_DEFERRED this is a plain LOG() call.
+#ifdef FX_LOG_DEFERRED
+	#define FX_LOG_ID_CALL_(id, ...)	fx_log_id((id), ##__VA_ARGS__)
+#else
+	#define FX_LOG_ID_CALL_(id, ...)	LOG(FX_LOG_LEVEL_OF(id), \
+											fxLogFormats[FX_LOG_INDEX_OF(id)], ##__VA_ARGS__)
+#endif
+
+#define FX_LOG_ID(id, ...)		do { \
+									if(FX_LOG_LEVEL_OF(id) <= FX_LOG_LEVEL) \
+									{ FX_LOG_ID_CALL_((id), ##__VA_ARGS__); } \
+								} while(0)
+
+//Rate-limited version, see FX_LOG_EVERY()
+#define FX_LOG_ID_EVERY(every, id, ...)	do { \
+									static uint32_t fxLogCount_ = 0; \
+									if(FX_LOG_LEVEL_OF(id) <= FX_LOG_LEVEL && \
+										(fxLogCount_++ % (every)) == 0) \
+									{ FX_LOG_ID_CALL_((id), ##__VA_ARGS__); } \
+								} while(0)
+
+//****************************************************************************
+// Public Function Prototype(s):
+//****************************************************************************
+
+#ifdef FX_LOG_DEFERRED
+void fx_log_id(uint32_t id, ...);
+#endif
+uint16_t fx_log_read(FxLogRecord *records, uint16_t max);
+uint16_t fx_log_process(uint16_t max);
+int fx_log_format(const FxLogRecord *r, char *buf, uint16_t len);
+uint32_t fx_log_dropped(void);
+
+#ifdef FX_LOG_THREAD
+int fx_log_start_thread(uint32_t periodMs);
+void fx_log_stop_thread(void);
+#endif
+
+#ifdef BOARD_TYPE_FLEXSEA_PLAN
+int fx_log_decode(FILE *in, FILE *out);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FLEXSEA_COMM_INC_FLEXSEA_LOG_H_ */
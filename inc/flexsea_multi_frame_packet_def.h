@@ -32,6 +32,9 @@
 #define MULTI_LAST_FRAMEID(multiInfo) ( (multiInfo) & 0x07 )
 #define MULTI_GENINFO(pid, thisframe, lastframe) ( ((pid) << 6) | ((thisframe)&0x07) << 3 | ((lastframe)&0x03)  )
 
+//Not a valid packet id: the remaining frames of a dropped packet are ignored
+#define MULTI_PACKETID_DROPPED 0xFF
+
 #define MULTI_NUM_OVERHEAD_BYTES_FRAME 5
 #define MULTI_DATA_OFFSET 3
 
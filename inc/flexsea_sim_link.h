@@ -0,0 +1,141 @@
+/****************************************************************************
+	[Project] FlexSEA: Flexible & Scalable Electronics Architecture
+	[Sub-project] 'flexsea-comm' Communication stack
+	Copyright (C) 2016 Dephy, Inc. <http://dephy.com/>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************
+	[Lead developper] Jean-Francois (JF) Duval, jfduval at dephy dot com.
+	[Origin] Based on Jean-Francois Duval's work at the MIT Media Lab
+	Biomechatronics research group <http://biomech.media.mit.edu/>
+	[Contributors]
+*****************************************************************************
+	[This file] flexsea_sim_link: simulated link between two ports (host)
+*****************************************************************************
+	[Change log] (Convention: YYYY-MM-DD | author | comment)
+	* 2026-10-17 | agent | Initial release
+	*
+****************************************************************************/
+
+#ifndef FLEXSEA_COMM_INC_FLEXSEA_SIM_LINK_H_
+#define FLEXSEA_COMM_INC_FLEXSEA_SIM_LINK_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//Simulated link between two MultiCommPeriph (host only): bandwidth, latency,
+//lost writes, bit errors and inserted bytes. Time is simulated (nothing
+//sleeps) and the impairments come from a seeded generator, so a run can be
+//repeated exactly.
+
+#ifdef BOARD_TYPE_FLEXSEA_PLAN
+
+//****************************************************************************
+// Include(s)
+//****************************************************************************
+
+#include <stdint.h>
+#include "flexsea_comm_multi.h"
+#include "flexsea_transport.h"
+
+//****************************************************************************
+// Definition(s):
+//****************************************************************************
+
+#define SIM_LINK_QUEUE_LEN		8192	//Bytes in flight, per direction
+#define SIM_LINK_MAX_CHUNK		1024	//Largest delivery to a receiver
+
+//****************************************************************************
+// Structure(s)
+//****************************************************************************
+
+typedef struct
+{
+	uint32_t bitsPerSecond;		//0: no limit
+	uint8_t bitsPerByte;		//On the wire: 10 for a UART (8N1), 8 for USB
+	uint32_t delayUs;			//Propagation delay (and host latency)
+	uint16_t rxChunk;			//Bytes per delivery (DMA), 0: whole writes only
+	uint16_t packetSize;		//A write takes whole packets (USB), 0: bytes
+	double writeLoss;			//Probability that a write is lost
+	double bitErrorRate;		//Probability that a bit is flipped
+	double insertRate;			//Probability of a random byte after a byte
+	uint32_t seed;
+}SimLinkConfig;
+
+//One direction of the link
+typedef struct
+{
+	uint32_t writes;
+	uint32_t writesLost;
+	uint32_t bytesSent;
+	uint32_t bytesDelivered;
+	uint32_t bitsFlipped;
+	uint32_t bytesInserted;
+	uint32_t bytesDropped;		//Queue full (receiver overrun)
+}SimLinkStats;
+
+struct SimLink_struct;
+
+typedef struct
+{
+	struct SimLink_struct *link;
+	MultiCommPeriph *rx;
+	uint8_t bytes[SIM_LINK_QUEUE_LEN];
+	uint8_t endOfWrite[SIM_LINK_QUEUE_LEN];
+	uint64_t arrival[SIM_LINK_QUEUE_LEN];	//ns
+	uint16_t head;
+	uint16_t count;
+	uint64_t busyUntil;						//End of the last transmission (ns)
+	SimLinkStats stats;
+}SimChannel;
+
+typedef struct SimLink_struct
+{
+	SimLinkConfig config;
+	uint64_t now;				//ns
+	uint32_t random;
+	SimChannel ch[2];			//0: a to b, 1: b to a
+	MultiCommPeriph *a;
+	MultiCommPeriph *b;
+}SimLink;
+
+//****************************************************************************
+// Public Function Prototype(s):
+//****************************************************************************
+
+void simLinkInit(SimLink *l, MultiCommPeriph *a, MultiCommPeriph *b, const SimLinkConfig *config);
+uint8_t simLinkReady(SimLink *l, MultiCommPeriph *from);
+uint16_t simLinkSend(SimLink *l, MultiCommPeriph *from, const uint8_t *data, uint16_t len);
+void simLinkTransport(SimLink *l, MultiCommPeriph *from, FxTransport *t);
+uint8_t simLinkTransmit(SimLink *l, MultiCommPeriph *from);
+uint8_t simLinkTransmitBurst(SimLink *l, MultiCommPeriph *from, uint8_t *framesSent);
+uint16_t simLinkRun(SimLink *l, uint64_t until);
+uint16_t simLinkAdvance(SimLink *l, uint32_t us);
+
+//****************************************************************************
+// Shared variable(s)
+//****************************************************************************
+
+//Our links: RS-485 at 921600 baud, USB full speed (CDC)
+extern const SimLinkConfig simLinkRs485;
+extern const SimLinkConfig simLinkUsbFs;
+
+#endif	//BOARD_TYPE_FLEXSEA_PLAN
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FLEXSEA_COMM_INC_FLEXSEA_SIM_LINK_H_ */
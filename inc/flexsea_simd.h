@@ -0,0 +1,86 @@
+/****************************************************************************
+	[Project] FlexSEA: Flexible & Scalable Electronics Architecture
+	[Sub-project] 'flexsea-comm' Communication stack
+	Copyright (C) 2016 Dephy, Inc. <http://dephy.com/>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************
+	[Lead developper] Jean-Francois (JF) Duval, jfduval at dephy dot com.
+	[Origin] Based on Jean-Francois Duval's work at the MIT Media Lab
+	Biomechatronics research group <http://biomech.media.mit.edu/>
+	[Contributors]
+*****************************************************************************
+	[This file] flexsea_simd: byte kernels of the framing code (AVX2/SSE2/SWAR)
+*****************************************************************************
+	[Change log] (Convention: YYYY-MM-DD | author | comment)
+	* 2026-10-17 | agent | Initial release
+	*
+****************************************************************************/
+
+#ifndef FLEXSEA_COMM_INC_FLEXSEA_SIMD_H_
+#define FLEXSEA_COMM_INC_FLEXSEA_SIMD_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//****************************************************************************
+// Include(s)
+//****************************************************************************
+
+#include <stdint.h>
+
+//****************************************************************************
+// Definition(s):
+//****************************************************************************
+
+//Byte kernels used by the framing code. The widest implementation available
+//at compile time is selected: AVX2, then SSE2, then a word-at-a-time (SWAR)
+//version that only relies on aligned 32/64-bit loads (MCU friendly).
+#if defined(__AVX2__)
+	#define FX_SIMD_AVX2
+#elif (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+	#define FX_SIMD_SSE2
+#else
+	#define FX_SIMD_SWAR
+#endif
+
+//****************************************************************************
+// Public Function Prototype(s):
+//****************************************************************************
+
+//Returns the index of the first occurrence of 'value' in p[0..len-1], -1 if none
+int32_t fx_find_byte(const uint8_t *p, uint32_t len, uint8_t value);
+
+//8-bit additive checksum (sum of the bytes, modulo 256) of p[0..len-1]
+uint8_t fx_checksum8(const uint8_t *p, uint32_t len);
+
+//Byte stuffing: copies src to dst and puts an ESCAPE in front of every HEADER,
+//FOOTER and ESCAPE byte. Stops at the first source byte that doesn't fit in
+//dstLen (an escaped pair is never split). *srcLen: bytes available in, bytes
+//consumed out. *checksum: fx_checksum8() of dst. Returns the bytes written.
+uint32_t fx_escape(uint8_t *dst, uint32_t dstLen, const uint8_t *src, \
+					uint32_t *srcLen, uint8_t *checksum);
+
+//Removes the byte stuffing: an ESCAPE is dropped, the byte after it is kept.
+//dst can be src (in place) or before it, otherwise it needs room for len
+//bytes. *escaped carries the state from one span to the next (0 to start a
+//new string). Returns the bytes written.
+uint32_t fx_unescape(uint8_t *dst, const uint8_t *src, uint32_t len, uint8_t *escaped);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FLEXSEA_COMM_INC_FLEXSEA_SIMD_H_ */
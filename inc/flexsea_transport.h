@@ -0,0 +1,152 @@
+/****************************************************************************
+	[Project] FlexSEA: Flexible & Scalable Electronics Architecture
+	[Sub-project] 'flexsea-comm' Communication stack
+	Copyright (C) 2016 Dephy, Inc. <http://dephy.com/>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************
+	[Lead developper] Jean-Francois (JF) Duval, jfduval at dephy dot com.
+	[Origin] Based on Jean-Francois Duval's work at the MIT Media Lab
+	Biomechatronics research group <http://biomech.media.mit.edu/>
+	[Contributors]
+*****************************************************************************
+	[This file] flexsea_transport: byte transports bound to the multi ports
+*****************************************************************************
+	[Change log] (Convention: YYYY-MM-DD | author | comment)
+	* 2026-10-17 | agent | Initial release
+	*
+****************************************************************************/
+
+#ifndef FLEXSEA_COMM_INC_FLEXSEA_TRANSPORT_H_
+#define FLEXSEA_COMM_INC_FLEXSEA_TRANSPORT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//****************************************************************************
+// Include(s)
+//****************************************************************************
+
+#include <stdint.h>
+#include "flexsea.h"
+
+//****************************************************************************
+// Definition(s):
+//****************************************************************************
+
+//Host: ports can be bound to a file descriptor (tty, pty, socketpair, ...)
+#if defined(BOARD_TYPE_FLEXSEA_PLAN) && defined(__linux__)
+	#define FX_TRANSPORT_FD
+#endif
+
+//What transmitFxPacket() does with a frame for a port without a transport.
+//Manage has always reported them as sent (dropped), the others keep them
+//pending.
+#ifdef BOARD_TYPE_FLEXSEA_MANAGE
+	#define FX_TRANSPORT_UNBOUND_SENT	1
+#else
+	#define FX_TRANSPORT_UNBOUND_SENT	0
+#endif
+
+#define FX_USB_PACKET_SIZE			64		//Full speed bulk
+#define FX_COALESCE_BUF_LEN			(16 * FX_USB_PACKET_SIZE)	//x2, double buffered
+
+//Manage: the USB frames go through a coalescer (fxUsbCoalescer). The main
+//loop then has to call fxCoalescerPoll(&fxUsbCoalescer, us) for the deadline.
+//Without it, the frames of a burst are still gathered in one transfer.
+//#define FX_USB_COALESCE
+#define FX_USB_COALESCE_THRESHOLD	(4 * FX_USB_PACKET_SIZE)
+#define FX_USB_COALESCE_DEADLINE_US	1000
+
+//****************************************************************************
+// Structure(s)
+//****************************************************************************
+
+typedef struct
+{
+	const uint8_t *data;
+	uint16_t len;
+}FxIoVec;
+
+//Transmit side of a port. Only send() is mandatory.
+typedef struct
+{
+	//Sends len bytes in one transfer. Returns 0 if they were sent (or queued).
+	uint8_t (*send)(void *ctx, const uint8_t *data, uint16_t len);
+
+	//Sends several buffers in one transfer. Returns how many were sent,
+	//complete. Without it, send() is called for each buffer.
+	uint8_t (*sendVectored)(void *ctx, const FxIoVec *iov, uint8_t count);
+
+	//1 if a transfer can start now. Without it, the port is always ready.
+	uint8_t (*ready)(void *ctx);
+
+	uint16_t maxChunk;		//Largest transfer in bytes, 0: no limit
+	void *ctx;				//Given to the functions above
+}FxTransport;
+
+//Coalescing stage in front of a transport: frames (from any packet) are
+//copied to a buffer, which is sent in whole USB packets once 'threshold'
+//bytes are waiting, and completely when the oldest byte is 'deadlineUs' old.
+//Double buffered: one fills while the lower transport sends the other.
+typedef struct
+{
+	FxTransport lower;
+	uint8_t buf[2][FX_COALESCE_BUF_LEN];
+	uint8_t fill;			//Buffer being filled
+	uint16_t len;			//Bytes waiting in it
+	uint16_t threshold;
+	uint32_t deadlineUs;
+	uint32_t now;			//us, last fxCoalescerPoll()
+	uint32_t oldest;		//us, when the oldest waiting byte came in
+	uint32_t transfers;
+	uint32_t bytes;
+}FxCoalescer;
+
+//****************************************************************************
+// Public Function Prototype(s):
+//****************************************************************************
+
+void fxTransportBind(Port p, const FxTransport *t);
+uint8_t fxTransportReady(const FxTransport *t);
+uint8_t fxTransportSend(const FxTransport *t, const uint8_t *data, uint16_t len);
+uint8_t fxTransportSendVectored(const FxTransport *t, const FxIoVec *iov, uint8_t count);
+
+void fxCoalescerInit(FxCoalescer *c, const FxTransport *lower, uint16_t threshold, \
+						uint32_t deadlineUs);
+void fxCoalescerTransport(FxCoalescer *c, FxTransport *t);
+uint8_t fxCoalescerPoll(FxCoalescer *c, uint32_t nowUs);
+uint8_t fxCoalescerFlush(FxCoalescer *c);
+
+#ifdef FX_TRANSPORT_FD
+void fxTransportFd(FxTransport *t, int fd);
+#endif
+
+//****************************************************************************
+// Shared variable(s)
+//****************************************************************************
+
+//Transport of each port. The board's own are bound at compile time.
+extern FxTransport fxTransport[NUMBER_OF_PORTS];
+
+#if defined FX_USB_COALESCE && defined BOARD_TYPE_FLEXSEA_MANAGE
+extern FxCoalescer fxUsbCoalescer;
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FLEXSEA_COMM_INC_FLEXSEA_TRANSPORT_H_ */
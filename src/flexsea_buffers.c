@@ -46,7 +46,12 @@ extern "C" {
 // circular buffers - test coverage could be better:
 //****************************************************************************
 
-circularBuffer_t rx_buf_circ[NUMBER_OF_PORTS];
+//One reception buffer per port, sized by PORT_RX_BUF_SIZES (commStackConfig.h)
+#define RX_BUF_STORAGE(port, len)		uint8_t bytes_##port[len];
+#define RX_BUF_CIRC_INIT(port, len)		[port] = CIRC_BUFF_INIT(rxBufStorage.bytes_##port, len),
+
+static struct { PORT_RX_BUF_SIZES(RX_BUF_STORAGE) } rxBufStorage;
+circularBuffer_t rx_buf_circ[NUMBER_OF_PORTS] = { PORT_RX_BUF_SIZES(RX_BUF_CIRC_INIT) };
 
 #ifdef __cplusplus
 }
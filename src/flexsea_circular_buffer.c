@@ -27,166 +27,549 @@
 	* 2017-03-21 | dudds4 | Initial GPL-3.0 release
 ****************************************************************************/
 
+#if defined(BOARD_TYPE_FLEXSEA_PLAN) && defined(__linux__) && !defined(_GNU_SOURCE)
+	#define _GNU_SOURCE		//memfd_create()
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #include <flexsea_circular_buffer.h>
+#include <flexsea_simd.h>
 #include <string.h>
-#include "log.h"
-void circ_buff_init(circularBuffer_t* cb)
+#include "flexsea_log.h"
+
+#ifdef CIRC_BUFF_MIRROR
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+//****************************************************************************
+// Private Function(s) - index handling:
+//****************************************************************************
+
+#ifdef CB_ATOMICS
+
+static inline uint32_t cb_load_acquire(cb_index_t *x)
 {
-	cb->head = -1;
-	cb->tail = 0;
-	cb->size= 0;
+	return atomic_load_explicit(x, memory_order_acquire);
+}
 
-	int i = 0;
-	uint8_t* b = cb->bytes;
-	for(i=0; i<CB_BUF_LEN;i++)
-		b[i]=0;
+static inline uint32_t cb_load_relaxed(cb_index_t *x)
+{
+	return atomic_load_explicit(x, memory_order_relaxed);
 }
 
-int circ_buff_write(circularBuffer_t* cb, uint8_t *writeFrom, uint16_t numBytes)
+static inline void cb_store_release(cb_index_t *x, uint32_t v)
+{
+	atomic_store_explicit(x, v, memory_order_release);
+}
+
+#else
+
+//Single core MCU: keep the compiler from moving byte accesses across
+#if defined(__GNUC__)
+	#define CB_BARRIER()	__asm__ __volatile__("" ::: "memory")
+#else
+	#define CB_BARRIER()
+#endif
+
+static inline uint32_t cb_load_acquire(cb_index_t *x)
+{
+	uint32_t v = *x;
+	CB_BARRIER();
+	return v;
+}
+
+static inline uint32_t cb_load_relaxed(cb_index_t *x)
+{
+	return *x;
+}
+
+static inline void cb_store_release(cb_index_t *x, uint32_t v)
+{
+	CB_BARRIER();
+	*x = v;
+}
+
+#endif	//CB_ATOMICS
+
+#ifdef CB_BUF_LEN_LOG2
+
+//Position (head/tail) to array index
+static inline uint32_t cb_index(const circularBuffer_t* cb, uint32_t pos)
+{
+	return pos & (cb->capacity - 1);
+}
+
+static inline uint32_t cb_advance(const circularBuffer_t* cb, uint32_t pos, uint32_t n)
+{
+	(void)cb;
+	return pos + n;
+}
+
+static inline int cb_distance(const circularBuffer_t* cb, uint32_t from, uint32_t to)
+{
+	(void)cb;
+	return (int)(to - from);
+}
+
+//Array index of 'offset' bytes from head
+static inline uint32_t cb_offset_index(const circularBuffer_t* cb, uint32_t head, \
+										uint32_t offset)
+{
+	return (head + offset) & (cb->capacity - 1);
+}
+
+#else
+
+//Position (head/tail) to array index
+static inline uint32_t cb_index(const circularBuffer_t* cb, uint32_t pos)
+{
+	return pos >= cb->capacity ? pos - cb->capacity : pos;
+}
+
+//Moves a position by n <= 2*capacity (one lap)
+static inline uint32_t cb_advance(const circularBuffer_t* cb, uint32_t pos, uint32_t n)
+{
+	uint32_t lap = 2 * (uint32_t)cb->capacity;
+	pos += n;
+	return pos >= lap ? pos - lap : pos;
+}
+
+static inline int cb_distance(const circularBuffer_t* cb, uint32_t from, uint32_t to)
+{
+	return to >= from ? (int)(to - from) : (int)(to + 2 * (uint32_t)cb->capacity - from);
+}
+
+//Array index of 'offset' bytes from head (offset <= capacity)
+static inline uint32_t cb_offset_index(const circularBuffer_t* cb, uint32_t head, \
+										uint32_t offset)
 {
-    const int MSG_BIGGER_THAN_BUFFER = 1;
-	const int OVERWROTE = 2;
-    const int SUCCESS = 0;
+	uint32_t i = cb_index(cb, head) + offset;
+	return i >= cb->capacity ? i - cb->capacity : i;
+}
+
+#endif	//CB_BUF_LEN_LOG2
 
-	if(numBytes > CB_BUF_LEN) { return MSG_BIGGER_THAN_BUFFER; }
+//Consumer side view of the buffer: our own head, and the published tail
+static inline int cb_size(circularBuffer_t* cb, uint32_t *head)
+{
+	*head = cb_load_relaxed(&cb->head);
+	return cb_distance(cb, *head, cb_load_acquire(&cb->tail));
+}
 
-	if(cb->tail + numBytes <= CB_BUF_LEN)
+//Producer side, after publishing: peak size and backpressure. Reports when
+//size goes from below the watermark to newSize, at or above it.
+static void cb_account_write(circularBuffer_t* cb, int size, int newSize)
+{
+	if(newSize > cb->stats.peakSize) { cb->stats.peakSize = newSize; }
+	if(cb->highWatermark && size < cb->highWatermark && newSize >= cb->highWatermark)
 	{
-		memcpy(cb->bytes + cb->tail, writeFrom, numBytes);
+		cb->stats.highWatermarks++;
+		if(cb->onHighWatermark) { cb->onHighWatermark(cb, newSize); }
 	}
-	else
+}
+
+#ifdef CB_SOF_INDEX
+
+//****************************************************************************
+// Private Function(s) - SOF index:
+//****************************************************************************
+
+//Producer side: records the HEADERs of the n bytes (p) that will be at
+//position 'pos'. One slot is kept for the gap marker: when the index is full
+//we note where we stopped recording, and resume once the consumer has
+//released slots.
+static void cb_sof_record(circularBuffer_t* cb, uint32_t pos, const uint8_t *p, uint32_t n)
+{
+	uint32_t count = cb_load_relaxed(&cb->sofCount);
+	uint32_t used = count - cb_load_acquire(&cb->sofRead);
+	uint32_t from = 0;
+	int32_t k;
+
+	while(from < n && (k = fx_find_byte(p + from, n - from, HEADER)) >= 0)
 	{
-		uint16_t bytesUntilEnd = CB_BUF_LEN - cb->tail;
-		memcpy(cb->bytes + cb->tail, writeFrom, bytesUntilEnd);
-		memcpy(cb->bytes, writeFrom + bytesUntilEnd, numBytes - bytesUntilEnd);
+		uint32_t i = count & (CB_SOF_SLOTS - 1);
+		from += k;
+		if(used < CB_SOF_SLOTS - 1)
+		{
+			cb->sof[i] = cb_advance(cb, pos, from);
+			cb->sofGap[i] = 0;
+			cb->sofProducerGap = 0;
+			count++;
+			used++;
+		}
+		else if(!cb->sofProducerGap)
+		{
+			cb->sof[i] = cb_advance(cb, pos, from);
+			cb->sofGap[i] = 1;
+			cb->sofProducerGap = 1;
+			count++;
+			used++;
+		}
+		from++;
 	}
 
-	if(cb->head < 0) cb->head = 0;
-	cb->tail = (cb->tail + numBytes) % CB_BUF_LEN;
-	cb->size += numBytes;
+	cb_store_release(&cb->sofCount, count);
+}
+
+//Consumer side: head is about to move by n bytes
+static void cb_sof_release(circularBuffer_t* cb, uint32_t head, int n)
+{
+	uint32_t count = cb_load_acquire(&cb->sofCount);
+	uint32_t r = cb_load_relaxed(&cb->sofRead);
 
-	if(cb->size > CB_BUF_LEN)
+	while(r != count)
 	{
-		LOG(lwarning, "CB has been overwritten");
-		cb->size = CB_BUF_LEN;
-		cb->head = cb->tail;
-		return OVERWROTE;
+		uint32_t i = r & (CB_SOF_SLOTS - 1);
+		if(cb_distance(cb, head, cb->sof[i]) >= n) { break; }
+		//Past a gap marker the index is incomplete until the next entry:
+		cb->sofConsumerGap = cb->sofGap[i];
+		r++;
 	}
+
+	cb_store_release(&cb->sofRead, r);
+}
+
+#endif	//CB_SOF_INDEX
+
+//****************************************************************************
+// Public Function(s):
+//****************************************************************************
+
+//Gives the buffer its storage (capacity bytes, owned by the caller) and
+//empties it. Call it once, before any other function.
+int circ_buff_attach(circularBuffer_t* cb, uint8_t *storage, uint16_t capacity)
+{
+	const int SUCCESS = 0;
+	const int INVALID_ARGS = 1;
+
+	if(!cb || !storage || !capacity) { return INVALID_ARGS; }
+
+	#ifdef CB_BUF_LEN_LOG2
+	//Mask indexing: round down to a power of two
+	if(capacity & (capacity - 1))
+	{
+		FX_LOG(lwarning, "CB capacity %u isn't a power of two", capacity);
+		while(capacity & (capacity - 1)) { capacity &= capacity - 1; }
+	}
+	#endif
+
+	cb->bytes = storage;
+	cb->capacity = capacity;
+	cb->mapped = capacity;
+	cb->policy = CB_DEFAULT_POLICY;
+	cb->highWatermark = 0;
+	cb->onHighWatermark = NULL;
+	circ_buff_init(cb);
 	return SUCCESS;
 }
 
-uint8_t circ_buff_peak(circularBuffer_t* cb, uint16_t offset)
+#ifdef CIRC_BUFF_MIRROR
+
+//Allocates the storage and maps it twice in a row: bytes[capacity + i] is
+//bytes[i]. capacity is rounded up to a multiple of the page size. Release it
+//with circ_buff_detach_mirrored().
+int circ_buff_attach_mirrored(circularBuffer_t* cb, uint16_t capacity)
+{
+	const int SUCCESS = 0;
+	const int INVALID_ARGS = 1;
+	const int MAPPING_FAILED = 2;
+
+	if(!cb || !capacity) { return INVALID_ARGS; }
+
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t len = capacity;
+	#ifdef CB_BUF_LEN_LOG2
+	size_t pow2 = 1;
+	while(pow2 < len) { pow2 <<= 1; }
+	len = pow2;
+	#endif
+	len = (len + page - 1) / page * page;
+	if(len > 0xFFFF) { return INVALID_ARGS; }
+
+	int fd = memfd_create("flexsea_cb", MFD_CLOEXEC);
+	if(fd < 0) { return MAPPING_FAILED; }
+
+	//Reserve the address range, then map the same pages in both halves
+	void *base = MAP_FAILED;
+	if(ftruncate(fd, len) == 0)
+	{
+		base = mmap(NULL, 2 * len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	}
+	if(base != MAP_FAILED && \
+		(mmap(base, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED || \
+		mmap((uint8_t *)base + len, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED))
+	{
+		munmap(base, 2 * len);
+		base = MAP_FAILED;
+	}
+	close(fd);
+
+	if(base == MAP_FAILED)
+	{
+		FX_LOG(lerror, "CB mirror mapping failed");
+		return MAPPING_FAILED;
+	}
+
+	cb->bytes = (uint8_t *)base;
+	cb->capacity = len;
+	cb->mapped = 2 * len;
+	cb->policy = CB_DEFAULT_POLICY;
+	cb->highWatermark = 0;
+	cb->onHighWatermark = NULL;
+	circ_buff_init(cb);
+	return SUCCESS;
+}
+
+void circ_buff_detach_mirrored(circularBuffer_t* cb)
 {
-    if(offset >= cb->size) return 0;
-    return cb->bytes[((cb->head + offset) % CB_BUF_LEN)];
+	if(!cb || !cb->bytes || cb->mapped != 2 * (uint32_t)cb->capacity) { return; }
+
+	munmap(cb->bytes, cb->mapped);
+	cb->bytes = NULL;
+	cb->capacity = 0;
+	cb->mapped = 0;
 }
 
-int32_t circ_buff_search(circularBuffer_t* cb, uint8_t value, uint16_t start)
+#endif	//CIRC_BUFF_MIRROR
+
+//Empties the buffer and clears its stats. The storage and the overflow
+//settings are kept. The buffer has to be attached first: returns 1 (and
+//touches nothing) if it has no storage.
+int circ_buff_init(circularBuffer_t* cb)
 {
-    if(start >= cb->size) return -1;
-    int i = start;
-    int index = cb->head + start;
+	const int SUCCESS = 0;
+	const int INVALID_ARGS = 1;
 
-    while(i < cb->size && index < CB_BUF_LEN)
-    {
-        if(cb->bytes[index] == value) return i;
-        i++;
-        index++;
-    }
+	if(!cb || !cb->bytes || !cb->capacity) { return INVALID_ARGS; }
 
-    index %= CB_BUF_LEN;
+	cb_store_release(&cb->head, 0);
+	cb_store_release(&cb->tail, 0);
+	memset(&cb->stats, 0, sizeof(CircBuffStats));
 
-    while(i < cb->size)
-    {
-        if(cb->bytes[index] == value) return i;
-        i++;
-        index++;
-    }
+	#ifdef CB_SOF_INDEX
+	cb_store_release(&cb->sofCount, 0);
+	cb_store_release(&cb->sofRead, 0);
+	cb->sofProducerGap = 0;
+	cb->sofConsumerGap = 0;
+	#endif
 
-    return -1;
+	#ifdef SCRUB_BUFFERS
+	memset(cb->bytes, 0, cb->capacity);
+	#endif
+
+	return SUCCESS;
 }
 
-int32_t circ_buff_search_not(circularBuffer_t* cb, uint8_t value, uint16_t start)
+//Producer side. Safe to call while the consumer is parsing, as long as the
+//buffer doesn't overflow (or CIRC_BUFF_SPSC is defined).
+int circ_buff_write(circularBuffer_t* cb, uint8_t *writeFrom, uint16_t numBytes)
 {
-    if(start > cb->size) return -1;
+	const int MSG_BIGGER_THAN_BUFFER = 1;
+	const int NOT_ENOUGH_SPACE = 3;
+	const int SUCCESS = 0;
 
-    uint16_t i = start;
+	if(numBytes > cb->capacity)
+	{
+		cb->stats.overflows++;
+		cb->stats.rejectedBytes += numBytes;
+		return MSG_BIGGER_THAN_BUFFER;
+	}
 
-    uint16_t idx = (cb->head + start);
-    while(idx < CB_BUF_LEN && i < cb->size && cb->bytes[idx] == value)
-    {
-        idx++;
-        i++;
-    }
+	uint32_t head = cb_load_acquire(&cb->head);
+	uint32_t tail = cb_load_relaxed(&cb->tail);
+	int size = cb_distance(cb, head, tail);
+	int result = SUCCESS;
 
-    idx = idx % CB_BUF_LEN;
-    while(idx < CB_BUF_LEN && i < cb->size && cb->bytes[idx] == value)
-    {
-        idx++;
-        i++;
-    }
+	int overflow = size + numBytes - cb->capacity;
+	if(overflow > 0)
+	{
+		int drop = overflow;
+		cb->stats.overflows++;
+		#ifdef CIRC_BUFF_SPSC
+		(void)drop;
+		#endif
+
+		switch(cb->policy)
+		{
+			#ifndef CIRC_BUFF_SPSC
+			case CB_DROP_TO_FRAME:
+				//Cut at a frame boundary so the parser doesn't see a partial frame
+				drop = circ_buff_search(cb, HEADER, overflow);
+				if(drop < 0) { drop = size; }
+				//Fall through
+			case CB_OVERWRITE_OLDEST:
+				//Oldest bytes are gone. Only safe without a concurrent consumer!
+				FX_LOG_ID_EVERY(FX_LOG_PERIOD, FXLOG_CB_OVERWRITTEN, (uint32_t)drop);
+				#ifdef CB_SOF_INDEX
+				cb_sof_release(cb, head, drop);
+				#endif
+				head = cb_advance(cb, head, drop);
+				cb_store_release(&cb->head, head);
+				cb->stats.droppedBytes += drop;
+				size -= drop;
+				result = CB_OVERWROTE;
+				break;
+			#endif	//CIRC_BUFF_SPSC
+			default:
+				cb->stats.rejectedBytes += numBytes;
+				return NOT_ENOUGH_SPACE;
+		}
+	}
 
-    return i;
+	uint32_t t = cb_index(cb, tail);
+	if(t + numBytes <= cb->mapped)
+	{
+		memcpy(cb->bytes + t, writeFrom, numBytes);
+	}
+	else
+	{
+		uint16_t bytesUntilEnd = cb->mapped - t;
+		memcpy(cb->bytes + t, writeFrom, bytesUntilEnd);
+		memcpy(cb->bytes, writeFrom + bytesUntilEnd, numBytes - bytesUntilEnd);
+	}
+
+	#ifdef CB_SOF_INDEX
+	cb_sof_record(cb, tail, writeFrom, numBytes);
+	#endif
+
+	tail = cb_advance(cb, tail, numBytes);
+	cb_store_release(&cb->tail, tail);
+
+	cb_account_write(cb, size, size + numBytes);
+	return result;
 }
 
-uint8_t circ_buff_checksum(circularBuffer_t* cb, uint16_t start, uint16_t end)
+uint8_t circ_buff_peak(circularBuffer_t* cb, uint16_t offset)
 {
-    if(start >= cb->size || end > cb->size) return 0;
-	if(end - start < 1) return 0;
+	uint32_t head;
+	if(offset >= cb_size(cb, &head)) return 0;
+	return cb->bytes[cb_offset_index(cb, head, offset)];
+}
+
+int32_t circ_buff_search(circularBuffer_t* cb, uint8_t value, uint16_t start)
+{
+	uint32_t head;
+	int size = cb_size(cb, &head);
+	if(start >= size) return -1;
+
+	//The live bytes are at most two linear spans: [index, end of array) and
+	//[0, tail). Each one is handed to the vectorized search as a whole.
+	int index = cb_offset_index(cb, head, start);
+	int remaining = size - start;
+	int end = (int)cb->mapped - index;
+	int firstLen = remaining < end ? remaining : end;
+
+	int32_t found = fx_find_byte(cb->bytes + index, firstLen, value);
+	if(found >= 0) return start + found;
 
-    uint8_t checksum = 0;
+	found = fx_find_byte(cb->bytes, remaining - firstLen, value);
+	if(found >= 0) return start + firstLen + found;
 
-    int i = (cb->head + start); //no modulo on purpose. (it would have no ultimate effect)
-	int j = (cb->head + end);
+	return -1;
+}
+
+//Offset of the first HEADER at or after 'start', -1 if none. Same result as
+//circ_buff_search(cb, HEADER, start), from the SOF index when enabled.
+int32_t circ_buff_search_sof(circularBuffer_t* cb, uint16_t start)
+{
+	#ifdef CB_SOF_INDEX
 
-	while(i < j && i < CB_BUF_LEN)
-		checksum += cb->bytes[i++];
+	uint32_t head;
+	int size = cb_size(cb, &head);
+	if(start >= size) return -1;
 
-    i %= CB_BUF_LEN;
-	j %= CB_BUF_LEN;
+	uint32_t count = cb_load_acquire(&cb->sofCount);
+	uint32_t r = cb_load_relaxed(&cb->sofRead);
+	int32_t found;
 
-    while(i < j)
-        checksum += cb->bytes[i++];
+	//Start of a part that wasn't recorded (gap), -1 if none
+	int scanFrom = cb->sofConsumerGap ? 0 : -1;
 
-    return checksum;
+	for(; r != count; r++)
+	{
+		uint32_t i = r & (CB_SOF_SLOTS - 1);
+		int offset = cb_distance(cb, head, cb->sof[i]);
+		if(offset >= size) { break; }
+
+		if(scanFrom >= 0 && offset > start)
+		{
+			found = circ_buff_search(cb, HEADER, scanFrom > start ? scanFrom : start);
+			if(found >= 0 && found < offset) { return found; }
+		}
+		scanFrom = -1;
+
+		if(cb->sofGap[i]) { scanFrom = offset; }
+		else if(offset >= start) { return offset; }
+	}
+
+	if(scanFrom >= 0) { return circ_buff_search(cb, HEADER, scanFrom > start ? scanFrom : start); }
+	return -1;
+
+	#else
+
+	return circ_buff_search(cb, HEADER, start);
+
+	#endif	//CB_SOF_INDEX
 }
 
-int circ_buff_read(circularBuffer_t* cb, uint8_t* readInto, uint16_t numBytes)
+int32_t circ_buff_search_not(circularBuffer_t* cb, uint8_t value, uint16_t start)
+{
+	uint32_t head;
+	int size = cb_size(cb, &head);
+	if(start > size) return -1;
+
+	int i = start;
+	uint32_t idx = cb_offset_index(cb, head, start);
+	while(i < size && cb->bytes[idx] == value)
+	{
+		i++;
+		if(++idx >= cb->mapped) { idx = 0; }
+	}
+
+	return i;
+}
+
+uint8_t circ_buff_checksum(circularBuffer_t* cb, uint16_t start, uint16_t end)
 {
-    const int SUCCESS = 0;
-    const int NOT_ENOUGH_BUFFERED = 1;
+	uint32_t head;
+	int size = cb_size(cb, &head);
+	if(start >= size || end > size) return 0;
+	if(end - start < 1) return 0;
+
+	uint8_t checksum;
 
-    if(numBytes > cb->size) { return NOT_ENOUGH_BUFFERED; }
+	uint32_t i = cb_offset_index(cb, head, start);
+	int n = end - start;
+	int firstLen = n < (int)(cb->mapped - i) ? n : (int)(cb->mapped - i);
+	n -= firstLen;
 
-    if(cb->head + numBytes < CB_BUF_LEN)
-    {
-        memcpy(readInto, cb->bytes + cb->head, numBytes);
-    }
-    else
-    {
-		uint16_t bytesUntilEnd = CB_BUF_LEN - cb->head;
-        memcpy(readInto, cb->bytes + cb->head, bytesUntilEnd);
-        memcpy(readInto + bytesUntilEnd, cb->bytes, numBytes - bytesUntilEnd);
-    }
+	checksum = fx_checksum8(cb->bytes + i, firstLen);
+	checksum += fx_checksum8(cb->bytes, n);
 
-    return SUCCESS;
+	return checksum;
+}
+
+int circ_buff_read(circularBuffer_t* cb, uint8_t* readInto, uint16_t numBytes)
+{
+	return circ_buff_read_section(cb, readInto, 0, numBytes);
 }
 
 int circ_buff_read_section(circularBuffer_t* cb, uint8_t* readInto, uint16_t start, uint16_t numBytes)
 {
-    const int SUCCESS = 0;
-    const int INVALID_ARGS = 1;
+	const int SUCCESS = 0;
+	const int INVALID_ARGS = 1;
 
-	if(!cb || !readInto || start + numBytes > cb->size) { return INVALID_ARGS; }
+	uint32_t head;
+	if(!cb || !readInto || start + numBytes > cb_size(cb, &head)) { return INVALID_ARGS; }
 
-	uint16_t s = (cb->head + start) % CB_BUF_LEN;
-	if(s + numBytes > CB_BUF_LEN)
+	uint16_t s = cb_offset_index(cb, head, start);
+	if(s + numBytes > cb->mapped)
 	{
-		uint16_t bytesUntilEnd = CB_BUF_LEN - s;
+		uint16_t bytesUntilEnd = cb->mapped - s;
 		memcpy(readInto, cb->bytes + s, bytesUntilEnd);
 		memcpy(readInto + bytesUntilEnd, cb->bytes, numBytes - bytesUntilEnd);
 	}
@@ -197,51 +580,157 @@ int circ_buff_read_section(circularBuffer_t* cb, uint8_t* readInto, uint16_t sta
 	return SUCCESS;
 }
 
+//Consumer side: releases numBytes to the producer
 int circ_buff_move_head(circularBuffer_t* cb, uint16_t numBytes)
 {
-    const int SUCCESS = 0;
-    const int MOVED_MORE_THAN_BUFFERED = 1;
+	const int SUCCESS = 0;
+	const int MOVED_MORE_THAN_BUFFERED = 1;
 	const int MOVED_MORE_THAN_MAX = 2;
 
+	uint32_t head;
+	int size = cb_size(cb, &head);
+
 	int result = SUCCESS;
-	if(numBytes > CB_BUF_LEN)
+	if(numBytes > cb->capacity)
 		result = MOVED_MORE_THAN_MAX;
-	else if(numBytes > cb->size)
+	else if(numBytes > size)
 		result = MOVED_MORE_THAN_BUFFERED;
 
-	numBytes = numBytes < CB_BUF_LEN ? numBytes : CB_BUF_LEN;
-
-	if(cb->head < 0) //buffer is already empty
-		return result;
+	numBytes = numBytes < size ? numBytes : size;
 
-	if(cb->head + numBytes > CB_BUF_LEN)
+	#ifdef SCRUB_BUFFERS
+	uint32_t h = cb_index(cb, head);
+	if(h + numBytes > cb->mapped)
 	{
-		uint16_t bytesUntilEnd = CB_BUF_LEN - cb->head;
-		memset(cb->bytes + cb->head, 0, bytesUntilEnd);
+		uint16_t bytesUntilEnd = cb->mapped - h;
+		memset(cb->bytes + h, 0, bytesUntilEnd);
 		memset(cb->bytes, 0, numBytes - bytesUntilEnd);
 	}
 	else
 	{
-		memset(cb->bytes + cb->head, 0, numBytes);
+		memset(cb->bytes + h, 0, numBytes);
 	}
+	#endif	//SCRUB_BUFFERS
 
-	cb->size -= numBytes;
-	if(cb->size < 1)
-	{
-		cb->head = -1;
-		cb->tail = 0;
-		cb->size = 0;
-	}
-	else
-	{
-		cb->head = (cb->head + numBytes) % CB_BUF_LEN;
-	}
+	#ifdef CB_SOF_INDEX
+	cb_sof_release(cb, head, numBytes);
+	#endif
+
+	cb_store_release(&cb->head, cb_advance(cb, head, numBytes));
 
 	return result;
 }
 
-int circ_buff_get_size(circularBuffer_t* cb)  { return cb->size; }
-int circ_buff_get_space(circularBuffer_t* cb)  { return CB_BUF_LEN - cb->size; }
+int circ_buff_get_size(circularBuffer_t* cb)
+{
+	uint32_t head;
+	return cb_size(cb, &head);
+}
+
+int circ_buff_get_capacity(circularBuffer_t* cb)
+{
+	return cb->capacity;
+}
+
+//Returns 1 if the policy isn't available (CIRC_BUFF_SPSC: reject only)
+int circ_buff_set_policy(circularBuffer_t* cb, CircBuffPolicy policy)
+{
+	const int SUCCESS = 0;
+	const int INVALID_POLICY = 1;
+
+	#ifdef CIRC_BUFF_SPSC
+	if(policy != CB_REJECT_NEW) { return INVALID_POLICY; }
+	#else
+	if(policy > CB_DROP_TO_FRAME) { return INVALID_POLICY; }
+	#endif
+
+	cb->policy = policy;
+	return SUCCESS;
+}
+
+//callback(cb, size) is called every time size goes from below 'level' to
+//'level' or more. level = 0 disables it.
+void circ_buff_set_high_watermark(circularBuffer_t* cb, uint16_t level, \
+								void (*callback)(circularBuffer_t *cb, int size))
+{
+	cb->highWatermark = level;
+	cb->onHighWatermark = callback;
+}
+
+int circ_buff_get_space(circularBuffer_t* cb)
+{
+	return cb->capacity - cb_distance(cb, cb_load_acquire(&cb->head), cb_load_acquire(&cb->tail));
+}
+
+//Producer side: largest free span that starts at tail. Fill it (DMA, read()
+//...) then publish the bytes with circ_buff_commit_write(). len is 0 when full.
+int circ_buff_acquire_write(circularBuffer_t* cb, uint8_t **ptr, uint16_t *len)
+{
+	const int SUCCESS = 0;
+	const int INVALID_ARGS = 1;
+
+	if(!cb || !ptr || !len) { return INVALID_ARGS; }
+
+	uint32_t tail = cb_load_relaxed(&cb->tail);
+	int space = cb->capacity - cb_distance(cb, cb_load_acquire(&cb->head), tail);
+	uint32_t t = cb_index(cb, tail);
+
+	*ptr = cb->bytes + t;
+	*len = space < (int)(cb->mapped - t) ? space : (int)(cb->mapped - t);
+	return SUCCESS;
+}
+
+int circ_buff_commit_write(circularBuffer_t* cb, uint16_t numBytes)
+{
+	const int SUCCESS = 0;
+	const int NOT_ENOUGH_SPACE = 3;
+
+	uint32_t tail = cb_load_relaxed(&cb->tail);
+	int size = cb_distance(cb, cb_load_acquire(&cb->head), tail);
+	if(numBytes > cb->capacity - size) { return NOT_ENOUGH_SPACE; }
+
+	#ifdef CB_SOF_INDEX
+	uint32_t t = cb_index(cb, tail);
+	uint32_t firstLen = numBytes < cb->mapped - t ? numBytes : cb->mapped - t;
+	cb_sof_record(cb, tail, cb->bytes + t, firstLen);
+	cb_sof_record(cb, cb_advance(cb, tail, firstLen), cb->bytes, numBytes - firstLen);
+	#endif
+
+	cb_store_release(&cb->tail, cb_advance(cb, tail, numBytes));
+	cb_account_write(cb, size, size + numBytes);
+	return SUCCESS;
+}
+
+//Consumer side: span of buffered bytes that starts at head. Use it in place
+//then release it with circ_buff_consume(). A second call after consuming
+//returns the wrapped part, if any. len is 0 when empty.
+int circ_buff_peek_contiguous(circularBuffer_t* cb, uint8_t **ptr, uint16_t *len)
+{
+	const int SUCCESS = 0;
+	const int INVALID_ARGS = 1;
+
+	if(!cb || !ptr || !len) { return INVALID_ARGS; }
+
+	uint32_t head;
+	int size = cb_size(cb, &head);
+	uint32_t h = cb_index(cb, head);
+
+	*ptr = cb->bytes + h;
+	*len = size < (int)(cb->mapped - h) ? size : (int)(cb->mapped - h);
+	return SUCCESS;
+}
+
+int circ_buff_consume(circularBuffer_t* cb, uint16_t numBytes)
+{
+	return circ_buff_move_head(cb, numBytes);
+}
+
+//Array index of the byte 'offset' positions after head (offset <= capacity)
+uint16_t circ_buff_index_of(circularBuffer_t* cb, uint16_t offset)
+{
+	return cb_offset_index(cb, cb_load_relaxed(&cb->head), offset);
+}
+
 #ifdef __cplusplus
 }
 #endif
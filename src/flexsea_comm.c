@@ -63,7 +63,8 @@ extern "C" {
 #include <stdlib.h>
 #include <stdint.h>
 #include <flexsea_comm.h>
-#include "log.h"
+#include <flexsea_simd.h>
+#include "flexsea_log.h"
 #include "flexsea_user_structs.h"
 //****************************************************************************
 // Variable(s)
@@ -75,15 +76,32 @@ uint8_t rx_command[NUMBER_OF_PORTS][COMM_PERIPH_ARR_LEN];
 PacketWrapper packet[NUMBER_OF_PORTS][2];
 CommPeriph commPeriph[NUMBER_OF_PORTS];
 
-uint32_t cmd_valid = 0;
-uint32_t cmd_bad_checksum = 0;
-
 struct commSpy_s commSpy1 = {0,0,0,0,0,0,0};
 
+//Snapshot attempts before we give up (the writer can't finish while we spin
+//in an interrupt)
+#define COMM_STATS_TRIES		8
+
+#if !defined(CB_ATOMICS) && defined(__GNUC__)
+	#define COMM_STATS_FENCE()	__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#elif !defined(CB_ATOMICS)
+	#define COMM_STATS_FENCE()
+#endif
+
+//decoderCheckFrame() results, for a frame that isn't valid
+#define DECODER_REJECTED		-1
+#define DECODER_INCOMPLETE		-2
+
 //****************************************************************************
 // Private Function Prototype(s):
 //****************************************************************************
 
+static uint8_t findFrame(circularBuffer_t *cb, int start, CommFrame *frame);
+static uint8_t decodeNextFrame(circularBuffer_t *cb, CommDecoder *d, CommFrame *frame);
+static int decoderCheckFrame(circularBuffer_t *cb, CommDecoder *d, uint16_t headerPos, \
+								int bufSize);
+static void decoderRebase(circularBuffer_t *cb, CommDecoder *d, uint16_t consumed);
+static uint16_t packedFrameLen(const uint8_t *packed, uint16_t *payloadLen);
 
 //****************************************************************************
 // Public Function(s)
@@ -92,48 +110,32 @@ struct commSpy_s commSpy1 = {0,0,0,0,0,0,0};
 //Takes payload, adds ESCAPES, checksum, header, ...
 uint8_t comm_gen_str(uint8_t payload[], uint8_t *cstr, uint8_t bytes)
 {
-	LOG(linfo,"Comm string too long, abort");
-	unsigned int i = 0, escapes = 0, idx = 0, total_bytes = 0;
+	FX_LOG_ID(FXLOG_GEN_STR_CALLED);
+	unsigned int escapes = 0, idx = 0, total_bytes = 0;
+	uint32_t consumed = bytes;
 	uint8_t checksum = 0;
 
 	//Fill comm_str with known values ('a')
 	memset(cstr, 0xAA, COMM_STR_BUF_LEN);
 
-	//Fill comm_str with payload and add ESCAPE characters
-	escapes = 0;
-	idx = 2;
-	for(i = 0; i < bytes && idx < COMM_STR_BUF_LEN; i++)
-	{
-		if ((payload[i] == HEADER) || (payload[i] == FOOTER) || (payload[i] == ESCAPE))
-		{
-			escapes = escapes + 1;
-			cstr[idx] = ESCAPE;
-			cstr[idx+1] = payload[i];
-			checksum += cstr[idx];
-			checksum += cstr[idx+1];
-			idx = idx + 1;
-		}
-		else
-		{
-			cstr[idx] = payload[i];
-			checksum += cstr[idx];
-		}
-		idx++;
-	}
+	//Fill comm_str with payload and add ESCAPE characters (checksum computed
+	//on the way)
+	total_bytes = fx_escape(cstr + 2, COMM_STR_BUF_LEN - 2, payload, &consumed, &checksum);
+	escapes = total_bytes - consumed;
+	idx = 2 + total_bytes;
 
-	if((idx + 2) >= COMM_STR_BUF_LEN)
+	if(consumed < bytes || (idx + 2) >= COMM_STR_BUF_LEN)
 	{
-		LOG(lwarning,"Comm string too long, abort");
+		FX_LOG_ID(FXLOG_GEN_STR_TOO_LONG, bytes);
+		commSpy1.error++;
 		memset(cstr, 0, COMM_STR_BUF_LEN);	//Clear string
 		return 0;
 	}
 
-	total_bytes = bytes + escapes;
 
 	commSpy1.bytes = bytes;
 	commSpy1.escapes = (uint8_t) escapes;
 	commSpy1.total_bytes = (uint8_t) total_bytes;
-	commSpy1.error++;
 
 	//String length?
 	if(total_bytes >= COMM_STR_BUF_LEN)
@@ -141,6 +143,7 @@ uint8_t comm_gen_str(uint8_t payload[], uint8_t *cstr, uint8_t bytes)
 		//Too long, abort:
 		memset(cstr, 0, COMM_STR_BUF_LEN);	//Clear string
 		commSpy1.retVal = 0;
+		commSpy1.error++;
 		return 0;
 	}
 
@@ -180,76 +183,250 @@ void generateRandomUint8_tArray(uint8_t *arr, uint8_t size)
 
 uint16_t unpack_payload_cb(circularBuffer_t *cb, uint8_t *packed, uint8_t unpacked[PACKAGED_PAYLOAD_LEN])
 {
-	LOG(linfo,"unpack_payload_cb called");
-	int bufSize = circ_buff_get_size(cb);
+	FX_LOG_ID(FXLOG_UNPACK_CALLED);
+	CommFrame frame;
 
-	int foundString = 0, foundFrame = 0, bytes, possibleFooterPos;
-	int lastPossibleHeaderIndex = bufSize - 4;
-	int headerPos = -1, lastHeaderPos = -1;
-	uint8_t checksum = 0;
+	if(!findFrame(cb, 0, &frame)) { return 0; }
 
-	int headers = 0, footers = 0;
-	while(!foundString && lastHeaderPos < lastPossibleHeaderIndex)
+	FX_LOG_ID(FXLOG_STRING_FOUND, frame.bytes);
+	unpack_payload_frame(cb, &frame, packed, unpacked);
+	return COMM_FRAME_END(frame);
+}
+
+//Incremental version of unpack_payload_cb(): every call only hunts for
+//HEADERs in the bytes received since the previous call. The decoder state (in
+//CommPeriphSub) remembers where it stopped and the candidate frames that were
+//still incomplete. Like unpack_payload_cb(), the valid frame with the first
+//HEADER wins. Returns the number of bytes to consume (0 if no
+//valid frame). The frame is copied & unescaped once it is validated.
+uint16_t unpack_payload_stream(circularBuffer_t *cb, CommDecoder *d, uint8_t *packed, \
+								uint8_t *unpacked)
+{
+	CommFrame frame;
+
+	if(!decodeNextFrame(cb, d, &frame)) { return 0; }
+
+	FX_LOG_ID(FXLOG_STRING_FOUND, frame.bytes);
+	unpack_payload_frame(cb, &frame, packed, unpacked);
+
+	//The caller is about to move the head past this frame:
+	resetCommDecoder(d);
+	return COMM_FRAME_END(frame);
+}
+
+//unpack_payload_stream() for a peripheral: the frame goes to rx->packedPtr and
+//its payload to rx->unpackedPtr (see fillPacketFromCommPeriph())
+uint16_t unpack_payload_periph(CommPeriphSub *rx)
+{
+	CommFrame frame;
+	uint8_t unpackedLen;
+
+	if(!decodeNextFrame(rx->circularBuff, &rx->decoder, &frame)) { return 0; }
+
+	unpackedLen = unpack_payload_frame(rx->circularBuff, &frame, rx->packedPtr, \
+										rx->unpackedPtr);
+	commStatsRx(rx, &frame, 1, frame.bytes - unpackedLen);
+
+	resetCommDecoder(&rx->decoder);
+	return COMM_FRAME_END(frame);
+}
+
+//Batch version of unpack_payload_stream(): locates and validates every
+//complete frame (up to max) in one sweep. Nothing is copied: unpack them one
+//by one with unpack_payload_frame(), then consume them all with a single
+//circ_buff_move_head(cb, COMM_FRAME_END(frames[n-1])). Returns n.
+uint8_t unpack_payload_stream_batch(circularBuffer_t *cb, CommDecoder *d, \
+									CommFrame frames[], uint8_t max)
+{
+	uint8_t n = 0;
+
+	while(n < max && decodeNextFrame(cb, d, &frames[n]))
 	{
-		headerPos = circ_buff_search(cb, HEADER, lastHeaderPos+1);
-		//if we can't find a header, we quit searching for strings
-		if(headerPos == -1) break;
+		//Keep going after this frame, the head doesn't move yet:
+		d->base = d->scanned = COMM_FRAME_END(frames[n]);
+		d->pending = 0;
+		d->overflow = -1;
+		n++;
+	}
 
-		headers++;
-		foundFrame = 0;
-		if(headerPos <= lastPossibleHeaderIndex)
-		{
-			LOG(ldebug2,"Last possible header");
-			bytes = circ_buff_peak(cb, headerPos + 1);
-			possibleFooterPos = headerPos + 3 + bytes;
-			foundFrame = (possibleFooterPos < bufSize && circ_buff_peak(cb, possibleFooterPos) == FOOTER);
-		}
+	//The bytes after the last frame were hunted already, that work is kept
+	//if the caller consumes the frames as expected
+	if(n) { decoderRebase(cb, d, COMM_FRAME_END(frames[n - 1])); }
+	return n;
+}
 
-		if(foundFrame)
-		{
-			LOG(ldebug2,"Frame found");
-			footers++;
-			checksum = circ_buff_checksum(cb, headerPos+2, possibleFooterPos-1);
+//Same, for callers that don't keep a decoder: the sweep starts at the head
+uint8_t unpack_payload_cb_batch(circularBuffer_t *cb, CommFrame frames[], uint8_t max)
+{
+	CommDecoder d;
+	resetCommDecoder(&d);
+	d.checksumErrors = 0;
+	d.framingErrors = 0;
+	return unpack_payload_stream_batch(cb, &d, frames, max);
+}
 
-			//if checksum is valid than we found a valid string
-			foundString = (checksum == circ_buff_peak(cb, possibleFooterPos-1));
-		}
+//Copies a located frame to packed[] (as received), and its payload without the
+//ESCAPE bytes to unpacked[]. Returns the length of the unpacked payload.
+uint8_t unpack_payload_frame(circularBuffer_t *cb, const CommFrame *frame, uint8_t *packed, \
+							uint8_t *unpacked)
+{
+	uint8_t escaped = 0;
+	circ_buff_read_section(cb, packed, frame->headerPos, frame->bytes + 4);
 
-		//either we found a frame and it had a valid checksum, or we want to try the next value of i
-		lastHeaderPos = headerPos;
+	//first value is header, next value is bytes, next value is first data
+	return fx_unescape(unpacked, packed + 2, frame->bytes, &escaped);
+}
+
+//Zero-copy version of unpack_payload_frame(): when the frame is contiguous
+//(always the case with a mirrored ring) and escape free, the view points
+//straight into the ring. Otherwise we fall back on the copies. Returns 1 for
+//a zero-copy view.
+//The handlers read fixed offsets without checking payloadLen. As with a
+//PacketWrapper, PACKET_WRAPPER_LEN bytes have to be readable from the
+//payload: frames closer than that to the end of the storage are copied.
+uint8_t comm_frame_view(circularBuffer_t *cb, const CommFrame *frame, CommFrameView *v, \
+						uint8_t *packed, uint8_t *unpacked)
+{
+	uint16_t index = circ_buff_index_of(cb, frame->headerPos);
+	uint8_t *bytes = cb->bytes + index;
+
+	v->packedLen = frame->bytes + 4;
+	if(index + v->packedLen <= cb->mapped && index + 2u + PACKET_WRAPPER_LEN <= cb->mapped && \
+		fx_find_byte(bytes + 2, frame->bytes, ESCAPE) < 0)
+	{
+		v->packed = bytes;
+		v->payload = bytes + 2;
+		v->payloadLen = frame->bytes;
+		v->cb = cb;
+		return 1;
 	}
 
-	int numBytesInPackedString = 0;
-	if(foundString)
+	uint8_t escaped = 0;
+	circ_buff_read_section(cb, packed, frame->headerPos, v->packedLen);
+	v->packed = packed;
+	v->payload = unpacked;
+	v->payloadLen = fx_unescape(unpacked, packed + 2, frame->bytes, &escaped);
+	v->cb = NULL;
+	return 0;
+}
+
+void resetCommDecoder(CommDecoder *d)
+{
+	d->anchor = -1;
+	d->next = -1;
+	d->base = 0;
+	d->scanned = 0;
+	d->pending = 0;
+	d->overflow = -1;
+	d->idle = -1;
+}
+
+//Writer side of a CommStats block: update the counters between these two
+void commStatsBegin(CommStats *s)
+{
+	#ifdef CB_ATOMICS
+	uint32_t seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+	atomic_store_explicit(&s->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	#else
+	s->seq = s->seq + 1;
+	COMM_STATS_FENCE();
+	#endif
+}
+
+void commStatsEnd(CommStats *s)
+{
+	#ifdef CB_ATOMICS
+	uint32_t seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+	atomic_store_explicit(&s->seq, seq + 1, memory_order_release);
+	#else
+	COMM_STATS_FENCE();
+	s->seq = s->seq + 1;
+	#endif
+}
+
+//Consistent copy of the counters, from any thread. 'cb': receive buffer for
+//overflowBytes, NULL if none. Returns 0, 1 if the writer kept it busy (ex.:
+//called from an ISR that interrupted the writer).
+uint8_t commStatsSnapshot(CommStats *s, circularBuffer_t *cb, CommCounters *out)
+{
+	uint32_t before = 0, after = 0;
+	uint8_t tries = 0;
+
+	do
 	{
-		LOG(ldebug2,"String found");
-		numBytesInPackedString = headerPos + bytes + 4;
+		if(tries++ >= COMM_STATS_TRIES) { return 1; }
+
+		#ifdef CB_ATOMICS
+		before = atomic_load_explicit(&s->seq, memory_order_acquire);
+		memcpy(out, &s->counters, sizeof(CommCounters));
+		atomic_thread_fence(memory_order_acquire);
+		after = atomic_load_explicit(&s->seq, memory_order_relaxed);
+		#else
+		before = s->seq;
+		COMM_STATS_FENCE();
+		memcpy(out, &s->counters, sizeof(CommCounters));
+		COMM_STATS_FENCE();
+		after = s->seq;
+		#endif
+	}while((before & 1) || before != after);
+
+	//The buffer keeps its own count (updated by the producer)
+	if(cb) { out->overflowBytes = cb->stats.droppedBytes + cb->stats.rejectedBytes; }
+	return 0;
+}
 
-		circ_buff_read_section(cb, packed, headerPos, bytes + 4);
+//Counts frames decoded on a port (and the decoder's errors). 'frames' were
+//consumed, in order, from the head. 'escapes': ESCAPE bytes removed.
+void commStatsRx(CommPeriphSub *rx, const CommFrame frames[], uint8_t n, uint32_t escapes)
+{
+	CommCounters *c = &rx->stats.counters;
+	uint16_t end = 0;
+	uint8_t i;
 
-		int k, skip = 0, unpacked_idx = 0;
-		for(k = 0; k < bytes; k++)
-		{
-			int index = k+2; //first value is header, next value is bytes, next value is first data
-			if(packed[index] == ESCAPE && skip == 0)
-			{
-				skip = 1;
-			}
-			else
-			{
-				skip = 0;
-				unpacked[unpacked_idx++] = packed[index];
-			}
-		}
+	commStatsBegin(&rx->stats);
+	for(i = 0; i < n; i++)
+	{
+		c->resyncBytes += frames[i].headerPos - end;
+		c->bytes += frames[i].bytes + 4;
+		end = COMM_FRAME_END(frames[i]);
 	}
+	c->frames += n;
+	c->escapes += escapes;
+	c->checksumErrors += rx->decoder.checksumErrors;
+	c->framingErrors += rx->decoder.framingErrors;
+	commStatsEnd(&rx->stats);
+
+	rx->decoder.checksumErrors = 0;
+	rx->decoder.framingErrors = 0;
+}
 
-	return numBytesInPackedString;
+//Counts frames sent (or encoded) on a port
+void commStatsTx(CommStats *s, uint32_t frames, uint32_t bytes, uint32_t escapes)
+{
+	commStatsBegin(s);
+	s->counters.frames += frames;
+	s->counters.bytes += bytes;
+	s->counters.escapes += escapes;
+	commStatsEnd(s);
 }
 
 //From CommPeriph to PacketWrapper:
 void fillPacketFromCommPeriph(CommPeriph *cp, PacketWrapper *pw)
 {
-	LOG(ldebug1,"fillPacketFromCommPeriph called");
+	FX_LOG_ID(FXLOG_FILL_PACKET_CALLED);
+	fillPacketPortsFromCommPeriph(cp, pw);
+
+	//Copy data. As the source is the peripheral, we always use rx. Only the
+	//bytes of the last frame are moved (see unpack_payload_periph()).
+	uint16_t payloadLen, packedLen = packedFrameLen(cp->rx.packedPtr, &payloadLen);
+	memcpy(pw->packed, cp->rx.packedPtr, packedLen);
+	memcpy(pw->unpaked, cp->rx.unpackedPtr, payloadLen);
+}
+
+//Same, without the data (zero-copy reception, see payload_parse_view())
+void fillPacketPortsFromCommPeriph(CommPeriph *cp, PacketWrapper *pw)
+{
 	pw->sourcePort = cp->port;
 	if(cp->portType == MASTER)
 	{
@@ -259,32 +436,39 @@ void fillPacketFromCommPeriph(CommPeriph *cp, PacketWrapper *pw)
 	{
 		pw->travelDir = UPSTREAM;
 	}
+}
 
-	//Copy data. As the source is the peripheral, we always use rx.
-	uint16_t len = COMM_STR_BUF_LEN;	//ToDo something smarter!
-	memcpy(pw->packed, cp->rx.packedPtr, len);
-	memcpy(pw->unpaked, cp->rx.unpackedPtr, len);
+//Materializes a frame view in a PacketWrapper (only the actual bytes)
+void fillPacketFromFrameView(const CommFrameView *v, PacketWrapper *pw)
+{
+	memcpy(pw->packed, v->packed, (v->packedLen < PACKET_WRAPPER_LEN) ? \
+			v->packedLen : PACKET_WRAPPER_LEN);
+	memcpy(pw->unpaked, v->payload, v->payloadLen);
 }
 
 //Functions that can copy packets between PacketWrapper objects:
 //ToDo: delete 'TravelDirection td'?
 void copyPacket(PacketWrapper *from, PacketWrapper *to, TravelDirection td)
 {
-	LOG(ldebug1,"copyPacket called");
+	FX_LOG_ID(FXLOG_COPY_PACKET_CALLED);
 	(void)td;
 	to->sourcePort = from->sourcePort;
 	to->destinationPort = from->destinationPort;
 	to->travelDir = from->travelDir;
-	memcpy(to->packed, from->packed, PACKET_WRAPPER_LEN);
-	memcpy(to->unpaked, from->unpaked, PACKET_WRAPPER_LEN);
+
+	//Only the bytes in use, when packed[] tells us how many there are
+	uint16_t payloadLen, packedLen = packedFrameLen(from->packed, &payloadLen);
+	memcpy(to->packed, from->packed, packedLen);
+	memcpy(to->unpaked, from->unpaked, payloadLen);
 }
 
-//Initialize CommPeriph to defaults:
+//Initialize CommPeriph to defaults. rx_cb has to be attached already
+//(circ_buff_attach()), it gets emptied here.
 void initCommPeriph(CommPeriph *cp, Port port, PortType pt, \
 					uint8_t *unpacked, uint8_t *packed, circularBuffer_t* rx_cb, \
 					PacketWrapper *inbound, PacketWrapper *outbound)
 {
-	LOG(linfo,"initCommPeriph called");
+	FX_LOG(linfo,"initCommPeriph called");
 	cp->port = port;
 	cp->portType = pt;
 	cp->transState = TS_UNKNOWN;
@@ -294,11 +478,21 @@ void initCommPeriph(CommPeriph *cp, Port port, PortType pt, \
 	//cp->rx.inputBufferPtr = input;	//LEAN_STACK
 	cp->rx.unpackedPtr = unpacked;
 	cp->rx.packedPtr = packed;
+	#ifdef SCRUB_BUFFERS
 	memset(cp->rx.packedPtr, 0, COMM_PERIPH_ARR_LEN);
 	memset(cp->rx.unpackedPtr, 0, COMM_PERIPH_ARR_LEN);
+	#endif
 
-	circ_buff_init(rx_cb);
+	if(circ_buff_init(rx_cb))
+	{
+		FX_LOG(lerror,"initCommPeriph: RX buffer not attached");
+	}
 	cp->rx.circularBuff = rx_cb;
+	resetCommDecoder(&cp->rx.decoder);
+	cp->rx.decoder.checksumErrors = 0;
+	cp->rx.decoder.framingErrors = 0;
+	memset(&cp->rx.stats, 0, sizeof(CommStats));
+	memset(&cp->tx.stats, 0, sizeof(CommStats));
 
 
 	cp->tx.bytesReadyFlag = 0;
@@ -310,7 +504,7 @@ void initCommPeriph(CommPeriph *cp, Port port, PortType pt, \
 void linkCommPeriphPacketWrappers(CommPeriph *cp, PacketWrapper *inbound, \
 					PacketWrapper *outbound)
 {
-	LOG(linfo,"linkCommPeriphPacketWrappers called");
+	FX_LOG(linfo,"linkCommPeriphPacketWrappers called");
 	//Force family:
 	cp->in = inbound;
 	cp->out = outbound;
@@ -320,7 +514,7 @@ void linkCommPeriphPacketWrappers(CommPeriph *cp, PacketWrapper *inbound, \
 	//Children inherit from parent:
 	if(cp->portType == MASTER)
 	{
-		LOG(linfo,"Port type: Master");
+		FX_LOG(linfo,"Port type: Master");
 		inbound->travelDir = DOWNSTREAM;
 		inbound->sourcePort = cp->port;
 		inbound->destinationPort = PORT_NONE;
@@ -331,7 +525,7 @@ void linkCommPeriphPacketWrappers(CommPeriph *cp, PacketWrapper *inbound, \
 	}
 	else
 	{
-		LOG(linfo,"Port type: Slave");
+		FX_LOG(linfo,"Port type: Slave");
 		inbound->travelDir = UPSTREAM;
 		inbound->sourcePort = cp->port;
 		inbound->destinationPort = PORT_NONE;
@@ -342,6 +536,237 @@ void linkCommPeriphPacketWrappers(CommPeriph *cp, PacketWrapper *inbound, \
 	}
 }
 
+//****************************************************************************
+// Private Function(s)
+//****************************************************************************
+
+//Full search, from 'start' (offset from head): the valid frame with the first
+//HEADER wins. Returns 1 if one was found.
+static uint8_t findFrame(circularBuffer_t *cb, int start, CommFrame *frame)
+{
+	int bufSize = circ_buff_get_size(cb);
+
+	int foundString = 0, foundFrame = 0, bytes = 0, possibleFooterPos;
+	int lastPossibleHeaderIndex = bufSize - 4;
+	int headerPos = -1, lastHeaderPos = start - 1;
+	uint8_t checksum = 0;
+
+	while(!foundString && lastHeaderPos < lastPossibleHeaderIndex)
+	{
+		headerPos = circ_buff_search_sof(cb, lastHeaderPos+1);
+		//if we can't find a header, we quit searching for strings
+		if(headerPos == -1) break;
+
+		foundFrame = 0;
+		if(headerPos <= lastPossibleHeaderIndex)
+		{
+			FX_LOG_ID(FXLOG_LAST_HEADER);
+			bytes = circ_buff_peak(cb, headerPos + 1);
+			possibleFooterPos = headerPos + 3 + bytes;
+			foundFrame = (possibleFooterPos < bufSize && circ_buff_peak(cb, possibleFooterPos) == FOOTER);
+		}
+
+		if(foundFrame)
+		{
+			FX_LOG_ID(FXLOG_FRAME_FOUND, headerPos);
+			checksum = circ_buff_checksum(cb, headerPos+2, possibleFooterPos-1);
+
+			//if checksum is valid than we found a valid string
+			foundString = (checksum == circ_buff_peak(cb, possibleFooterPos-1));
+		}
+
+		//either we found a frame and it had a valid checksum, or we want to try the next value of i
+		lastHeaderPos = headerPos;
+	}
+
+	if(foundString)
+	{
+		frame->headerPos = headerPos;
+		frame->bytes = bytes;
+	}
+
+	return foundString;
+}
+
+//Feeds the new bytes to the decoder (see unpack_payload_stream()). Returns 1
+//when a valid frame is complete.
+static uint8_t decodeNextFrame(circularBuffer_t *cb, CommDecoder *d, CommFrame *frame)
+{
+	int bufSize = circ_buff_get_size(cb);
+	int result;
+	uint8_t k;
+
+	//Head moved (frame consumed, or overwritten data): start fresh, unless
+	//the frames of the previous batch were consumed
+	int head = (int)cb->head;
+	if(d->next >= 0)
+	{
+		if(circ_buff_index_of(cb, 0) == d->next) { d->anchor = head; }
+		d->next = -1;
+	}
+	if(d->anchor != head || d->scanned > bufSize)
+	{
+		resetCommDecoder(d);
+		d->anchor = head;
+	}
+
+	//No new bytes since the last fruitless sweep (ex.: the call that ends a
+	//batch loop): the candidates would fail the same way
+	if(d->idle == bufSize) { return 0; }
+	d->idle = -1;
+
+	//The new bytes can complete the open candidates. They were incomplete
+	//until now, so the oldest valid one wins.
+	for(k = 0; k < d->pending; )
+	{
+		result = decoderCheckFrame(cb, d, d->candidate[k], bufSize);
+		if(result >= 0)
+		{
+			frame->headerPos = d->candidate[k];
+			frame->bytes = result;
+			return 1;
+		}
+		else if(result == DECODER_REJECTED)
+		{
+			memmove(&d->candidate[k], &d->candidate[k + 1], \
+					(d->pending - k - 1) * sizeof(d->candidate[0]));
+			d->pending--;
+		}
+		else
+		{
+			k++;
+		}
+	}
+
+	//All the tracked candidates failed: go back to the untracked headers
+	if(!d->pending && d->overflow >= 0)
+	{
+		d->scanned = d->overflow;
+		d->overflow = -1;
+	}
+
+	//Hunt: jump from HEADER to HEADER in the contiguous spans. Each one opens
+	//a candidate, checked right away: the older ones are incomplete.
+	int index = circ_buff_index_of(cb, d->scanned);
+	while(d->scanned < bufSize && d->overflow < 0)
+	{
+		uint32_t span = bufSize - d->scanned;
+		if(span > cb->mapped - index) { span = cb->mapped - index; }
+		int32_t pos = fx_find_byte(cb->bytes + index, span, HEADER);
+		if(pos < 0)
+		{
+			d->scanned += span;
+			index = 0;
+			continue;
+		}
+
+		d->scanned += pos;
+		index += pos;
+		result = decoderCheckFrame(cb, d, d->scanned, bufSize);
+		if(result >= 0)
+		{
+			frame->headerPos = d->scanned;
+			frame->bytes = result;
+			return 1;
+		}
+		else if(result == DECODER_INCOMPLETE)
+		{
+			//When we run out of slots we stop tracking (to keep the order)
+			//and remember where we stopped
+			if(d->pending < DECODER_CANDIDATES)
+			{
+				d->candidate[d->pending++] = d->scanned;
+			}
+			else
+			{
+				d->overflow = d->scanned;
+				break;
+			}
+		}
+
+		d->scanned++;
+		if(++index >= (int)cb->mapped) { index = 0; }
+	}
+
+	//Untracked headers could hide a complete frame (noisy line). Rare, so we
+	//simply use the full search.
+	if(d->overflow >= 0) { return findFrame(cb, d->base, frame); }
+	d->idle = bufSize;
+	return 0;
+}
+
+//Checks the frame whose HEADER is at headerPos (offset from head), like
+//findFrame(). The payload is summed in bulk. Returns its # of BYTES if it's
+//valid, DECODER_REJECTED if it isn't and DECODER_INCOMPLETE if we need more
+//bytes.
+static int decoderCheckFrame(circularBuffer_t *cb, CommDecoder *d, uint16_t headerPos, \
+								int bufSize)
+{
+	uint32_t index = circ_buff_index_of(cb, headerPos);
+	uint8_t bytes, checksum, footer;
+
+	if(headerPos + 1 >= bufSize) { return DECODER_INCOMPLETE; }
+	bytes = cb->bytes[(index + 1 < cb->mapped) ? index + 1 : 0];
+
+	//The whole frame has to fit in packed[]:
+	if(bytes + 4 > COMM_PERIPH_ARR_LEN) { return DECODER_REJECTED; }
+	if(headerPos + bytes + 4 > bufSize) { return DECODER_INCOMPLETE; }
+
+	if(index + bytes + 4u <= cb->mapped)
+	{
+		const uint8_t *p = cb->bytes + index;
+		checksum = (fx_checksum8(p + 2, bytes) == p[bytes + 2]);
+		footer = p[bytes + 3];
+	}
+	else
+	{
+		//Wraps around the end of the storage
+		checksum = (circ_buff_checksum(cb, headerPos + 2, headerPos + bytes + 2) == \
+					circ_buff_peak(cb, headerPos + bytes + 2));
+		footer = circ_buff_peak(cb, headerPos + bytes + 3);
+	}
+
+	if(footer == FOOTER && checksum) { return bytes; }
+
+	//Most candidates are HEADER values in a payload, only count the ones that
+	//look like frames
+	if(footer == FOOTER) { d->checksumErrors++; }
+	else if(checksum) { d->framingErrors++; }
+	return DECODER_REJECTED;
+}
+
+//Makes the decoder state relative to the head after 'consumed' bytes are
+//consumed. decodeNextFrame() only keeps it if the head really moved there.
+static void decoderRebase(circularBuffer_t *cb, CommDecoder *d, uint16_t consumed)
+{
+	uint8_t k;
+
+	d->next = circ_buff_index_of(cb, consumed);
+	d->anchor = -1;
+	d->base = 0;
+	d->scanned -= consumed;
+	for(k = 0; k < d->pending; k++) { d->candidate[k] -= consumed; }
+	if(d->overflow >= 0) { d->overflow -= consumed; }
+	if(d->idle >= 0) { d->idle -= consumed; }
+}
+
+//Bytes in use in a packed[] array (PACKET_WRAPPER_LEN): the frame it holds,
+//HEADER to FOOTER. Its payload, unescaped, is never longer than BYTES:
+//*payloadLen. Anything else (filled by hand) is used whole.
+static uint16_t packedFrameLen(const uint8_t *packed, uint16_t *payloadLen)
+{
+	uint16_t len = packed[1] + 4;
+
+	if(packed[0] == HEADER && len <= PACKET_WRAPPER_LEN && packed[len - 1] == FOOTER)
+	{
+		*payloadLen = packed[1];
+		return len;
+	}
+
+	*payloadLen = PACKET_WRAPPER_LEN;
+	return PACKET_WRAPPER_LEN;
+}
+
 #ifdef __cplusplus
 }
 #endif
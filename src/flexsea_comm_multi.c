@@ -69,36 +69,51 @@ extern "C" {
 #include "flexsea_device_spec.h"
 #include "flexsea_user_structs.h"
 #include "flexsea_multi_circbuff.h"
-#include "log.h"
+#include "flexsea_simd.h"
+#include "flexsea_log.h"
 //****************************************************************************
 // Variable(s)
 //****************************************************************************
 
-MultiCommPeriph comm_multi_periph[NUMBER_OF_PORTS];
+//Each port gets its circular buffer storage, sized by PORT_RX_BUF_SIZES
+#define MULTI_RX_STORAGE(port, len)		uint8_t bytes_##port[len];
+#define MULTI_PERIPH_INIT(port, len)	\
+	[port] = { .circularBuff = CIRC_BUFF_INIT(multiRxStorage.bytes_##port, len) },
+
+static struct { PORT_RX_BUF_SIZES(MULTI_RX_STORAGE) } multiRxStorage;
+MultiCommPeriph comm_multi_periph[NUMBER_OF_PORTS] = { PORT_RX_BUF_SIZES(MULTI_PERIPH_INIT) };
 
 //****************************************************************************
 // Private Function Prototypes(s)
 //****************************************************************************
 
+static uint8_t packMultiFrames(const uint8_t *unpacked, uint16_t len, uint8_t packetId, \
+								uint8_t packed[][PACKET_WRAPPER_LEN], uint8_t *frameMap, \
+								uint8_t *frames, uint32_t *bytes, uint32_t *escapes);
+static uint8_t multiOutIdle(const MultiWrapper *p);
+
 //****************************************************************************
 // Public Function(s)
 //****************************************************************************
 
 void initMultiWrapper(MultiWrapper *w)
 {
-	LOG(linfo,"initMultiWrapper called");
+	FX_LOG_ID(FXLOG_MULTI_WRAPPER_INIT);
+	#ifdef SCRUB_BUFFERS
 	int i;
 	for(i=0;i<MAX_FRAMES_PER_MULTI_PACKET;i++)
 		memset(&(w->packed[i][0]), 0, PACKET_WRAPPER_LEN);
 
 	memset(w->unpacked, 0, UNPACKED_BUFF_SIZE);
+	#endif
 	w->unpackedIdx = 0;
+	memset(&w->stats, 0, sizeof(CommStats));
 }
 
 //Initialize CommPeriph to defaults:
 void initMultiPeriph(MultiCommPeriph *cp, Port port, PortType pt)
 {
-	LOG(linfo,"initMultiPeriph called");
+	FX_LOG_ID(FXLOG_MULTI_PERIPH_INIT);
 	cp->port = port;
 	cp->portType = pt;
 	cp->transState = TS_UNKNOWN;
@@ -114,17 +129,30 @@ void initMultiPeriph(MultiCommPeriph *cp, Port port, PortType pt)
 	#endif
 	initMultiWrapper(&(cp->in));
 	initMultiWrapper(&(cp->out));
+	cp->outQueue.head = 0;
+	cp->outQueue.count = 0;
+	cp->outQueue.dropped = 0;
 	#ifdef BOARD_TYPE_FLEXSEA_PLAN
 //	UNLOCK_MUTEX(&(cp->data_guard));
 	#endif
 
+	#ifdef CIRC_BUFF_MIRROR
+	//Plan's USB link gets mirrored storage: frames never wrap. If the mapping
+	//fails the buffer keeps its static array. Storage attached by the caller
+	//is left alone.
+	if(cp->circularBuff.bytes == multiRxStorage.bytes_PORT_USB)
+	{
+		circ_buff_attach_mirrored(&cp->circularBuff, cp->circularBuff.capacity);
+	}
+	#endif
+
 	circ_buff_init(&cp->circularBuff);
 }
 
 uint8_t tryParse(MultiCommPeriph *cp) {
 	if(!(cp->bytesReadyFlag > 0))
 	{
-		LOG(ldebug1,"cp->bytesReadyFlag %u is smaller than 0",cp->bytesReadyFlag );
+		FX_LOG_ID(FXLOG_MULTI_BYTES_READY, cp->bytesReadyFlag);
 		return 1;
 	}
 	cp->bytesReadyFlag--;	// = 0;
@@ -160,79 +188,103 @@ void setMsgInfo(uint8_t* outbuf, uint8_t xid, uint8_t rid, uint8_t cmdcode, uint
 		outbuf[MP_CMD1] |= 0x01;
 }
 
+//fx_escape() stuffs the legacy format's special bytes
+#if (MULTI_SOF != HEADER) || (MULTI_EOF != FOOTER) || (MULTI_ESC != ESCAPE)
+	#error "Multi frame special bytes have to match the legacy ones"
+#endif
+
 //Takes the payload, in p->unpacked, adds ESCAPES, checksum, header, ...
 //Adds escapes, checksums, etc, and breaks it up into packets
 //returns 1 on error, 0 on success
-#define BYTE_NEEDS_ESCAPE(x) (((x) == MULTI_SOF) || ((x) == MULTI_EOF) || ((x) == MULTI_ESC))
 uint8_t packMultiPacket(MultiWrapper* p) {
-	LOG(ldebug3,"packMultiPacket called");
-	//space per frame that we can fit the underlying unpacked string into
-	const uint16_t SPACE = PACKET_WRAPPER_LEN - MULTI_NUM_OVERHEAD_BYTES_FRAME;
-
-	uint16_t i=0, j;
-	uint8_t frameId = 0;
+	FX_LOG_ID(FXLOG_MULTI_PACK_CALLED);
+	uint8_t frames;
+	uint32_t bytes, escapes;
 
-	while(i < p->unpackedIdx && frameId < MAX_FRAMES_PER_MULTI_PACKET)
+	if(packMultiFrames(p->unpacked, p->unpackedIdx, p->currentMultiPacket, p->packed, \
+						&p->frameMap, &frames, &bytes, &escapes))
 	{
-			uint8_t *frame = p->packed[frameId];
-			uint8_t checksum = 0;							//checksum only adds actual data, not any of the frame stuff
-			j=0;
-			frame[0] = MULTI_SOF;							// set the start of frame byte
-			while(j < (SPACE-1) && i < p->unpackedIdx)		// fill in the data
-			{
-				if (BYTE_NEEDS_ESCAPE(p->unpacked[i]))
-				{
-					checksum += MULTI_ESC;
-					frame[MULTI_DATA_OFFSET+(j++)] = MULTI_ESC;
-				}
-				checksum += p->unpacked[i];
-				frame[MULTI_DATA_OFFSET+(j++)] = p->unpacked[i++];
-			}
+		return 1;
+	}
 
-			//if the next byte doesn't need an escape, then we can add it
-			if(j < SPACE && i < p->unpackedIdx && !BYTE_NEEDS_ESCAPE(p->unpacked[i]))
-			{
-				checksum += p->unpacked[i];
-				frame[MULTI_DATA_OFFSET+(j++)] = p->unpacked[i++];
-			}
+	//set isMultiComplete low, meaning that the sending of the packet is not complete
+	p->isMultiComplete = 0;
 
-			frame[1] = j;								// set the frame's num bytes
+	//TX statistics (p is the 'out' wrapper of its port)
+	commStatsTx(&p->stats, frames, bytes, escapes);
+	return 0;
+}
 
-			uint8_t checksumPos = MULTI_CHECKSUM_POS_FROM_SOF(0, frame[1]);
-			frame[checksumPos] = checksum;						// set the checksum
-			frame[checksumPos+1] = MULTI_EOF;					// set the end of frame byte
+//Packs the packet in src (unpacked, unpackedIdx, currentMultiPacket) to be
+//sent on cp's port: in cp->out if it's done sending, else behind it in the
+//queue. src is cp->out for a reply, or another port's wrapper to forward a
+//packet. Its unpacked buffer is free again on return. Returns 1 if the
+//packet didn't fit or the queue is full (packet dropped).
+uint8_t queueMultiPacket(MultiCommPeriph *cp, MultiWrapper *src)
+{
+	MultiOutQueue *q = &cp->outQueue;
+	uint8_t frames, slot;
+	uint32_t bytes, escapes;
 
-			//if there's still data to pack then we must move onto the next frame
-			if(i < p->unpackedIdx)
-				frameId++;
+	if(!q->count && multiOutIdle(&cp->out))
+	{
+		if(packMultiFrames(src->unpacked, src->unpackedIdx, src->currentMultiPacket, \
+							cp->out.packed, &cp->out.frameMap, &frames, &bytes, &escapes))
+		{
+			return 1;
+		}
+		cp->out.isMultiComplete = 0;
 	}
-	//check if it all fit in our multi packet
-	if(frameId >= MAX_FRAMES_PER_MULTI_PACKET)
+	else
 	{
-		//if it did not all fit we return an error
-		LOG(lerror,"Not all the data fit into the frame");
-		return 1;
+		if(q->count >= MULTI_OUT_QUEUE_LEN)
+		{
+			q->dropped++;
+			FX_LOG_ID_EVERY(FX_LOG_PERIOD, FXLOG_MULTI_QUEUE_FULL, cp->port);
+			return 1;
+		}
+
+		slot = (q->head + q->count) % MULTI_OUT_QUEUE_LEN;
+		if(packMultiFrames(src->unpacked, src->unpackedIdx, src->currentMultiPacket, \
+							q->packed[slot], &q->frameMap[slot], &frames, &bytes, &escapes))
+		{
+			return 1;
+		}
+		q->count++;
 	}
-	// if it did all fit we just need to fill the multiInfo byte now that we know how many frames we have
-	// frameId now holds the id of the last frame in the packet
-	uint8_t lastFrameIdInPacket = frameId;
 
-	// set the multiInfo
-	p->frameMap = 0;
-	for(frameId=0; frameId <= lastFrameIdInPacket; frameId++)
+	commStatsTx(&cp->out.stats, frames, bytes, escapes);
+	return 0;
+}
+
+//Moves the next queued packet to cp->out once it's done sending. Called by
+//the transmit functions. Returns 1 if it did.
+uint8_t dequeueMultiPacket(MultiCommPeriph *cp)
+{
+	MultiOutQueue *q = &cp->outQueue;
+	uint8_t frameId;
+
+	if(!q->count || !multiOutIdle(&cp->out)) { return 0; }
+
+	for(frameId = 0; frameId < MAX_FRAMES_PER_MULTI_PACKET; frameId++)
 	{
-		p->packed[frameId][MULTI_INFO_POS_FROM_SOF(0)] = MULTI_GENINFO(p->currentMultiPacket, frameId, lastFrameIdInPacket);
-		p->frameMap |= (1 << frameId);
+		if(q->frameMap[q->head] & (1 << frameId))
+		{
+			memcpy(cp->out.packed[frameId], q->packed[q->head][frameId], \
+					SIZE_OF_MULTIFRAME(q->packed[q->head][frameId]));
+		}
 	}
+	cp->out.frameMap = q->frameMap[q->head];
+	cp->out.isMultiComplete = 0;
 
-	//set isMultiComplete low, meaning that the sending of the packet is not complete
-	p->isMultiComplete = 0;
-	return 0;
+	q->head = (q->head + 1) % MULTI_OUT_QUEUE_LEN;
+	q->count--;
+	return 1;
 }
 
 uint8_t receiveAndFillResponse(uint8_t cmd_7bits, uint8_t pType, MultiPacketInfo* info, MultiCommPeriph* cp)
 {
-	LOG(linfo,"receiveAndFillResponse called");
+	FX_LOG_ID(FXLOG_MULTI_RECEIVE_CALLED);
 	// initialize the response length to 0
 	// Our index is the length of response.
 	cp->out.unpackedIdx = 0;
@@ -246,7 +298,7 @@ uint8_t receiveAndFillResponse(uint8_t cmd_7bits, uint8_t pType, MultiPacketInfo
 //	//LOCK_MUTEX(&(cp->data_guard));
 	#endif
 	if(cp->out.unpackedIdx + MULTI_PACKET_OVERHEAD >= UNPACKED_BUFF_SIZE) {
-		LOG(lerror,"More data than expected unpacked");
+		FX_LOG_ID(FXLOG_MULTI_TOO_MUCH_DATA);
 		error = 1; // raise an error flag
 	}
 	else if (cp->out.unpackedIdx) {
@@ -257,10 +309,15 @@ uint8_t receiveAndFillResponse(uint8_t cmd_7bits, uint8_t pType, MultiPacketInfo
 
 		// set multipacket id's to match
 		cp->out.currentMultiPacket = cp->in.currentMultiPacket;
+
+		// packed now, in out.packed or queued behind it: out.unpacked is free
+		// for the next reply
+		error = queueMultiPacket(cp, &cp->out);
+		cp->out.unpackedIdx = 0;
 	}
 	else
 	{
-		LOG(ldebug2,"Empty unpack array");
+		FX_LOG_ID(FXLOG_MULTI_EMPTY);
 	}
 	cp->in.frameMap = 0;
 	#ifdef BOARD_TYPE_FLEXSEA_PLAN
@@ -273,7 +330,7 @@ uint8_t receiveAndFillResponse(uint8_t cmd_7bits, uint8_t pType, MultiPacketInfo
 // Just note that this only works if this device is communicating with plan.
 uint8_t parseReadyMultiString(MultiCommPeriph* cp)
 {
-	LOG(linfo,"parseReadyMultiString called");
+	FX_LOG_ID(FXLOG_MULTI_PARSE_CALLED);
 	// ensure multi is actually ready to be parsed
 	if(!cp->in.isMultiComplete) return PARSE_DEFAULT;
 
@@ -314,7 +371,7 @@ uint8_t parseReadyMultiString(MultiCommPeriph* cp)
 			uint8_t error = receiveAndFillResponse(cmd_7bits, pType, &info, cp);
 			if(error)
 			{
-				LOG(lerror,"Error recieving string occured");
+				FX_LOG_ID(FXLOG_MULTI_PARSE_ERROR);
 				return PARSE_DEFAULT;
 			}
 		}
@@ -325,7 +382,7 @@ uint8_t parseReadyMultiString(MultiCommPeriph* cp)
 		uint8_t error = receiveAndFillResponse(cmd_7bits, RX_PTYPE_READ, &info, cp);
 		if(error)
 		{
-			LOG(lerror,"Error recieving who am i message occured");
+			FX_LOG_ID(FXLOG_MULTI_WHOAMI_ERROR);
 			return PARSE_DEFAULT;
 		}
 	}
@@ -335,25 +392,40 @@ uint8_t parseReadyMultiString(MultiCommPeriph* cp)
 
 void resetToPacketId(MultiWrapper* p, uint8_t id)
 {
-	LOG(ldebug4,"resetToPacketId called");
+	FX_LOG_ID(FXLOG_MULTI_RESET_CALLED);
 	p->currentMultiPacket = id;
 	p->unpackedIdx = 0;
 	p->frameMap = 0;
 	memset(p->unpacked, 0, UNPACKED_BUFF_SIZE);
 }
 
+//Returns circ_buff_write()'s code: 0 if all went well, non-zero if bytes were
+//lost (see the buffer's overflow policy and its stats)
 int16_t copyIntoMultiPacket(MultiCommPeriph* p, uint8_t *src, uint16_t nb)
 {
 	circularBuffer_t *cb = &p->circularBuff;
-	int16_t nOverwritten = circ_buff_get_size(cb) + nb - CB_BUF_LEN;
-	circ_buff_write(cb, src, nb);
+	uint32_t dropped = cb->stats.droppedBytes;
+	int16_t error = circ_buff_write(cb, src, nb);
 
+	//The cached parsing position moves with the bytes dropped from the head
+	uint32_t nOverwritten = cb->stats.droppedBytes - dropped;
 	if(nOverwritten > 0)
 	{
-		p->parsingCachedIndex -= nOverwritten;
-		if(p->parsingCachedIndex < 0) p->parsingCachedIndex = 0;
+		//Up to the capacity (65535)
+		p->parsingCachedIndex = (p->parsingCachedIndex > (int32_t)nOverwritten) ? \
+								p->parsingCachedIndex - (int32_t)nOverwritten : 0;
 	}
 
+	if(error == 0 || error == CB_OVERWROTE) { p->bytesReadyFlag++; }
+	return error;
+}
+
+//Zero-copy version of copyIntoMultiPacket(): the nb bytes were written in
+//place, in the span given by circ_buff_acquire_write(&p->circularBuff, ...)
+int16_t commitIntoMultiPacket(MultiCommPeriph* p, uint16_t nb)
+{
+	if(circ_buff_commit_write(&p->circularBuff, nb)) { return 1; }
+
 	p->bytesReadyFlag++;
 	return 0;
 }
@@ -361,7 +433,7 @@ int16_t copyIntoMultiPacket(MultiCommPeriph* p, uint8_t *src, uint16_t nb)
 void advanceMultiInput(MultiCommPeriph *p, int16_t nb)
 {
 	if(!p || nb < 0) return;
-	if(nb > p->circularBuff.size) nb = p->circularBuff.size;
+	if(nb > circ_buff_get_size(&p->circularBuff)) nb = circ_buff_get_size(&p->circularBuff);
 
 	circ_buff_move_head(&(p->circularBuff), nb);
 
@@ -372,6 +444,107 @@ void advanceMultiInput(MultiCommPeriph *p, int16_t nb)
 
 }
 
+//Next frame of an outgoing packet (p: 'out' wrapper) waiting to be sent.
+//Returns its id, MULTI_FRAME_NONE, or MULTI_FRAME_INVALID if the frame map
+//doesn't make sense (the packet is then dropped).
+int8_t nextMultiFrame(MultiWrapper *p)
+{
+	uint8_t frameId = 0;
+
+	if(p->frameMap == 0 || p->isMultiComplete) { return MULTI_FRAME_NONE; }
+
+	while((p->frameMap & (1 << frameId)) == 0) { frameId++; }
+
+	if(frameId >= MAX_FRAMES_PER_MULTI_PACKET)
+	{
+		p->frameMap = 0;
+		p->isMultiComplete = 1;
+		FX_LOG_ID(FXLOG_MULTI_TOO_MANY_FRAMES);
+		return MULTI_FRAME_INVALID;
+	}
+
+	return frameId;
+}
+
+//Marks a frame as sent. The packet is complete once they all are.
+void markMultiFrameSent(MultiWrapper *p, uint8_t frameId)
+{
+	p->frameMap &= ~(1 << frameId);
+	if(p->frameMap == 0) { p->isMultiComplete = 1; }
+}
+
+//****************************************************************************
+// Private Function(s)
+//****************************************************************************
+
+//Splits 'len' bytes of unpacked packet in escaped frames. frameMap, frames,
+//bytes (on the wire) and escapes are only written on success. Returns 1 if
+//it doesn't fit in MAX_FRAMES_PER_MULTI_PACKET frames.
+static uint8_t packMultiFrames(const uint8_t *unpacked, uint16_t len, uint8_t packetId, \
+								uint8_t packed[][PACKET_WRAPPER_LEN], uint8_t *frameMap, \
+								uint8_t *frames, uint32_t *bytes, uint32_t *escapes)
+{
+	//space per frame that we can fit the underlying unpacked string into
+	const uint16_t SPACE = PACKET_WRAPPER_LEN - MULTI_NUM_OVERHEAD_BYTES_FRAME;
+
+	uint16_t i=0, j;
+	uint8_t frameId = 0;
+	uint32_t nBytes = 0, nEscapes = 0;
+
+	while(i < len && frameId < MAX_FRAMES_PER_MULTI_PACKET)
+	{
+			uint8_t *frame = packed[frameId];
+			uint8_t checksum;								//checksum only adds actual data, not any of the frame stuff
+			uint32_t consumed = len - i;
+			frame[0] = MULTI_SOF;							// set the start of frame byte
+
+			// fill in the data, escaped. A byte and its escape stay in the same frame.
+			j = fx_escape(frame + MULTI_DATA_OFFSET, SPACE, unpacked + i, &consumed, &checksum);
+			i += consumed;
+			nEscapes += j - consumed;
+			nBytes += j + MULTI_NUM_OVERHEAD_BYTES_FRAME;
+
+			frame[1] = j;								// set the frame's num bytes
+
+			uint8_t checksumPos = MULTI_CHECKSUM_POS_FROM_SOF(0, frame[1]);
+			frame[checksumPos] = checksum;						// set the checksum
+			frame[checksumPos+1] = MULTI_EOF;					// set the end of frame byte
+
+			//if there's still data to pack then we must move onto the next frame
+			if(i < len)
+				frameId++;
+	}
+	//check if it all fit in our multi packet
+	if(frameId >= MAX_FRAMES_PER_MULTI_PACKET)
+	{
+		//if it did not all fit we return an error
+		FX_LOG_ID(FXLOG_MULTI_DATA_DIDNT_FIT);
+		return 1;
+	}
+	// if it did all fit we just need to fill the multiInfo byte now that we know how many frames we have
+	// frameId now holds the id of the last frame in the packet
+	uint8_t lastFrameIdInPacket = frameId;
+
+	// set the multiInfo
+	*frameMap = 0;
+	for(frameId=0; frameId <= lastFrameIdInPacket; frameId++)
+	{
+		packed[frameId][MULTI_INFO_POS_FROM_SOF(0)] = MULTI_GENINFO(packetId, frameId, lastFrameIdInPacket);
+		*frameMap |= (1 << frameId);
+	}
+
+	*frames = lastFrameIdInPacket + 1;
+	*bytes = nBytes;
+	*escapes = nEscapes;
+	return 0;
+}
+
+//Nothing left to send in this 'out' wrapper
+static uint8_t multiOutIdle(const MultiWrapper *p)
+{
+	return (p->isMultiComplete || !p->frameMap);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -41,8 +41,10 @@ extern "C" {
 #include "flexsea_multi_circbuff.h"
 #include "flexsea_payload.h"
 #include "flexsea_circular_buffer.h"
+#include "flexsea_interface.h"
+#include "flexsea_transport.h"
 #include "user-mn.h"
-#include "log.h"
+#include "flexsea_log.h"
 
 #ifndef BOARD_TYPE_FLEXSEA_PLAN
 
@@ -93,7 +95,7 @@ uint8_t noWatch = 0;
 void receiveFlexSEAPacket(Port p, uint8_t *newPacketFlag,  \
 							uint8_t *parsedPacketFlag, uint8_t *watch)
 {
-	uint8_t parseResult = 0;
+	uint8_t parsed = 0;
 
 	//Handle RS-485 transceiver(s):
 	#ifdef BOARD_TYPE_FLEXSEA_MANAGE
@@ -111,16 +113,13 @@ void receiveFlexSEAPacket(Port p, uint8_t *newPacketFlag,  \
 	}
 	#endif
 
-	//This replaces flexsea_receive_from_X():
-	commPeriph[p].rx.unpackedPacketsAvailable = tryParseRx(&commPeriph[p], &packet[p][INBOUND]);
-	(*newPacketFlag) = commPeriph[p].rx.unpackedPacketsAvailable;
-
-	//And this replaces parseXCommands():
-	if(commPeriph[p].rx.unpackedPacketsAvailable > 0)
+	//This replaces flexsea_receive_from_X() and parseXCommands(). All the
+	//frames received so far are dispatched in one call. packet[p][INBOUND]
+	//then holds the last one:
+	(*newPacketFlag) = tryParseRxBatch(&commPeriph[p], &packet[p][INBOUND], &parsed);
+	(*parsedPacketFlag) += parsed;
+	if(*newPacketFlag)
 	{
-		commPeriph[p].rx.unpackedPacketsAvailable = 0;
-		parseResult = payload_parse_str(&packet[p][INBOUND]);
-		(*parsedPacketFlag) += (parseResult == PARSE_SUCCESSFUL) ? 1 : 0;
 		(*watch) = 0; //Valid packets restart the watch count
 	}
 }
@@ -129,8 +128,9 @@ void receiveFlexSEAPacket(Port p, uint8_t *newPacketFlag,  \
 //When autoParse is > 0 we parse the new data
 uint8_t receiveFlexSEABytes(uint8_t *d, uint8_t len, uint8_t autoParse)
 {
-	circ_buff_write(commPeriph[PORT_USB].rx.circularBuff, d, len);
-	commPeriph[PORT_USB].rx.bytesReadyFlag++;
+	//Refused bytes (full buffer, CB_REJECT_NEW) are counted in the buffer stats
+	int error = circ_buff_write(commPeriph[PORT_USB].rx.circularBuff, d, len);
+	if(error == 0 || error == CB_OVERWROTE) { commPeriph[PORT_USB].rx.bytesReadyFlag++; }
 
 	//Parse if needed:
 	if(autoParse){receiveFlexSEAPacket(PORT_USB, &npFlag, &ppFlag, &noWatch);}
@@ -177,137 +177,94 @@ uint8_t receiveFxPacket(Port p) {
 	return receiveFxPacketByPeriph(cp);
 }
 
-#if (defined BOARD_TYPE_FLEXSEA_MANAGE || defined BOARD_TYPE_FLEXSEA_EXECUTE || \
-	defined BOARD_TYPE_FLEXSEA_PROTOTYPE)
-
+//Sends the next frame of the port's outgoing packet, through the transport
+//bound to the port (fxTransport[]). Returns 0 if a frame was sent, 1 if the
+//port wasn't ready (try again) or on error, (uint8_t)-1 if there was nothing
+//to send.
 uint8_t transmitFxPacket(Port p)
 {
-	MultiCommPeriph *cp = comm_multi_periph + p;
+	if(p >= NUMBER_OF_PORTS) { return 1; }
+	return transmitFxPacketByPeriph(comm_multi_periph + p, &fxTransport[p]);
+}
+
+uint8_t transmitFxPacketByPeriph(MultiCommPeriph *cp, const FxTransport *t)
+{
+	//next packet from the queue, once the current one is sent
+	dequeueMultiPacket(cp);
 
 	//check if the periph has anything to send
-	if(cp->out.frameMap > 0 && !cp->out.isMultiComplete)
+	int8_t frameId = nextMultiFrame(&cp->out);
+	if(frameId == MULTI_FRAME_INVALID)
 	{
-		uint8_t frameId = 0;
-		//figure out the next frame to send
-		while((cp->out.frameMap & (1 << frameId)) == 0)
-		{
-			frameId++;
-		}
+		return 1;	// return an error, the packet was discarded
+	}
 
-		//check that the frameid is valid
-		if(frameId >= MAX_FRAMES_PER_MULTI_PACKET)
-		{
-			// if its not valid we just discard the multi packet frames, setting the flags accordingly
-			cp->out.frameMap = 0;
-			cp->out.isMultiComplete = 1;
-			LOG(lerror,"More frames expected than possible");
-			return 1;	// return an error
-		}
+	if(frameId == MULTI_FRAME_NONE)
+	{
+		return -1;
+	}
 
-		uint8_t success = 0;
-		#ifdef BOARD_TYPE_FLEXSEA_MANAGE
-		if(p == PORT_WIRELESS || p == PORT_BWC)
-		{
-			// TODO: readyToTransfer function does not appear to be complete
-			// just saying always ready for now
-			uint8_t isReady = 1; //readyToTransfer(p);
-			if(isReady)
-			{
-				uint8_t *data = &(cp->out.packed[frameId][0]);
-				uint16_t datalen = SIZE_OF_MULTIFRAME(cp->out.packed[frameId]);
-				// bilateral data does not use this on rigid 3.0
-				#if (HW_VER < 20)
-					//ToDo replace with mapping function:
-					if(p == PORT_WIRELESS)
-					{
-						#ifdef USE_UART3
-						puts_expUart(data, datalen);
-						#endif
-
-						#ifdef USE_UART4
-						puts_expUart2(data, datalen);
-						#endif
-					}
-					else if(p == PORT_BWC)
-					{
-						#ifdef USE_XB24C
-						puts_uart_xb24c(data, datalen);
-						#endif
-					}
-				#else
-					if(p == PORT_WIRELESS)
-					{
-						puts_expUart2(data, datalen);
-					}
-				#endif // (HW_VER < 20)
-				UNUSED(datalen);
-				UNUSED(data);
-				success = 1;
-			}
-			else
-			{
-				success = 0;
-
-				/*
-				//Error recovery test:
-				#ifdef USE_UART3
-				static uint16_t failedTransfers = 0;
-				failedTransfers++;
-				if(failedTransfers > 1500)
-				{
-					failedTransfers = 0;
-					resetUsartState(p);
-				}
-				#endif
-				*/
-			}
-		}
-		else if(p == PORT_USB)
-		{
-			// route traffic to GUI through debug uart on the BMS
-		#ifdef BOARD_SUBTYPE_BMS
-			// handle habsolute and bms like normal usarts
-			uint8_t *data = &(cp->out.packed[frameId][0]);
-			uint16_t datalen = SIZE_OF_MULTIFRAME(cp->out.packed[frameId]);
-			usart_transmit(DEBUG_USART, data, datalen);
-			success = 1;
-		#else
-			success = !CDC_CheckBusy_FS() && USBD_OK == CDC_Transmit_FS(cp->out.packed[frameId], SIZE_OF_MULTIFRAME(cp->out.packed[frameId]));
-		#endif
-		}
-		else
-		{
-			success = 1; // unimplemented port we just pretend its all good? TODO: something smarter?
-		}
-		#endif	//BOARD_TYPE_FLEXSEA_MANAGE
-		
-		#if(defined BOARD_TYPE_FLEXSEA_EXECUTE || defined BOARD_TYPE_FLEXSEA_PROTOTYPE)
-			
-		if(p == PORT_USB)
-		{
-			success = usb_puts(cp->out.packed[frameId], SIZE_OF_MULTIFRAME(cp->out.packed[frameId]));
-		}
-		
-		#endif	//BOARD_TYPE_FLEXSEA_EXECUTE
+	uint8_t *frame = cp->out.packed[frameId];
+	if(fxTransportSend(t, frame, SIZE_OF_MULTIFRAME(frame)))
+	{
+		return 1;	// maybe we should be checking for USBD_BUSY or USBD_FAIL
+	}
+
+	markMultiFrameSent(&cp->out, frameId);
+	return 0;
+}
+
+//Sends all the frames left in the port's outgoing packet, then the packets
+//queued behind it: one vectored transfer per packet if the transport supports
+//it (else frame by frame, while it's ready). Same return values as
+//transmitFxPacket(), 0 meaning that everything went out; framesSent
+//(optional) gets the number of frames sent by this call, even when some are
+//left.
+uint8_t transmitFxPacketBurst(Port p, uint8_t *framesSent)
+{
+	if(framesSent) { *framesSent = 0; }
+	if(p >= NUMBER_OF_PORTS) { return 1; }
+	return transmitFxPacketBurstByPeriph(comm_multi_periph + p, &fxTransport[p], framesSent);
+}
+
+uint8_t transmitFxPacketBurstByPeriph(MultiCommPeriph *cp, const FxTransport *t, \
+										uint8_t *framesSent)
+{
+	FxIoVec iov[MAX_FRAMES_PER_MULTI_PACKET];
+	uint8_t frameIds[MAX_FRAMES_PER_MULTI_PACKET];
+	uint8_t count, sent, total = 0, i;
+	int8_t frameId;
+
+	if(framesSent) { *framesSent = 0; }
+
+	do
+	{
+		dequeueMultiPacket(cp);
+
+		frameId = nextMultiFrame(&cp->out);
+		if(frameId == MULTI_FRAME_INVALID) { return 1; }
+		if(frameId == MULTI_FRAME_NONE) { return total ? 0 : -1; }
 
-		if(success)
+		for(count = 0; frameId < MAX_FRAMES_PER_MULTI_PACKET; frameId++)
 		{
-			//mark frame as sent
-			cp->out.frameMap &= (   ~(1 << frameId)   );
+			if(!(cp->out.frameMap & (1 << frameId))) { continue; }
 
-			if(cp->out.frameMap == 0)
-			{
-				cp->out.isMultiComplete = 1;
-			}
+			iov[count].data = cp->out.packed[frameId];
+			iov[count].len = SIZE_OF_MULTIFRAME(cp->out.packed[frameId]);
+			frameIds[count++] = frameId;
 		}
 
-		// maybe we should be checking for USBD_BUSY or USBD_FAIL
-		return success ? 0 : 1;
-	}
+		sent = fxTransportSendVectored(t, iov, count);
+		for(i = 0; i < sent; i++) { markMultiFrameSent(&cp->out, frameIds[i]); }
 
-	return -1;
+		total += sent;
+		if(framesSent) { *framesSent = total; }
+		if(sent < count) { return 1; }
+
+	}while(cp->outQueue.count);
+
+	return 0;
 }
-#endif
 
 //****************************************************************************
 // Private Function(s):
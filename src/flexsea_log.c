@@ -0,0 +1,407 @@
+/****************************************************************************
+	[Project] FlexSEA: Flexible & Scalable Electronics Architecture
+	[Sub-project] 'flexsea-comm' Communication stack
+	Copyright (C) 2016 Dephy, Inc. <http://dephy.com/>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************
+	[Lead developper] Jean-Francois (JF) Duval, jfduval at dephy dot com.
+	[Origin] Based on Jean-Francois Duval's work at the MIT Media Lab
+	Biomechatronics research group <http://biomech.media.mit.edu/>
+	[Contributors]
+*****************************************************************************
+	[This file] flexsea_log: message table and deferred (binary) logging
+*****************************************************************************
+	[Change log] (Convention: YYYY-MM-DD | author | comment)
+	* 2026-10-17 | agent | Initial release
+	*
+****************************************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//****************************************************************************
+// Include(s)
+//****************************************************************************
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "flexsea_log.h"
+#include "flexsea_circular_buffer.h"
+
+#ifdef FX_LOG_THREAD
+	#include <pthread.h>
+	#include <time.h>
+#elif defined(BOARD_TYPE_FLEXSEA_PLAN) && defined(__linux__)
+	#include <time.h>
+#endif
+
+//****************************************************************************
+// Definition(s):
+//****************************************************************************
+
+#if (FX_LOG_RING_LEN & (FX_LOG_RING_LEN - 1))
+	#error "FX_LOG_RING_LEN has to be a power of two"
+#endif
+
+#define FX_LOG_TEXT_LEN			96
+
+#define FX_LOG_X_FORMAT(id, level, nargs, fmt)	fmt,
+#define FX_LOG_X_NARGS(id, level, nargs, fmt)	nargs,
+
+const char * const fxLogFormats[FX_LOG_NUM_MESSAGES] = { FX_LOG_MESSAGES(FX_LOG_X_FORMAT) };
+
+#ifdef FX_LOG_DEFERRED
+
+static const uint8_t fxLogNargs[FX_LOG_NUM_MESSAGES] = { FX_LOG_MESSAGES(FX_LOG_X_NARGS) };
+
+//Bounded multi-producer ring (ISRs and threads can log), single consumer.
+//For position pos (slot pos & mask), state == (pos & ~mask) means free and
+//+1 written. Zero is a valid initial state.
+static FxLogRecord fxLogRing[FX_LOG_RING_LEN];
+static cb_index_t fxLogState[FX_LOG_RING_LEN];
+static cb_index_t fxLogWrite = 0;
+static cb_index_t fxLogRead = 0;
+static cb_index_t fxLogDropped = 0;
+
+#endif	//FX_LOG_DEFERRED
+
+#ifdef FX_LOG_THREAD
+static pthread_t fxLogThread;
+static uint8_t fxLogThreadRunning = 0;		//__atomic: the thread polls it
+static uint32_t fxLogThreadPeriodMs = 0;
+#endif
+
+//****************************************************************************
+// Private Function Prototype(s):
+//****************************************************************************
+
+static void fx_log_print(const FxLogRecord *r);
+#ifdef FX_LOG_DEFERRED
+static uint32_t fx_log_timestamp(void);
+static inline uint32_t fx_log_load(cb_index_t *x);
+static inline void fx_log_store(cb_index_t *x, uint32_t v);
+static inline uint8_t fx_log_claim(cb_index_t *x, uint32_t expected);
+#endif
+#ifdef FX_LOG_THREAD
+static void *fx_log_thread(void *arg);
+#endif
+
+//****************************************************************************
+// Public Function(s)
+//****************************************************************************
+
+#ifdef FX_LOG_DEFERRED
+
+//Called by FX_LOG_ID(): the id, time and raw arguments go in the ring (no
+//formatting). The id is promoted by the variadic call, hence the uint32_t.
+void fx_log_id(uint32_t id, ...)
+{
+	FxLogRecord r;
+	uint8_t i, n = 0;
+	va_list ap;
+
+	if(FX_LOG_INDEX_OF(id) >= FX_LOG_NUM_MESSAGES) { return; }
+
+	r.timestamp = fx_log_timestamp();
+	r.id = (uint16_t)id;
+	r.seq = 0;
+	memset(r.args, 0, sizeof(r.args));
+	n = fxLogNargs[FX_LOG_INDEX_OF(id)];
+	va_start(ap, id);
+	for(i = 0; i < n && i < FX_LOG_MAX_ARGS; i++)
+	{
+		r.args[i] = va_arg(ap, uint32_t);
+	}
+	va_end(ap);
+
+	uint32_t pos = fx_log_load(&fxLogWrite);
+	for(;;)
+	{
+		uint32_t lap = pos & ~(uint32_t)(FX_LOG_RING_LEN - 1);
+		int32_t diff = (int32_t)(fx_log_load(&fxLogState[pos & (FX_LOG_RING_LEN - 1)]) - lap);
+
+		if(diff == 0)
+		{
+			//Free for this lap, try to take it
+			if(fx_log_claim(&fxLogWrite, pos)) { break; }
+		}
+		else if(diff < 0)
+		{
+			//The consumer didn't release it yet: full
+			while(!fx_log_claim(&fxLogDropped, fx_log_load(&fxLogDropped))) {}
+			return;
+		}
+		pos = fx_log_load(&fxLogWrite);
+	}
+
+	//The drops show as gaps in the sequence
+	r.seq = (uint16_t)(pos + fx_log_load(&fxLogDropped));
+	fxLogRing[pos & (FX_LOG_RING_LEN - 1)] = r;
+	fx_log_store(&fxLogState[pos & (FX_LOG_RING_LEN - 1)], \
+				(pos & ~(uint32_t)(FX_LOG_RING_LEN - 1)) + 1);
+}
+
+#endif	//FX_LOG_DEFERRED
+
+//Copies up to 'max' records out of the ring (binary dump). Single consumer.
+//Returns the number of records.
+uint16_t fx_log_read(FxLogRecord *records, uint16_t max)
+{
+	uint16_t n = 0;
+
+	#ifdef FX_LOG_DEFERRED
+
+	uint32_t pos = fx_log_load(&fxLogRead);
+	while(n < max)
+	{
+		cb_index_t *state = &fxLogState[pos & (FX_LOG_RING_LEN - 1)];
+		uint32_t lap = pos & ~(uint32_t)(FX_LOG_RING_LEN - 1);
+		if(fx_log_load(state) != lap + 1) { break; }
+
+		records[n++] = fxLogRing[pos & (FX_LOG_RING_LEN - 1)];
+		fx_log_store(state, lap + FX_LOG_RING_LEN);	//Free for the next lap
+		pos++;
+	}
+	fx_log_store(&fxLogRead, pos);
+
+	#else
+
+	(void)records;
+	(void)max;
+
+	#endif	//FX_LOG_DEFERRED
+
+	return n;
+}
+
+//Idle loop hook: formats and logs up to 'max' deferred records. Returns the
+//number of records processed.
+uint16_t fx_log_process(uint16_t max)
+{
+	FxLogRecord r;
+	uint16_t n = 0;
+
+	while(n < max && fx_log_read(&r, 1))
+	{
+		fx_log_print(&r);
+		n++;
+	}
+
+	return n;
+}
+
+//Text version of a record: "[timestamp] message". Returns the length, -1 for
+//an unknown id.
+int fx_log_format(const FxLogRecord *r, char *buf, uint16_t len)
+{
+	int n = 0, m = 0;
+	uint16_t index = FX_LOG_INDEX_OF(r->id);
+
+	if(index >= FX_LOG_NUM_MESSAGES || len == 0) { return -1; }
+
+	n = snprintf(buf, len, "[%lu] ", (unsigned long)r->timestamp);
+	if(n < 0 || n >= len) { return n; }
+	m = snprintf(buf + n, len - n, fxLogFormats[index], \
+				r->args[0], r->args[1], r->args[2], r->args[3]);
+	return (m < 0) ? m : n + m;
+}
+
+//Records lost because the ring was full
+uint32_t fx_log_dropped(void)
+{
+	#ifdef FX_LOG_DEFERRED
+	return fx_log_load(&fxLogDropped);
+	#else
+	return 0;
+	#endif
+}
+
+#ifdef FX_LOG_THREAD
+
+//Host: a background thread calls fx_log_process() every periodMs
+int fx_log_start_thread(uint32_t periodMs)
+{
+	if(fxLogThreadRunning) { return 0; }
+
+	fxLogThreadPeriodMs = periodMs;
+	__atomic_store_n(&fxLogThreadRunning, 1, __ATOMIC_RELEASE);
+	if(pthread_create(&fxLogThread, NULL, fx_log_thread, NULL))
+	{
+		__atomic_store_n(&fxLogThreadRunning, 0, __ATOMIC_RELEASE);
+		return 1;
+	}
+
+	return 0;
+}
+
+//Stops the thread, after it has processed every pending record
+void fx_log_stop_thread(void)
+{
+	if(!fxLogThreadRunning) { return; }
+
+	__atomic_store_n(&fxLogThreadRunning, 0, __ATOMIC_RELEASE);
+	pthread_join(fxLogThread, NULL);
+	fx_log_process(FX_LOG_RING_LEN);
+}
+
+#endif	//FX_LOG_THREAD
+
+#ifdef BOARD_TYPE_FLEXSEA_PLAN
+
+//Decoder: binary records (as copied by fx_log_read()) to text, one per line.
+//Gaps in the sequence numbers are reported. Returns the number of records
+//decoded, -1 if the file contains unknown ids (wrong version?).
+int fx_log_decode(FILE *in, FILE *out)
+{
+	FxLogRecord r;
+	char text[FX_LOG_TEXT_LEN];
+	int n = 0, unknown = 0;
+	uint16_t expected = 0;
+
+	while(fread(&r, sizeof(r), 1, in) == 1)
+	{
+		if(n && r.seq != expected)
+		{
+			fprintf(out, "(%u records lost)\n", (uint16_t)(r.seq - expected));
+		}
+		expected = r.seq + 1;
+
+		if(fx_log_format(&r, text, sizeof(text)) < 0)
+		{
+			fprintf(out, "[%lu] Unknown id %u\n", (unsigned long)r.timestamp, r.id);
+			unknown = 1;
+		}
+		else
+		{
+			fprintf(out, "%s\n", text);
+		}
+		n++;
+	}
+
+	return unknown ? -1 : n;
+}
+
+#endif	//BOARD_TYPE_FLEXSEA_PLAN
+
+//****************************************************************************
+// Private Function(s)
+//****************************************************************************
+
+static void fx_log_print(const FxLogRecord *r)
+{
+	char text[FX_LOG_TEXT_LEN];
+
+	if(fx_log_format(r, text, sizeof(text)) >= 0)
+	{
+		LOG(FX_LOG_LEVEL_OF(r->id), "%s", text);
+	}
+}
+
+#ifdef FX_LOG_DEFERRED
+
+static uint32_t fx_log_timestamp(void)
+{
+	#if defined(FX_LOG_TIMESTAMP)
+	return (uint32_t)FX_LOG_TIMESTAMP();
+	#elif defined(BOARD_TYPE_FLEXSEA_PLAN) && defined(__linux__)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+	#else
+	return 0;
+	#endif
+}
+
+#ifdef CB_ATOMICS
+
+static inline uint32_t fx_log_load(cb_index_t *x)
+{
+	return atomic_load_explicit(x, memory_order_acquire);
+}
+
+static inline void fx_log_store(cb_index_t *x, uint32_t v)
+{
+	atomic_store_explicit(x, v, memory_order_release);
+}
+
+static inline uint8_t fx_log_claim(cb_index_t *x, uint32_t expected)
+{
+	return atomic_compare_exchange_weak_explicit(x, &expected, expected + 1, \
+					memory_order_relaxed, memory_order_relaxed);
+}
+
+#else
+
+//Single core MCU: the claim has to be atomic with respect to the ISRs
+static inline uint32_t fx_log_load(cb_index_t *x)
+{
+	#if defined(__GNUC__)
+	return __atomic_load_n(x, __ATOMIC_ACQUIRE);
+	#else
+	return *x;
+	#endif
+}
+
+static inline void fx_log_store(cb_index_t *x, uint32_t v)
+{
+	#if defined(__GNUC__)
+	__atomic_store_n(x, v, __ATOMIC_RELEASE);
+	#else
+	*x = v;
+	#endif
+}
+
+static inline uint8_t fx_log_claim(cb_index_t *x, uint32_t expected)
+{
+	#if defined(__GNUC__)
+	return __atomic_compare_exchange_n(x, &expected, expected + 1, 1, \
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	#else
+	//No CAS: only log from one context
+	if(*x != expected) { return 0; }
+	*x = expected + 1;
+	return 1;
+	#endif
+}
+
+#endif	//CB_ATOMICS
+
+#endif	//FX_LOG_DEFERRED
+
+#ifdef FX_LOG_THREAD
+
+static void *fx_log_thread(void *arg)
+{
+	struct timespec period;
+	(void)arg;
+
+	period.tv_sec = fxLogThreadPeriodMs / 1000;
+	period.tv_nsec = (long)(fxLogThreadPeriodMs % 1000) * 1000000;
+	while(__atomic_load_n(&fxLogThreadRunning, __ATOMIC_ACQUIRE))
+	{
+		while(fx_log_process(FX_LOG_RING_LEN)) {}
+		nanosleep(&period, NULL);
+	}
+
+	return NULL;
+}
+
+#endif	//FX_LOG_THREAD
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,9 +1,17 @@
 #include "flexsea_multi_circbuff.h"
 #include "flexsea_multi_frame_packet_def.h"
 #include "flexsea_comm_multi.h"
+#include "flexsea_comm.h"
 #include "flexsea_circular_buffer.h"
+#include "flexsea_simd.h"
 #include <string.h>
-#include "log.h"
+#include "flexsea_log.h"
+
+//circ_buff_search_sof() looks for HEADER
+#if (MULTI_SOF != HEADER)
+	#error "MULTI_SOF has to match HEADER"
+#endif
+
 typedef struct MultiInfoByte_struct {
 	uint8_t packetId;
 	uint8_t frameId;
@@ -14,10 +22,10 @@ typedef struct MultiInfoByte_struct {
 // Private Function Prototypes
 // --------------------------------
 int circ_buff_checkFrame(circularBuffer_t *cb, int headerPos);
-int circ_buff_copyToWrapper(circularBuffer_t* cb, int headerPos, MultiWrapper* p);
+int circ_buff_copyToWrapper(circularBuffer_t* cb, int headerPos, MultiWrapper* p, \
+							uint16_t checksumErrors);
 static inline MultiInfoByte decodeMultiInfo(circularBuffer_t* cb, int headerPos);
-unsigned copyEscapedString(uint8_t *dst, uint8_t *src, unsigned nb);
-void circ_buff_copyToUnpacked(circularBuffer_t* cb, int headerPos, int bytes, MultiWrapper* p);
+int circ_buff_copyToUnpacked(circularBuffer_t* cb, int headerPos, int bytes, MultiWrapper* p);
 
 // --------------------------------
 // Public Function Implementations
@@ -25,25 +33,28 @@ void circ_buff_copyToUnpacked(circularBuffer_t* cb, int headerPos, int bytes, Mu
 
 uint16_t unpack_multi_payload_cb(circularBuffer_t *cb, MultiWrapper* p)
 {
-	LOG(ldebug3,"Unloading payload");
+	FX_LOG_ID(FXLOG_MULTI_UNLOADING);
     int foundString = 0;
     int lastPossibleHeaderIndex = circ_buff_get_size(cb) - MULTI_NUM_OVERHEAD_BYTES_FRAME;
     int headerPos = -1;
+    uint16_t checksumErrors = 0;
 
     // search for a frame
     while(!foundString && headerPos < lastPossibleHeaderIndex)
     {
-        headerPos = circ_buff_search(cb, MULTI_SOF, headerPos+1);
+        headerPos = circ_buff_search_sof(cb, headerPos+1);
 
         //if we can't find a header, we quit searching for strings
         if(headerPos == -1)
         	break;
 
         foundString = circ_buff_checkFrame(cb, headerPos);
+        if(foundString < 0) { checksumErrors++; foundString = 0; }
     }
 
+    //Bad frames are only counted once they are consumed (with this one)
     if(foundString)
-    	return circ_buff_copyToWrapper(cb, headerPos, p);
+    	return circ_buff_copyToWrapper(cb, headerPos, p, checksumErrors);
 
     return 0;
 }
@@ -61,37 +72,50 @@ uint16_t unpack_multi_payload_cb_cached(circularBuffer_t *cb, MultiWrapper* p, i
     int foundString = 0;
     int lastPossibleHeaderIndex = bufSize - MULTI_NUM_OVERHEAD_BYTES_FRAME;
     int headerPos = (*cacheStart)-1;
-    int lastHeaderPos = headerPos;
+    int pendingHeaderPos = -1, searchedAll = 0;
+    uint16_t checksumErrors = 0;
 
     // search for a frame
     while(!foundString && headerPos < lastPossibleHeaderIndex)
     {
-        headerPos = circ_buff_search(cb, MULTI_SOF, headerPos+1);
+        headerPos = circ_buff_search_sof(cb, headerPos+1);
 
         //if we can't find a header, we quit searching for strings
         if(headerPos == -1)
+        {
+        	searchedAll = 1;
         	break;
+        }
 
         foundString = circ_buff_checkFrame(cb, headerPos);
-        lastHeaderPos = headerPos;
+        if(foundString < 0) { checksumErrors++; foundString = 0; }
+        else if(!foundString && pendingHeaderPos < 0 && \
+        		(headerPos > lastPossibleHeaderIndex || \
+        		MULTI_EOF_POS_FROM_SOF(headerPos, circ_buff_peak(cb, headerPos + 1)) >= bufSize))
+        {
+        	// frame still arriving (split between transfers): search from there next time
+        	pendingHeaderPos = headerPos;
+        }
     }
 
     int numBytesInPackedString = 0;
     if(foundString)
     {
-    	numBytesInPackedString = circ_buff_copyToWrapper(cb, headerPos, p);
+    	numBytesInPackedString = circ_buff_copyToWrapper(cb, headerPos, p, checksumErrors);
 
-        // update the cached header value
+        // everything up to the end of this frame is consumed
         *cacheStart = numBytesInPackedString;
-        *cacheStart = circ_buff_search_not(cb, 0, *cacheStart);
     }
     else
     {
-        // update the cached header value
-        if(lastHeaderPos >= 0)
-            *cacheStart = lastHeaderPos;
-        else
+        // update the cached header value: the next search starts at the first
+        // frame still arriving, else after the bytes already searched
+        if(pendingHeaderPos >= 0)
+            *cacheStart = pendingHeaderPos;
+        else if(searchedAll)
             *cacheStart = bufSize;
+        else
+            *cacheStart = headerPos + 1;
     }
 
     return numBytesInPackedString;
@@ -104,11 +128,12 @@ uint16_t unpack_multi_payload_cb_cached(circularBuffer_t *cb, MultiWrapper* p, i
 int circ_buff_checkFrame(circularBuffer_t *cb, int headerPos)
 {
     int foundFrame = 0, numBytes, footerPos, checksum;
-    if(headerPos <= cb->size - MULTI_NUM_OVERHEAD_BYTES_FRAME)
+    int bufSize = circ_buff_get_size(cb);
+    if(headerPos <= bufSize - MULTI_NUM_OVERHEAD_BYTES_FRAME)
     {
     	numBytes = circ_buff_peak(cb, headerPos + 1);
     	footerPos = MULTI_EOF_POS_FROM_SOF(headerPos, numBytes);
-        foundFrame = (footerPos < cb->size && circ_buff_peak(cb, footerPos) == MULTI_EOF);
+        foundFrame = (footerPos < bufSize && circ_buff_peak(cb, footerPos) == MULTI_EOF);
     }
 
     if(foundFrame)
@@ -116,17 +141,19 @@ int circ_buff_checkFrame(circularBuffer_t *cb, int headerPos)
         //checksum only adds actual data, not any of the frame stuff
         checksum = circ_buff_checksum(cb, MULTI_DATA_POS_FROM_SOF(headerPos) , footerPos-1);
 
-        //if checksum is valid than we found a valid string
-        return (checksum == circ_buff_peak(cb, footerPos-1));
+        //if checksum is valid than we found a valid string (-1: bad checksum)
+        return (checksum == circ_buff_peak(cb, footerPos-1)) ? 1 : -1;
     }
 
     return 0;
 }
 
-int circ_buff_copyToWrapper(circularBuffer_t* cb, int headerPos, MultiWrapper* p)
+int circ_buff_copyToWrapper(circularBuffer_t* cb, int headerPos, MultiWrapper* p, \
+							uint16_t checksumErrors)
 {
 	int bytes = circ_buff_peak(cb, headerPos + 1);
 	int numBytesInPackedString = headerPos + bytes + MULTI_NUM_OVERHEAD_BYTES_FRAME;
+	int escapes = -1;
 
 	MultiInfoByte mInfo = decodeMultiInfo(cb, headerPos);
 
@@ -139,41 +166,60 @@ int circ_buff_copyToWrapper(circularBuffer_t* cb, int headerPos, MultiWrapper* p
 	if (mInfo.packetId == p->currentMultiPacket)
 	{
 		// Note that in this implementation we parse each frame as we receive it and we require them to be received in order
-		circ_buff_copyToUnpacked(cb, headerPos, bytes, p);
-
-		//set the multi's map to record we received this frame
-		p->frameMap |= (1 << mInfo.frameId);
-		if (mInfo.frameId == mInfo.lastFrameInPacket)
-			p->isMultiComplete = 1;
+		escapes = circ_buff_copyToUnpacked(cb, headerPos, bytes, p);
 
+		if(escapes < 0)
+		{
+			//too long: the packet is lost, its next frames will be ignored
+			resetToPacketId(p, MULTI_PACKETID_DROPPED);
+		}
+		else
+		{
+			//set the multi's map to record we received this frame
+			p->frameMap |= (1 << mInfo.frameId);
+			if (mInfo.frameId == mInfo.lastFrameInPacket)
+				p->isMultiComplete = 1;
+		}
 	}
 
+	//RX statistics (p is the 'in' wrapper of its port)
+	CommCounters *c = &p->stats.counters;
+	commStatsBegin(&p->stats);
+	c->frames++;
+	c->bytes += bytes + MULTI_NUM_OVERHEAD_BYTES_FRAME;
+	c->resyncBytes += headerPos;
+	c->checksumErrors += checksumErrors;
+	if(escapes < 0) { c->multiDrops++; }
+	else { c->escapes += escapes; }
+	commStatsEnd(&p->stats);
+
 	return numBytesInPackedString;
 
 }
 
-void circ_buff_copyToUnpacked(circularBuffer_t* cb, int headerPos, int bytes, MultiWrapper* p)
+//Returns the number of ESCAPE bytes removed, -1 if the frame was dropped
+int circ_buff_copyToUnpacked(circularBuffer_t* cb, int headerPos, int bytes, MultiWrapper* p)
 {
-	int start = (cb->head + headerPos + MULTI_DATA_OFFSET) % CB_BUF_LEN;
-	static uint8_t packed_msg[PACKET_WRAPPER_LEN];
+	int start = circ_buff_index_of(cb, headerPos + MULTI_DATA_OFFSET);
+	uint8_t *dst = p->unpacked + p->unpackedIdx;
+	uint8_t lastWasEscape = 0;
 
-	if(start + bytes > CB_BUF_LEN)
-	{
-		// clear packed message buffer
-		memset(packed_msg, 0x00, sizeof(packed_msg));
-		// calculate number of bytes left till end of circular buffer
-		uint16_t bytesUntilEnd = CB_BUF_LEN - start;
-		// copy back portion of the buffer
-		memcpy(packed_msg, cb->bytes + start, bytesUntilEnd);
-		// copy front portion of buffer
-		memcpy(packed_msg + bytesUntilEnd, cb->bytes, bytes - bytesUntilEnd);
-		// now unpack the data to get rid of 0xE9 escape characters
-		p->unpackedIdx += copyEscapedString(p->unpacked, packed_msg, bytes);
-	}
-	else
+	// the frame is appended to the previous ones (fx_unescape() needs room for all of it)
+	if(p->unpackedIdx + bytes > UNPACKED_BUFF_SIZE)
 	{
-		p->unpackedIdx += copyEscapedString(p->unpacked, cb->bytes + start, bytes);
+		FX_LOG_ID_EVERY(FX_LOG_PERIOD, FXLOG_MULTI_TOO_LONG);
+		return -1;
 	}
+
+	// number of bytes until the end of the circular buffer (or its mirror)
+	int firstLen = (start + bytes > (int)cb->mapped) ? (int)cb->mapped - start : bytes;
+
+	// unescape both linear spans straight from the buffer to get rid of 0xE9 escape characters
+	dst += fx_unescape(dst, cb->bytes + start, firstLen, &lastWasEscape);
+	dst += fx_unescape(dst, cb->bytes, bytes - firstLen, &lastWasEscape);
+	int unescaped = dst - (p->unpacked + p->unpackedIdx);
+	p->unpackedIdx = dst - p->unpacked;
+	return bytes - unescaped;
 }
 
 static inline MultiInfoByte decodeMultiInfo(circularBuffer_t* cb, int headerPos)
@@ -189,21 +235,3 @@ static inline MultiInfoByte decodeMultiInfo(circularBuffer_t* cb, int headerPos)
 	return result;
 
 }
-
-unsigned copyEscapedString(uint8_t *dst, uint8_t *src, unsigned nb)
-{
-	unsigned i = 0, k, lastWasEscape = 0;
-	for(k = 0; k < nb; k++)
-	{
-		if(src[k] == MULTI_ESC && (!lastWasEscape))
-		{
-			lastWasEscape = 1;
-		}
-		else
-		{
-			lastWasEscape = 0;
-			dst[i++] = src[k];
-		}
-	}
-	return i;
-}
@@ -40,7 +40,7 @@ extern "C" {
 #include <string.h>
 #include <flexsea_payload.h>
 #include <flexsea_board.h>
-#include "log.h"
+#include "flexsea_log.h"
 //****************************************************************************
 // Variable(s)
 //****************************************************************************
@@ -52,7 +52,8 @@ uint8_t lastPayloadParsed[2] = {0, 0};
 // Private Function Prototype(s):
 //****************************************************************************
 
-static void route(PacketWrapper * p, PortType to);
+static uint8_t parse(PacketWrapper* p, uint8_t *cp_str, const CommFrameView *v);
+static void route(PacketWrapper * p, PortType to, const CommFrameView *v);
 
 //****************************************************************************
 // Public Function(s):
@@ -62,84 +63,17 @@ static void route(PacketWrapper * p, PortType to);
 //ToDo improve: for now, supports only one command per string
 uint8_t payload_parse_str(PacketWrapper* p)
 {
-	uint8_t *cp_str = p->unpaked;
-	uint8_t info[2] = {0,0};
-	uint8_t cmd = 0, cmd_7bits = 0;
-	unsigned int id = 0;
-	uint8_t pType = RX_PTYPE_INVALID;
-	info[0] = (uint8_t)p->sourcePort;
-
-	//Command
-	cmd = cp_str[P_CMD1];		//CMD w/ R/W bit
-	cmd_7bits = CMD_7BITS(cmd);	//CMD code, no R/W information
-
-	//First, get RID code
-	id = get_rid(cp_str);
-	if(id == ID_MATCH)
-	{
-		p->destinationPort = PORT_NONE;	//We are home
-		pType = packetType(cp_str);
-		
-		//It's addressed to me. Function pointer array will call
-		//the appropriate handler (as defined in flexsea_system):
-		if((cmd_7bits <= MAX_CMD_CODE) && (pType <= RX_PTYPE_MAX_INDEX))
-		{
-			//Save info about the last success:
-			lastPayloadParsed[0] = cmd_7bits;
-			lastPayloadParsed[1] = pType;
-			//Call handler:
-			(*flexsea_payload_ptr[cmd_7bits][pType]) (cp_str, info);
-			return PARSE_SUCCESSFUL;
-		}
-		else
-		{
-			return PARSE_DEFAULT;
-		}
-	}
-	else if(id == ID_SUB1_MATCH)
-	{
-		#ifndef USB_SPI_BRIDGE
-		//For a slave on bus #1:
-		p->destinationPort = PORT_RS485_1;
-		route(p, SLAVE);
-		#else
-		//This will redirect the EX1 requests to SPI:
-		p->destinationPort = PORT_EXP;
-		route(p, SLAVE);
-		#endif
-	}
-	#if(defined BOARD_TYPE_FLEXSEA_EXECUTE || defined BOARD_TYPE_FLEXSEA_PROTOTOTYPE)
-	else if(id == ID_SUB2_MATCH)
-	{
-		//For a slave on bus #2:
-		p->destinationPort = PORT_RS485_2;
-		route(p, SLAVE);
-	}
-	else if(id == ID_SUB3_MATCH)
-	{
-		//For a slave on the expansion port:
-		p->destinationPort = PORT_EXP;
-		route(p, SLAVE);
-	}
-	#endif	//BOARD_TYPE_FLEXSEA_EXECUTE
-	else if((id == ID_UP_MATCH) || (id == ID_OTHER_MASTER))
-	{
-		//For a master:
-
-		#ifdef BOARD_TYPE_FLEXSEA_MANAGE
-
-		//Manage is the only board that can receive a package destined to his master
-		route(p, MASTER);
-
-		#endif	//BOARD_TYPE_FLEXSEA_MANAGE
-	}
-	else
-	{
-		return PARSE_ID_NO_MATCH;
-	}
+	return parse(p, p->unpaked, NULL);
+}
 
-	//Shouldn't get here...
-	return PARSE_DEFAULT;
+//Zero-copy version: the handlers get the payload where it is (receive ring,
+//see comm_frame_view()). p only needs its ports; the frame is copied into it
+//when it has to be routed. Payloads too short to hold the header (IDs and
+//command) are refused.
+uint8_t payload_parse_view(PacketWrapper* p, const CommFrameView *v)
+{
+	if(v->payloadLen < P_DATA1) { return PARSE_DEFAULT; }
+	return parse(p, v->payload, v);
 }
 
 //Start a new payload string
@@ -195,15 +129,12 @@ inline uint8_t tryParseRx(CommPeriph *cp, PacketWrapper *pw)
 	cp->rx.bytesReadyFlag--;
 	uint8_t successfulParse = 0, error;
 
-	uint16_t numBytesConverted = unpack_payload_cb(\
-			cp->rx.circularBuff, \
-			cp->rx.packedPtr, \
-			cp->rx.unpackedPtr);
+	uint16_t numBytesConverted = unpack_payload_periph(&cp->rx);
 	if(numBytesConverted > 0)
 	{
 		error = circ_buff_move_head(cp->rx.circularBuff, numBytesConverted);
 		if(error){
-			LOG(lerror,"circ_buff_move_head error %u", error);
+			FX_LOG_ID(FXLOG_MOVE_HEAD_ERROR, error);
 		}
 
 
@@ -221,10 +152,7 @@ inline uint8_t tryParseRx(CommPeriph *cp, PacketWrapper *pw)
 	cp->rx.bytesReadyFlag--;	// = 0;
 	uint8_t error = 0;
 
-	uint16_t numBytesConverted = unpack_payload_cb(\
-			cp->rx.circularBuff, \
-			cp->rx.packedPtr, \
-			cp->rx.unpackedPtr);
+	uint16_t numBytesConverted = unpack_payload_periph(&cp->rx);
 		
 	if(numBytesConverted > 0)
 	{
@@ -232,7 +160,7 @@ inline uint8_t tryParseRx(CommPeriph *cp, PacketWrapper *pw)
 
 		if(error)
 		{
-			LOG(lerror,"circ_buff_move_head error %u", error);
+			FX_LOG_ID(FXLOG_MOVE_HEAD_ERROR, error);
 		}
 		fillPacketFromCommPeriph(cp, pw);
 		// payload_parse_str returns 2 on successful parse
@@ -243,6 +171,54 @@ inline uint8_t tryParseRx(CommPeriph *cp, PacketWrapper *pw)
 }
 #endif
 
+//Batch version of tryParseRx(): every complete frame is parsed, back to back.
+//They are then consumed with a single head move. As with tryParseRx(), pw
+//holds the last frame (packed and unpaked) when we return.
+//Returns the number of frames found, *parsed: # parsed successfully.
+uint8_t tryParseRxBatch(CommPeriph *cp, PacketWrapper *pw, uint8_t *parsed)
+{
+	CommFrame frames[COMM_RX_BATCH];
+	CommFrameView view;
+	uint32_t escapes = 0;
+	uint8_t i, n;
+
+	(*parsed) = 0;
+	if(!(cp->rx.bytesReadyFlag > 0)) return 0;
+	cp->rx.bytesReadyFlag--;
+
+	n = unpack_payload_stream_batch(cp->rx.circularBuff, &cp->rx.decoder, \
+									frames, COMM_RX_BATCH);
+	for(i = 0; i < n; i++)
+	{
+		//Handlers read the frames in the ring (copied only if they wrap or
+		//contain escapes)
+		comm_frame_view(cp->rx.circularBuff, &frames[i], &view, \
+						cp->rx.packedPtr, cp->rx.unpackedPtr);
+		escapes += frames[i].bytes - view.payloadLen;
+		fillPacketPortsFromCommPeriph(cp, pw);
+		if(payload_parse_view(pw, &view) == PARSE_SUCCESSFUL) { (*parsed)++; }
+	}
+
+	//The view is still valid, the head hasn't moved yet
+	if(n) { fillPacketFromFrameView(&view, pw); }
+
+	if(n || cp->rx.decoder.checksumErrors || cp->rx.decoder.framingErrors)
+	{
+		commStatsRx(&cp->rx, frames, n, escapes);
+	}
+
+	if(n)
+	{
+		uint8_t error = circ_buff_move_head(cp->rx.circularBuff, COMM_FRAME_END(frames[n - 1]));
+		if(error)
+		{
+			FX_LOG_ID(FXLOG_MOVE_HEAD_ERROR, error);
+		}
+	}
+
+	return n;
+}
+
 //Accessor function for the API: what did we last parse?
 void getSignatureOfLastPayloadParsed(uint8_t *cmd, uint8_t *type)
 {
@@ -254,12 +230,97 @@ void getSignatureOfLastPayloadParsed(uint8_t *cmd, uint8_t *type)
 // Private Function(s):
 //****************************************************************************
 
-static void route(PacketWrapper * p, PortType to)
+//Decode/parse received string (payload_parse_str() / payload_parse_view())
+static uint8_t parse(PacketWrapper* p, uint8_t *cp_str, const CommFrameView *v)
+{
+	uint8_t info[2] = {0,0};
+	uint8_t cmd = 0, cmd_7bits = 0;
+	unsigned int id = 0;
+	uint8_t pType = RX_PTYPE_INVALID;
+	info[0] = (uint8_t)p->sourcePort;
+
+	//Command
+	cmd = cp_str[P_CMD1];		//CMD w/ R/W bit
+	cmd_7bits = CMD_7BITS(cmd);	//CMD code, no R/W information
+
+	//First, get RID code
+	id = get_rid(cp_str);
+	if(id == ID_MATCH)
+	{
+		p->destinationPort = PORT_NONE;	//We are home
+		pType = packetType(cp_str);
+		
+		//It's addressed to me. Function pointer array will call
+		//the appropriate handler (as defined in flexsea_system):
+		if((cmd_7bits <= MAX_CMD_CODE) && (pType <= RX_PTYPE_MAX_INDEX))
+		{
+			//Save info about the last success:
+			lastPayloadParsed[0] = cmd_7bits;
+			lastPayloadParsed[1] = pType;
+			//Call handler:
+			(*flexsea_payload_ptr[cmd_7bits][pType]) (cp_str, info);
+			return PARSE_SUCCESSFUL;
+		}
+		else
+		{
+			return PARSE_DEFAULT;
+		}
+	}
+	else if(id == ID_SUB1_MATCH)
+	{
+		#ifndef USB_SPI_BRIDGE
+		//For a slave on bus #1:
+		p->destinationPort = PORT_RS485_1;
+		route(p, SLAVE, v);
+		#else
+		//This will redirect the EX1 requests to SPI:
+		p->destinationPort = PORT_EXP;
+		route(p, SLAVE, v);
+		#endif
+	}
+	#if(defined BOARD_TYPE_FLEXSEA_EXECUTE || defined BOARD_TYPE_FLEXSEA_PROTOTOTYPE)
+	else if(id == ID_SUB2_MATCH)
+	{
+		//For a slave on bus #2:
+		p->destinationPort = PORT_RS485_2;
+		route(p, SLAVE, v);
+	}
+	else if(id == ID_SUB3_MATCH)
+	{
+		//For a slave on the expansion port:
+		p->destinationPort = PORT_EXP;
+		route(p, SLAVE, v);
+	}
+	#endif	//BOARD_TYPE_FLEXSEA_EXECUTE
+	else if((id == ID_UP_MATCH) || (id == ID_OTHER_MASTER))
+	{
+		//For a master:
+
+		#ifdef BOARD_TYPE_FLEXSEA_MANAGE
+
+		//Manage is the only board that can receive a package destined to his master
+		route(p, MASTER, v);
+
+		#endif	//BOARD_TYPE_FLEXSEA_MANAGE
+	}
+	else
+	{
+		return PARSE_ID_NO_MATCH;
+	}
+
+	//Shouldn't get here...
+	return PARSE_DEFAULT;
+}
+
+static void route(PacketWrapper * p, PortType to, const CommFrameView *v)
 {
 	#ifdef BOARD_TYPE_FLEXSEA_MANAGE
 
 		Port idx = PORT_NONE;
 
+		//Zero-copy reception: the frame is only copied when it's routed
+		if(v) { fillPacketFromFrameView(v, p); }
+
 		if(to == SLAVE)
 		{
 			idx = p->destinationPort;
@@ -283,6 +344,7 @@ static void route(PacketWrapper * p, PortType to)
 
 		(void)p;
 		(void)to;
+		(void)v;
 
 	#endif 	//BOARD_TYPE_FLEXSEA_MANAGE
 }
@@ -341,7 +403,7 @@ uint8_t get_rid(uint8_t *pldata)
 	}
 
 	//If we end up here it's because we didn't get a match:
-	LOG(lwarning,"No matching id found");
+	FX_LOG(lwarning,"No matching id found");
 	return ID_NO_MATCH;
 }
 
@@ -0,0 +1,331 @@
+/****************************************************************************
+	[Project] FlexSEA: Flexible & Scalable Electronics Architecture
+	[Sub-project] 'flexsea-comm' Communication stack
+	Copyright (C) 2016 Dephy, Inc. <http://dephy.com/>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************
+	[Lead developper] Jean-Francois (JF) Duval, jfduval at dephy dot com.
+	[Origin] Based on Jean-Francois Duval's work at the MIT Media Lab
+	Biomechatronics research group <http://biomech.media.mit.edu/>
+	[Contributors]
+*****************************************************************************
+	[This file] flexsea_sim_link: simulated link between two ports (host)
+*****************************************************************************
+	[Change log] (Convention: YYYY-MM-DD | author | comment)
+	* 2026-10-17 | agent | Initial release
+	*
+****************************************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef BOARD_TYPE_FLEXSEA_PLAN
+
+//****************************************************************************
+// Include(s)
+//****************************************************************************
+
+#include <string.h>
+#include "flexsea_sim_link.h"
+#include "flexsea_interface.h"
+#include "flexsea_log.h"
+
+//****************************************************************************
+// Variable(s)
+//****************************************************************************
+
+//921600 baud, 8N1. Frames are delivered at the end of each write (DMA idle
+//line interrupt).
+const SimLinkConfig simLinkRs485 = {921600, 10, 1, 0, 0, 0, 0, 0, 1};
+
+//CDC bulk: 19 packets of 64 bytes per 1 ms frame, a short packet costs a
+//whole one, and the transfer waits for the next frame (host polling)
+const SimLinkConfig simLinkUsbFs = {19 * 64 * 8 * 1000, 8, 1000, 0, 64, 0, 0, 0, 1};
+
+//****************************************************************************
+// Private Function Prototype(s):
+//****************************************************************************
+
+static SimChannel *simChannelFrom(SimLink *l, MultiCommPeriph *from);
+static void simChannelWrite(SimChannel *c, const FxIoVec *iov, uint8_t count);
+static uint8_t simTransportSend(void *ctx, const uint8_t *data, uint16_t len);
+static uint8_t simTransportSendVectored(void *ctx, const FxIoVec *iov, uint8_t count);
+static uint8_t simTransportReady(void *ctx);
+static double simRandom(SimLink *l);
+static void simPush(SimChannel *c, uint8_t byte, uint64_t arrival);
+static uint16_t simDeliver(SimChannel *c, uint64_t now, uint16_t rxChunk);
+
+//****************************************************************************
+// Public Function(s)
+//****************************************************************************
+
+//Connects a and b. Their circular buffers must be attached already.
+void simLinkInit(SimLink *l, MultiCommPeriph *a, MultiCommPeriph *b, const SimLinkConfig *config)
+{
+	memset(l, 0, sizeof(SimLink));
+	l->config = *config;
+	l->random = config->seed ? config->seed : 1;
+	l->a = a;
+	l->b = b;
+	l->ch[0].link = l;
+	l->ch[0].rx = b;
+	l->ch[1].link = l;
+	l->ch[1].rx = a;
+}
+
+//The transmitter is idle (like !CDC_CheckBusy_FS())
+uint8_t simLinkReady(SimLink *l, MultiCommPeriph *from)
+{
+	SimChannel *c = simChannelFrom(l, from);
+	return (c && simTransportReady(c));
+}
+
+//Puts len bytes on the wire, after the ones being transmitted. The
+//impairments are applied here. Returns the number of bytes taken (all of
+//them, even if the write gets lost: the sender can't tell), 0 on error.
+uint16_t simLinkSend(SimLink *l, MultiCommPeriph *from, const uint8_t *data, uint16_t len)
+{
+	FxIoVec iov;
+	SimChannel *c = simChannelFrom(l, from);
+
+	if(!c || !data || !len) { return 0; }
+
+	iov.data = data;
+	iov.len = len;
+	simChannelWrite(c, &iov, 1);
+	return len;
+}
+
+//Transport of 'from' over the link, for transmitFxPacketByPeriph() or
+//fxTransportBind()
+void simLinkTransport(SimLink *l, MultiCommPeriph *from, FxTransport *t)
+{
+	t->send = simTransportSend;
+	t->sendVectored = simTransportSendVectored;
+	t->ready = simTransportReady;
+	t->maxChunk = 0;
+	t->ctx = simChannelFrom(l, from);
+}
+
+//transmitFxPacket() for a simulated port: sends the next frame of from->out
+uint8_t simLinkTransmit(SimLink *l, MultiCommPeriph *from)
+{
+	FxTransport t;
+
+	simLinkTransport(l, from, &t);
+	if(!t.ctx) { return 1; }
+	return transmitFxPacketByPeriph(from, &t);
+}
+
+//transmitFxPacketBurst() for a simulated port: all the frames left, in one
+//write
+uint8_t simLinkTransmitBurst(SimLink *l, MultiCommPeriph *from, uint8_t *framesSent)
+{
+	FxTransport t;
+
+	simLinkTransport(l, from, &t);
+	if(!t.ctx)
+	{
+		if(framesSent) { *framesSent = 0; }
+		return 1;
+	}
+	return transmitFxPacketBurstByPeriph(from, &t, framesSent);
+}
+
+//Moves the time to 'until' (ns) and delivers the bytes arrived by then, in
+//order. The receivers still have to parse them (receiveFxPacketByPeriph()).
+//Returns the number of deliveries.
+uint16_t simLinkRun(SimLink *l, uint64_t until)
+{
+	uint16_t n = 0;
+
+	if(until > l->now) { l->now = until; }
+
+	n += simDeliver(&l->ch[0], l->now, l->config.rxChunk);
+	n += simDeliver(&l->ch[1], l->now, l->config.rxChunk);
+
+	return n;
+}
+
+uint16_t simLinkAdvance(SimLink *l, uint32_t us)
+{
+	return simLinkRun(l, l->now + us * 1000ULL);
+}
+
+//****************************************************************************
+// Private Function(s)
+//****************************************************************************
+
+static SimChannel *simChannelFrom(SimLink *l, MultiCommPeriph *from)
+{
+	if(from == l->a) { return &l->ch[0]; }
+	if(from == l->b) { return &l->ch[1]; }
+	return NULL;
+}
+
+//One transfer (write): the buffers go back to back, and the receiver sees the
+//end of the last one
+static void simChannelWrite(SimChannel *c, const FxIoVec *iov, uint8_t count)
+{
+	SimLink *l = c->link;
+	const SimLinkConfig *cfg = &l->config;
+	uint64_t byteTime = 0, t, delay = cfg->delayUs * 1000ULL;
+	uint32_t len = 0, slots;
+	uint16_t i;
+	uint8_t k, bit, byte;
+
+	if(cfg->bitsPerSecond) { byteTime = (uint64_t)cfg->bitsPerByte * 1000000000ULL / cfg->bitsPerSecond; }
+	t = (c->busyUntil > l->now) ? c->busyUntil : l->now;
+
+	for(k = 0; k < count; k++) { len += iov[k].len; }
+	c->stats.writes++;
+	c->stats.bytesSent += len;
+
+	//Time on the wire, in bytes
+	slots = len;
+	if(cfg->packetSize)
+	{
+		slots = ((len + cfg->packetSize - 1) / cfg->packetSize) * cfg->packetSize;
+	}
+
+	//A lost write still uses the line
+	if(cfg->writeLoss > 0 && simRandom(l) < cfg->writeLoss)
+	{
+		c->stats.writesLost++;
+		c->busyUntil = t + slots * byteTime;
+		return;
+	}
+	slots -= len;
+
+	for(k = 0; k < count; k++)
+	{
+		for(i = 0; i < iov[k].len; i++)
+		{
+			byte = iov[k].data[i];
+			if(cfg->bitErrorRate > 0)
+			{
+				for(bit = 0; bit < 8; bit++)
+				{
+					if(simRandom(l) < cfg->bitErrorRate)
+					{
+						byte ^= (1 << bit);
+						c->stats.bitsFlipped++;
+					}
+				}
+			}
+
+			t += byteTime;
+			simPush(c, byte, t + delay);
+
+			if(cfg->insertRate > 0 && simRandom(l) < cfg->insertRate)
+			{
+				t += byteTime;
+				simPush(c, (uint8_t)(simRandom(l) * 256), t + delay);
+				c->stats.bytesInserted++;
+			}
+		}
+	}
+
+	//The receiver sees the end of the write (idle line)
+	if(c->count) { c->endOfWrite[(c->head + c->count - 1) % SIM_LINK_QUEUE_LEN] = 1; }
+	c->busyUntil = t + slots * byteTime;
+}
+
+static uint8_t simTransportSend(void *ctx, const uint8_t *data, uint16_t len)
+{
+	FxIoVec iov;
+
+	iov.data = data;
+	iov.len = len;
+	simChannelWrite((SimChannel *)ctx, &iov, 1);
+	return 0;
+}
+
+static uint8_t simTransportSendVectored(void *ctx, const FxIoVec *iov, uint8_t count)
+{
+	simChannelWrite((SimChannel *)ctx, iov, count);
+	return count;
+}
+
+static uint8_t simTransportReady(void *ctx)
+{
+	SimChannel *c = (SimChannel *)ctx;
+	return (c->busyUntil <= c->link->now);
+}
+
+//xorshift32, [0, 1)
+static double simRandom(SimLink *l)
+{
+	uint32_t x = l->random;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	l->random = x;
+	return x / 4294967296.0;
+}
+
+static void simPush(SimChannel *c, uint8_t byte, uint64_t arrival)
+{
+	uint16_t i;
+
+	if(c->count >= SIM_LINK_QUEUE_LEN)
+	{
+		FX_LOG_EVERY(FX_LOG_PERIOD, lwarning, "Simulated link full, byte dropped");
+		c->stats.bytesDropped++;
+		return;
+	}
+
+	i = (c->head + c->count) % SIM_LINK_QUEUE_LEN;
+	c->bytes[i] = byte;
+	c->endOfWrite[i] = 0;
+	c->arrival[i] = arrival;
+	c->count++;
+}
+
+//Hands the arrived bytes to the receiver: rxChunk at a time, and what's left
+//at the end of a write. Returns the number of deliveries.
+static uint16_t simDeliver(SimChannel *c, uint64_t now, uint16_t rxChunk)
+{
+	uint8_t buf[SIM_LINK_MAX_CHUNK];
+	uint16_t n = 0, deliveries = 0, i;
+
+	if(!rxChunk || rxChunk > SIM_LINK_MAX_CHUNK) { rxChunk = SIM_LINK_MAX_CHUNK; }
+
+	while(n < c->count)
+	{
+		i = (c->head + n) % SIM_LINK_QUEUE_LEN;
+		if(c->arrival[i] > now) { break; }
+
+		buf[n++] = c->bytes[i];
+		if(n == rxChunk || c->endOfWrite[i])
+		{
+			copyIntoMultiPacket(c->rx, buf, n);
+			c->stats.bytesDelivered += n;
+			c->head = (c->head + n) % SIM_LINK_QUEUE_LEN;
+			c->count -= n;
+			n = 0;
+			deliveries++;
+		}
+	}
+
+	return deliveries;
+}
+
+#endif	//BOARD_TYPE_FLEXSEA_PLAN
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,533 @@
+/****************************************************************************
+	[Project] FlexSEA: Flexible & Scalable Electronics Architecture
+	[Sub-project] 'flexsea-comm' Communication stack
+	Copyright (C) 2016 Dephy, Inc. <http://dephy.com/>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************
+	[Lead developper] Jean-Francois (JF) Duval, jfduval at dephy dot com.
+	[Origin] Based on Jean-Francois Duval's work at the MIT Media Lab
+	Biomechatronics research group <http://biomech.media.mit.edu/>
+	[Contributors]
+*****************************************************************************
+	[This file] flexsea_simd: byte kernels of the framing code (AVX2/SSE2/SWAR)
+*****************************************************************************
+	[Change log] (Convention: YYYY-MM-DD | author | comment)
+	* 2026-10-17 | agent | Initial release
+	*
+****************************************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//****************************************************************************
+// Include(s)
+//****************************************************************************
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "flexsea_simd.h"
+#include "flexsea_comm_def.h"
+
+#if defined(FX_SIMD_AVX2)
+	#include <immintrin.h>
+#elif defined(FX_SIMD_SSE2)
+	#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+
+//****************************************************************************
+// Definition(s):
+//****************************************************************************
+
+//Native word used by the SWAR code. may_alias keeps GCC from assuming that
+//the word loads can't see the bytes written through uint8_t pointers.
+#if defined(__GNUC__)
+	typedef size_t __attribute__((__may_alias__)) fx_word_t;
+#else
+	typedef size_t fx_word_t;
+#endif
+
+#define SWAR_ONES			((fx_word_t)-1 / 0xFF)		//0x0101...01
+#define SWAR_HIGHS			(SWAR_ONES * 0x80)			//0x8080...80
+#define SWAR_HAS_ZERO(w)	(((w) - SWAR_ONES) & ~(w) & SWAR_HIGHS)
+#define SWAR_EVEN_BYTES		((fx_word_t)-1 / 0xFFFF * 0xFF)	//0x00FF00FF...
+#define SWAR_SUM_BLOCK		256		//Words summed before a 16-bit lane can overflow
+#define SWAR_SPECIAL(w)		(SWAR_HAS_ZERO((w) ^ (SWAR_ONES * HEADER)) | \
+							SWAR_HAS_ZERO((w) ^ (SWAR_ONES * FOOTER)) | \
+							SWAR_HAS_ZERO((w) ^ (SWAR_ONES * ESCAPE)))
+#define CHECKSUM_SHORT_LEN	16		//Below this, fx_checksum8() is a plain loop
+#define NEEDS_ESCAPE(c)		(((c) == HEADER) || ((c) == FOOTER) || ((c) == ESCAPE))
+#define UNESCAPE_BYTE(dst, o, c, esc)	do { \
+			if((c) == ESCAPE && !(esc)) { (esc) = 1; } \
+			else { (esc) = 0; (dst)[(o)++] = (c); } } while(0)
+
+//****************************************************************************
+// Private Function Prototype(s):
+//****************************************************************************
+
+static int32_t find_byte_scalar(const uint8_t *p, uint32_t start, uint32_t len, \
+								uint8_t value);
+static inline uint32_t fx_ctz(uint32_t mask);
+static inline int escape_byte(uint8_t *dst, uint32_t dstLen, uint32_t *o, \
+								uint8_t c, uint32_t *sum);
+#if defined(FX_SIMD_AVX2) || defined(FX_SIMD_SSE2)
+static inline uint32_t sad_fold(__m128i acc);
+#else
+static inline uint32_t swar_fold(fx_word_t even, fx_word_t odd);
+#endif
+
+//****************************************************************************
+// Public Function(s)
+//****************************************************************************
+
+int32_t fx_find_byte(const uint8_t *p, uint32_t len, uint8_t value)
+{
+	uint32_t i = 0;
+
+	#if defined(FX_SIMD_AVX2)
+
+	const __m256i needle = _mm256_set1_epi8((char)value);
+	for(; i + 32 <= len; i += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+		if(mask) { return (int32_t)(i + fx_ctz(mask)); }
+	}
+
+	#endif	//FX_SIMD_AVX2
+
+	#if defined(FX_SIMD_AVX2) || defined(FX_SIMD_SSE2)
+
+	const __m128i needle16 = _mm_set1_epi8((char)value);
+	for(; i + 16 <= len; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle16));
+		if(mask) { return (int32_t)(i + fx_ctz(mask)); }
+	}
+
+	#else
+
+	//Walk byte by byte until we are word aligned (no unaligned loads on M0):
+	while(i < len && ((uintptr_t)(p + i) & (sizeof(fx_word_t) - 1)))
+	{
+		if(p[i] == value) { return (int32_t)i; }
+		i++;
+	}
+
+	const fx_word_t pattern = SWAR_ONES * value;
+	for(; i + sizeof(fx_word_t) <= len; i += sizeof(fx_word_t))
+	{
+		fx_word_t w = *(const fx_word_t *)(p + i) ^ pattern;
+		if(SWAR_HAS_ZERO(w))
+		{
+			//Endian-neutral: let the scalar loop pick the exact byte
+			return find_byte_scalar(p, i, i + sizeof(fx_word_t), value);
+		}
+	}
+
+	#endif	//SIMD
+
+	return find_byte_scalar(p, i, len, value);
+}
+
+uint8_t fx_checksum8(const uint8_t *p, uint32_t len)
+{
+	uint32_t i = 0, sum = 0;
+
+	//Short commands: the vector setup and fold cost more than the sum. From 8
+	//bytes, one 64-bit word is summed in 16-bit lanes (the multiply adds the
+	//lanes in the top one).
+	if(len < CHECKSUM_SHORT_LEN)
+	{
+		if(len >= 8)
+		{
+			uint64_t w;
+			memcpy(&w, p, 8);
+			w = (w & 0x00FF00FF00FF00FFull) + ((w >> 8) & 0x00FF00FF00FF00FFull);
+			sum = (uint32_t)((w * 0x0001000100010001ull) >> 48);
+			i = 8;
+		}
+		for(; i < len; i++) { sum += p[i]; }
+		return (uint8_t)sum;
+	}
+
+	#if defined(FX_SIMD_AVX2)
+
+	//psadbw against zero: four 64-bit sums of 8 bytes each
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i acc = zero;
+	for(; i + 32 <= len; i += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+	}
+	__m128i acc16 = _mm_add_epi64(_mm256_castsi256_si128(acc), \
+									_mm256_extracti128_si256(acc, 1));
+
+	#elif defined(FX_SIMD_SSE2)
+
+	__m128i acc16 = _mm_setzero_si128();
+
+	#endif
+
+	#if defined(FX_SIMD_AVX2) || defined(FX_SIMD_SSE2)
+
+	const __m128i zero16 = _mm_setzero_si128();
+	for(; i + 16 <= len; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		acc16 = _mm_add_epi64(acc16, _mm_sad_epu8(v, zero16));
+	}
+	sum = sad_fold(acc16);
+
+	#else
+
+	while(i < len && ((uintptr_t)(p + i) & (sizeof(fx_word_t) - 1)))
+	{
+		sum += p[i++];
+	}
+
+	//Even and odd bytes are added in 16-bit lanes, folded every SWAR_SUM_BLOCK
+	//words
+	while(i + sizeof(fx_word_t) <= len)
+	{
+		fx_word_t even = 0, odd = 0;
+		uint32_t n = 0;
+		for(; n < SWAR_SUM_BLOCK && i + sizeof(fx_word_t) <= len; n++, i += sizeof(fx_word_t))
+		{
+			fx_word_t w = *(const fx_word_t *)(p + i);
+			even += w & SWAR_EVEN_BYTES;
+			odd += (w >> 8) & SWAR_EVEN_BYTES;
+		}
+		sum += swar_fold(even, odd);
+	}
+
+	#endif	//SIMD
+
+	for(; i < len; i++)
+	{
+		sum += p[i];
+	}
+
+	return (uint8_t)sum;
+}
+
+uint32_t fx_escape(uint8_t *dst, uint32_t dstLen, const uint8_t *src, \
+					uint32_t *srcLen, uint8_t *checksum)
+{
+	const uint32_t len = *srcLen;
+	uint32_t i = 0, o = 0, sum = 0;
+
+	//Clean blocks are stored as is. With a single special byte, we keep what
+	//precedes it, escape it, and the next block starts right after it. At the
+	//first escape heavy block (2+ special bytes) we switch to the byte loop
+	//for good: mixing the two costs more than the plain loop.
+	#if defined(FX_SIMD_AVX2)
+
+	const __m256i header = _mm256_set1_epi8((char)HEADER);
+	const __m256i footer = _mm256_set1_epi8((char)FOOTER);
+	const __m256i escape = _mm256_set1_epi8((char)ESCAPE);
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i acc = zero;
+
+	//Clean blocks only, the 16-byte loop takes over at the first special byte
+	while(i + 32 <= len && o + 32 <= dstLen)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+		__m256i special = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, header), \
+								_mm256_cmpeq_epi8(v, footer)), _mm256_cmpeq_epi8(v, escape));
+		if(_mm256_movemask_epi8(special)) { break; }
+
+		_mm256_storeu_si256((__m256i *)(dst + o), v);
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+		i += 32;
+		o += 32;
+	}
+	__m128i acc16 = _mm_add_epi64(_mm256_castsi256_si128(acc), \
+									_mm256_extracti128_si256(acc, 1));
+
+	#elif defined(FX_SIMD_SSE2)
+
+	__m128i acc16 = _mm_setzero_si128();
+
+	#endif
+
+	#if defined(FX_SIMD_AVX2) || defined(FX_SIMD_SSE2)
+
+	const __m128i header16 = _mm_set1_epi8((char)HEADER);
+	const __m128i footer16 = _mm_set1_epi8((char)FOOTER);
+	const __m128i escape16 = _mm_set1_epi8((char)ESCAPE);
+	const __m128i lane16 = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m128i zero16 = _mm_setzero_si128();
+
+	while(i + 16 <= len && o + 16 <= dstLen)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, header16), \
+								_mm_cmpeq_epi8(v, footer16)), _mm_cmpeq_epi8(v, escape16));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(special);
+		_mm_storeu_si128((__m128i *)(dst + o), v);
+
+		if(!mask)
+		{
+			acc16 = _mm_add_epi64(acc16, _mm_sad_epu8(v, zero16));
+			i += 16;
+			o += 16;
+			continue;
+		}
+
+		//Escape heavy: the rest goes through the plain byte loop
+		if(mask & (mask - 1)) { break; }
+
+		uint32_t run = fx_ctz(mask);
+		__m128i keep = _mm_cmpgt_epi8(_mm_set1_epi8((char)run), lane16);
+		acc16 = _mm_add_epi64(acc16, _mm_sad_epu8(_mm_and_si128(v, keep), zero16));
+		i += run;
+		o += run;
+		if(!escape_byte(dst, dstLen, &o, src[i], &sum)) { break; }
+		i++;
+	}
+	sum += sad_fold(acc16);
+
+	#else
+
+	//Clean (aligned) words are copied as is and summed in lanes
+	while(i < len)
+	{
+		if(!((uintptr_t)(src + i) & (sizeof(fx_word_t) - 1)))
+		{
+			fx_word_t even = 0, odd = 0;
+			uint32_t start = i, n = 0;
+			while(n < SWAR_SUM_BLOCK && i + sizeof(fx_word_t) <= len && \
+					o + (i - start) + sizeof(fx_word_t) <= dstLen)
+			{
+				fx_word_t w = *(const fx_word_t *)(src + i);
+				if(SWAR_SPECIAL(w)) { break; }
+				memcpy(dst + o + (i - start), &w, sizeof(fx_word_t));
+				even += w & SWAR_EVEN_BYTES;
+				odd += (w >> 8) & SWAR_EVEN_BYTES;
+				i += sizeof(fx_word_t);
+				n++;
+			}
+
+			if(n)
+			{
+				o += i - start;
+				sum += swar_fold(even, odd);
+				continue;
+			}
+		}
+
+		//Byte by byte up to the next word boundary (through a special word)
+		uint32_t end = i + sizeof(fx_word_t) - ((uintptr_t)(src + i) & (sizeof(fx_word_t) - 1));
+		if(end > len) { end = len; }
+		while(i < end && escape_byte(dst, dstLen, &o, src[i], &sum)) { i++; }
+		if(i < end) { break; }
+	}
+
+	#endif	//SIMD
+
+	//No bound checks when even an all-escaped remainder fits
+	if(o + 2 * (len - i) <= dstLen)
+	{
+		for(; i < len; i++)
+		{
+			if(NEEDS_ESCAPE(src[i]))
+			{
+				dst[o++] = ESCAPE;
+				sum += ESCAPE;
+			}
+			dst[o++] = src[i];
+			sum += src[i];
+		}
+	}
+
+	for(; i < len; i++)
+	{
+		if(!escape_byte(dst, dstLen, &o, src[i], &sum)) { break; }
+	}
+
+	*srcLen = i;
+	*checksum = (uint8_t)sum;
+	return o;
+}
+
+uint32_t fx_unescape(uint8_t *dst, const uint8_t *src, uint32_t len, uint8_t *escaped)
+{
+	uint32_t i = 0, o = 0;
+	uint8_t esc = *escaped;
+
+	//Clean blocks are stored as is, blocks with one ESCAPE are compacted in a
+	//register. Stores never pass the bytes already loaded, so it works in
+	//place. Blocks with 2+ ESCAPEs go byte by byte.
+	#if defined(FX_SIMD_AVX2) || defined(FX_SIMD_SSE2)
+
+	const __m128i escape16 = _mm_set1_epi8((char)ESCAPE);
+	const __m128i lane16 = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	while(i + 16 <= len)
+	{
+		if(esc)
+		{
+			dst[o++] = src[i++];
+			esc = 0;
+			continue;
+		}
+
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, escape16));
+
+		if(!mask)
+		{
+			_mm_storeu_si128((__m128i *)(dst + o), v);
+			i += 16;
+			o += 16;
+		}
+		else if(mask & (mask - 1))
+		{
+			uint32_t end = i + 16;
+			for(; i < end; i++) { UNESCAPE_BYTE(dst, o, src[i], esc); }
+		}
+		else
+		{
+			//Drop the ESCAPE lane: the lanes above it move down by one. The
+			//escaped byte is the next lane, or the next block's first byte.
+			uint32_t run = fx_ctz(mask);
+			__m128i low = _mm_cmpgt_epi8(_mm_set1_epi8((char)run), lane16);
+			v = _mm_or_si128(_mm_and_si128(low, v), _mm_andnot_si128(low, _mm_srli_si128(v, 1)));
+			_mm_storeu_si128((__m128i *)(dst + o), v);
+			o += 15;
+			i += 16;
+			esc = (run == 15);
+		}
+	}
+
+	#else
+
+	while(i < len)
+	{
+		if(!esc && !((uintptr_t)(src + i) & (sizeof(fx_word_t) - 1)))
+		{
+			const fx_word_t pattern = SWAR_ONES * ESCAPE;
+			uint32_t start = i;
+			while(i + sizeof(fx_word_t) <= len)
+			{
+				fx_word_t w = *(const fx_word_t *)(src + i);
+				if(SWAR_HAS_ZERO(w ^ pattern)) { break; }
+				memcpy(dst + o + (i - start), &w, sizeof(fx_word_t));
+				i += sizeof(fx_word_t);
+			}
+
+			if(i != start)
+			{
+				o += i - start;
+				continue;
+			}
+		}
+
+		//Byte by byte up to the next word boundary (through an ESCAPE word)
+		uint32_t end = i + sizeof(fx_word_t) - ((uintptr_t)(src + i) & (sizeof(fx_word_t) - 1));
+		if(end > len) { end = len; }
+		for(; i < end; i++) { UNESCAPE_BYTE(dst, o, src[i], esc); }
+	}
+
+	#endif	//SIMD
+
+	for(; i < len; i++)
+	{
+		UNESCAPE_BYTE(dst, o, src[i], esc);
+	}
+
+	*escaped = esc;
+	return o;
+}
+
+//****************************************************************************
+// Private Function(s):
+//****************************************************************************
+
+//Index of the lowest set bit of mask (not 0), for the SIMD compare masks
+static inline uint32_t fx_ctz(uint32_t mask)
+{
+	#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (uint32_t)index;
+	#else
+	return (uint32_t)__builtin_ctz(mask);
+	#endif
+}
+
+//Writes c (escaped if needed) at dst[*o]. Returns 0 if it doesn't fit.
+static inline int escape_byte(uint8_t *dst, uint32_t dstLen, uint32_t *o, \
+								uint8_t c, uint32_t *sum)
+{
+	if(NEEDS_ESCAPE(c))
+	{
+		if(*o + 2 > dstLen) { return 0; }
+		dst[(*o)++] = ESCAPE;
+		*sum += ESCAPE;
+	}
+	else if(*o + 1 > dstLen)
+	{
+		return 0;
+	}
+
+	dst[(*o)++] = c;
+	*sum += c;
+	return 1;
+}
+
+#if defined(FX_SIMD_AVX2) || defined(FX_SIMD_SSE2)
+
+//Adds the two 64-bit psadbw sums
+static inline uint32_t sad_fold(__m128i acc)
+{
+	return (uint32_t)_mm_cvtsi128_si32(acc) + \
+			(uint32_t)_mm_cvtsi128_si32(_mm_unpackhi_epi64(acc, acc));
+}
+
+#else
+
+//Adds the 16-bit lanes (even and odd bytes) with a multiply: top lane = sum.
+//Only the low byte of each lane matters for an 8-bit checksum.
+static inline uint32_t swar_fold(fx_word_t even, fx_word_t odd)
+{
+	fx_word_t lanes = (even & SWAR_EVEN_BYTES) + (odd & SWAR_EVEN_BYTES);
+	return (uint32_t)((lanes * ((fx_word_t)-1 / 0xFFFF)) >> (8 * sizeof(fx_word_t) - 16));
+}
+
+#endif	//SIMD
+
+
+static int32_t find_byte_scalar(const uint8_t *p, uint32_t start, uint32_t len, \
+								uint8_t value)
+{
+	uint32_t i;
+	for(i = start; i < len; i++)
+	{
+		if(p[i] == value) { return (int32_t)i; }
+	}
+	return -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,512 @@
+/****************************************************************************
+	[Project] FlexSEA: Flexible & Scalable Electronics Architecture
+	[Sub-project] 'flexsea-comm' Communication stack
+	Copyright (C) 2016 Dephy, Inc. <http://dephy.com/>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************
+	[Lead developper] Jean-Francois (JF) Duval, jfduval at dephy dot com.
+	[Origin] Based on Jean-Francois Duval's work at the MIT Media Lab
+	Biomechatronics research group <http://biomech.media.mit.edu/>
+	[Contributors]
+*****************************************************************************
+	[This file] flexsea_transport: byte transports bound to the multi ports
+*****************************************************************************
+	[Change log] (Convention: YYYY-MM-DD | author | comment)
+	* 2026-10-17 | agent | Initial release
+	*
+****************************************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//****************************************************************************
+// Include(s)
+//****************************************************************************
+
+#include <string.h>
+#include "flexsea_transport.h"
+#include "flexsea_multi_frame_packet_def.h"
+#include "flexsea_log.h"
+
+#ifdef FX_TRANSPORT_FD
+	#include <errno.h>
+	#include <poll.h>
+	#include <stdint.h>
+	#include <sys/uio.h>
+	#include <unistd.h>
+#endif
+
+#ifndef BOARD_TYPE_FLEXSEA_PLAN
+
+	#include "user-mn.h"
+
+	#if(defined BOARD_TYPE_FLEXSEA_EXECUTE || defined BOARD_TYPE_FLEXSEA_PROTOTYPE)
+
+		#include "usb.h"
+
+	#else
+
+		//Manage or Mn:
+		#if (HW_VER < 10)
+			#include "uarts.h"
+		#else
+			#include "usart.h"
+		#endif // HW_VER < 10)
+
+		#ifdef USE_USB
+		#include "usbd_cdc_if.h"
+		#endif
+
+	#endif
+
+#endif // BOARD_TYPE_FLEXSEA_PLAN
+
+//Manage without the coalescer: the frames of a burst are gathered and sent
+//in one USB transfer, up to a whole multi packet
+#define FX_USB_GATHER_LEN			(MAX_FRAMES_PER_MULTI_PACKET * PACKET_WRAPPER_LEN)
+
+//****************************************************************************
+// Private Function Prototype(s):
+//****************************************************************************
+
+#ifdef BOARD_TYPE_FLEXSEA_MANAGE
+static uint8_t fxSendUsb(void *ctx, const uint8_t *data, uint16_t len);
+static uint8_t fxReadyUsb(void *ctx);
+#ifndef FX_USB_COALESCE
+static uint8_t fxSendUsbVectored(void *ctx, const FxIoVec *iov, uint8_t count);
+#endif
+#if !(defined BOARD_SUBTYPE_HABSOLUTE || defined BOARD_SUBTYPE_BMS)
+static uint8_t fxSendWireless(void *ctx, const uint8_t *data, uint16_t len);
+static uint8_t fxSendBwc(void *ctx, const uint8_t *data, uint16_t len);
+#endif
+#endif	//BOARD_TYPE_FLEXSEA_MANAGE
+
+#if(defined BOARD_TYPE_FLEXSEA_EXECUTE || defined BOARD_TYPE_FLEXSEA_PROTOTYPE)
+static uint8_t fxSendUsb(void *ctx, const uint8_t *data, uint16_t len);
+#endif
+
+static uint8_t fxCoalescerSend(void *ctx, const uint8_t *data, uint16_t len);
+static uint8_t fxCoalescerSendVectored(void *ctx, const FxIoVec *iov, uint8_t count);
+static uint8_t fxCoalescerSendBuffered(FxCoalescer *c, uint8_t aligned);
+
+#ifdef FX_TRANSPORT_FD
+static uint8_t fxFdSend(void *ctx, const uint8_t *data, uint16_t len);
+static uint8_t fxFdSendVectored(void *ctx, const FxIoVec *iov, uint8_t count);
+static uint8_t fxFdReady(void *ctx);
+static uint8_t fxFdWriteAll(int fd, const uint8_t *data, uint16_t len, uint8_t started);
+#endif
+
+//****************************************************************************
+// Variable(s)
+//****************************************************************************
+
+#if defined BOARD_TYPE_FLEXSEA_MANAGE
+
+#ifdef FX_USB_COALESCE
+FxCoalescer fxUsbCoalescer = {
+	.lower = {fxSendUsb, NULL, fxReadyUsb, 0, NULL},
+	.threshold = FX_USB_COALESCE_THRESHOLD,
+	.deadlineUs = FX_USB_COALESCE_DEADLINE_US
+};
+#endif
+
+FxTransport fxTransport[NUMBER_OF_PORTS] = {
+	#ifdef FX_USB_COALESCE
+	[PORT_USB] = {fxCoalescerSend, fxCoalescerSendVectored, NULL, 0, &fxUsbCoalescer},
+	#else
+	[PORT_USB] = {fxSendUsb, fxSendUsbVectored, fxReadyUsb, FX_USB_GATHER_LEN, NULL},
+	#endif
+	#if !(defined BOARD_SUBTYPE_HABSOLUTE || defined BOARD_SUBTYPE_BMS)
+	[PORT_WIRELESS] = {fxSendWireless, NULL, NULL, 0, NULL},
+	[PORT_BWC] = {fxSendBwc, NULL, NULL, 0, NULL},
+	#endif
+};
+
+#elif(defined BOARD_TYPE_FLEXSEA_EXECUTE || defined BOARD_TYPE_FLEXSEA_PROTOTYPE)
+
+FxTransport fxTransport[NUMBER_OF_PORTS] = {
+	[PORT_USB] = {fxSendUsb, NULL, NULL, 0, NULL},
+};
+
+#else
+
+FxTransport fxTransport[NUMBER_OF_PORTS];
+
+#endif
+
+//****************************************************************************
+// Public Function(s)
+//****************************************************************************
+
+//Binds a transport to a port (copied). NULL unbinds it.
+void fxTransportBind(Port p, const FxTransport *t)
+{
+	if(p >= NUMBER_OF_PORTS) { return; }
+
+	if(t) { fxTransport[p] = *t; }
+	else { memset(&fxTransport[p], 0, sizeof(FxTransport)); }
+}
+
+uint8_t fxTransportReady(const FxTransport *t)
+{
+	if(!t || !t->send) { return FX_TRANSPORT_UNBOUND_SENT; }
+	return t->ready ? t->ready(t->ctx) : 1;
+}
+
+//One transfer. Returns 0 if it was sent.
+uint8_t fxTransportSend(const FxTransport *t, const uint8_t *data, uint16_t len)
+{
+	if(!t || !t->send) { return !FX_TRANSPORT_UNBOUND_SENT; }
+
+	if(t->maxChunk && len > t->maxChunk)
+	{
+		FX_LOG(lerror, "Transfer too long for the port (%u > %u)", len, t->maxChunk);
+		return 1;
+	}
+
+	if(t->ready && !t->ready(t->ctx)) { return 1; }
+	return t->send(t->ctx, data, len) ? 1 : 0;
+}
+
+//Sends the buffers in order, in one transfer if the transport can (up to
+//maxChunk bytes), else one by one while it's ready. A buffer is never split.
+//Returns the number of buffers sent.
+uint8_t fxTransportSendVectored(const FxTransport *t, const FxIoVec *iov, uint8_t count)
+{
+	uint32_t total = 0;
+	uint8_t n = 0;
+
+	if(!t || !t->send) { return FX_TRANSPORT_UNBOUND_SENT ? count : 0; }
+	if(!count) { return 0; }
+
+	if(t->sendVectored)
+	{
+		//What fits in one transfer:
+		while(n < count && (!t->maxChunk || total + iov[n].len <= t->maxChunk))
+		{
+			total += iov[n++].len;
+		}
+
+		if(!n) { return fxTransportSend(t, iov[0].data, iov[0].len) ? 0 : 1; }
+		if(t->ready && !t->ready(t->ctx)) { return 0; }
+		return t->sendVectored(t->ctx, iov, n);
+	}
+
+	while(n < count && !fxTransportSend(t, iov[n].data, iov[n].len)) { n++; }
+	return n;
+}
+
+//Coalescer in front of 'lower'. threshold is rounded down to whole USB packets.
+void fxCoalescerInit(FxCoalescer *c, const FxTransport *lower, uint16_t threshold, \
+						uint32_t deadlineUs)
+{
+	memset(c, 0, sizeof(FxCoalescer));
+	if(lower) { c->lower = *lower; }
+
+	if(threshold > FX_COALESCE_BUF_LEN) { threshold = FX_COALESCE_BUF_LEN; }
+	threshold -= threshold % FX_USB_PACKET_SIZE;
+	c->threshold = threshold ? threshold : FX_USB_PACKET_SIZE;
+	c->deadlineUs = deadlineUs;
+}
+
+//Transport feeding the coalescer, to bind to a port
+void fxCoalescerTransport(FxCoalescer *c, FxTransport *t)
+{
+	t->send = fxCoalescerSend;
+	t->sendVectored = fxCoalescerSendVectored;
+	t->ready = NULL;
+	t->maxChunk = 0;
+	t->ctx = c;
+}
+
+//Call from the main loop. Sends everything waiting once the oldest byte
+//reached the deadline (0: at every call). Returns 1 if bytes are overdue but
+//the lower transport is busy.
+uint8_t fxCoalescerPoll(FxCoalescer *c, uint32_t nowUs)
+{
+	c->now = nowUs;
+	if(c->len && (uint32_t)(nowUs - c->oldest) >= c->deadlineUs)
+	{
+		return fxCoalescerFlush(c);
+	}
+
+	return 0;
+}
+
+//Sends everything waiting, now. Returns 1 if the lower transport was busy.
+uint8_t fxCoalescerFlush(FxCoalescer *c)
+{
+	return fxCoalescerSendBuffered(c, 0);
+}
+
+#ifdef FX_TRANSPORT_FD
+
+//Transport writing to a file descriptor: serial port, pty, socket, pipe.
+//Non-blocking descriptors report 'not ready' when full, but a transfer that
+//started is always completed (no partial frames).
+void fxTransportFd(FxTransport *t, int fd)
+{
+	t->send = fxFdSend;
+	t->sendVectored = fxFdSendVectored;
+	t->ready = fxFdReady;
+	t->maxChunk = 0;
+	t->ctx = (void *)(intptr_t)fd;
+}
+
+#endif	//FX_TRANSPORT_FD
+
+//****************************************************************************
+// Private Function(s)
+//****************************************************************************
+
+#ifdef BOARD_TYPE_FLEXSEA_MANAGE
+
+static uint8_t fxSendUsb(void *ctx, const uint8_t *data, uint16_t len)
+{
+	(void)ctx;
+
+	#ifdef BOARD_SUBTYPE_BMS
+	//Traffic to the GUI goes through the debug UART on the BMS
+	usart_transmit(DEBUG_USART, (uint8_t *)data, len);
+	return 0;
+	#else
+	return (USBD_OK != CDC_Transmit_FS((uint8_t *)data, len));
+	#endif
+}
+
+static uint8_t fxReadyUsb(void *ctx)
+{
+	(void)ctx;
+
+	#ifdef BOARD_SUBTYPE_BMS
+	return 1;
+	#else
+	return !CDC_CheckBusy_FS();
+	#endif
+}
+
+#ifndef FX_USB_COALESCE
+
+//The buffers are copied back to back and sent at once. fxTransportSendVectored()
+//keeps them within maxChunk (FX_USB_GATHER_LEN) and only calls us when the
+//previous transfer is done (fxReadyUsb()), so a single buffer is enough.
+static uint8_t fxSendUsbVectored(void *ctx, const FxIoVec *iov, uint8_t count)
+{
+	static uint8_t gather[FX_USB_GATHER_LEN];
+	uint16_t len = 0;
+	uint8_t n;
+
+	for(n = 0; n < count; n++)
+	{
+		if(len + iov[n].len > FX_USB_GATHER_LEN) { break; }
+		memcpy(gather + len, iov[n].data, iov[n].len);
+		len += iov[n].len;
+	}
+
+	if(!n || fxSendUsb(ctx, gather, len)) { return 0; }
+	return n;
+}
+
+#endif	//FX_USB_COALESCE
+
+#if !(defined BOARD_SUBTYPE_HABSOLUTE || defined BOARD_SUBTYPE_BMS)
+
+static uint8_t fxSendWireless(void *ctx, const uint8_t *data, uint16_t len)
+{
+	(void)ctx;
+
+	#if (HW_VER < 20)
+		//ToDo replace with mapping function:
+		#ifdef USE_UART3
+		puts_expUart((uint8_t *)data, len);
+		#endif
+
+		#ifdef USE_UART4
+		puts_expUart2((uint8_t *)data, len);
+		#endif
+	#else
+		puts_expUart2((uint8_t *)data, len);
+	#endif // (HW_VER < 20)
+
+	UNUSED(data);
+	UNUSED(len);
+	return 0;
+}
+
+//Bilateral data does not use this on Rigid 3.0
+static uint8_t fxSendBwc(void *ctx, const uint8_t *data, uint16_t len)
+{
+	(void)ctx;
+
+	#if (HW_VER < 20) && defined(USE_XB24C)
+	puts_uart_xb24c((uint8_t *)data, len);
+	#endif
+
+	UNUSED(data);
+	UNUSED(len);
+	return 0;
+}
+
+#endif
+
+#endif	//BOARD_TYPE_FLEXSEA_MANAGE
+
+#if(defined BOARD_TYPE_FLEXSEA_EXECUTE || defined BOARD_TYPE_FLEXSEA_PROTOTYPE)
+
+static uint8_t fxSendUsb(void *ctx, const uint8_t *data, uint16_t len)
+{
+	(void)ctx;
+	return !usb_puts((uint8_t *)data, len);
+}
+
+#endif	//BOARD_TYPE_FLEXSEA_EXECUTE
+
+//Copies the frame, and sends the whole packets waiting past the threshold.
+//Busy (1) if there's no room left and the lower transport can't make some.
+static uint8_t fxCoalescerSend(void *ctx, const uint8_t *data, uint16_t len)
+{
+	FxCoalescer *c = (FxCoalescer *)ctx;
+
+	if(len > FX_COALESCE_BUF_LEN)
+	{
+		FX_LOG(lerror, "Frame too long for the coalescer (%u)", len);
+		return 1;
+	}
+
+	if(len > FX_COALESCE_BUF_LEN - c->len)
+	{
+		fxCoalescerSendBuffered(c, 1);
+		if(len > FX_COALESCE_BUF_LEN - c->len) { return 1; }
+	}
+
+	if(!c->len) { c->oldest = c->now; }
+	memcpy(c->buf[c->fill] + c->len, data, len);
+	c->len += len;
+
+	if(c->len >= c->threshold) { fxCoalescerSendBuffered(c, 1); }
+	return 0;
+}
+
+static uint8_t fxCoalescerSendVectored(void *ctx, const FxIoVec *iov, uint8_t count)
+{
+	uint8_t i;
+
+	for(i = 0; i < count; i++)
+	{
+		if(fxCoalescerSend(ctx, iov[i].data, iov[i].len)) { break; }
+	}
+
+	return i;
+}
+
+//Hands the fill buffer to the lower transport (whole USB packets only if
+//aligned = 1) and carries the rest over to the other buffer, which is free:
+//the previous transfer is done, or the lower transport wouldn't be ready.
+static uint8_t fxCoalescerSendBuffered(FxCoalescer *c, uint8_t aligned)
+{
+	uint16_t n = c->len;
+
+	if(aligned) { n -= n % FX_USB_PACKET_SIZE; }
+	if(!n) { return 0; }
+
+	if(fxTransportSend(&c->lower, c->buf[c->fill], n)) { return 1; }
+
+	c->len -= n;
+	memcpy(c->buf[c->fill ^ 1], c->buf[c->fill] + n, c->len);
+	c->fill ^= 1;
+	c->transfers++;
+	c->bytes += n;
+	return 0;
+}
+
+#ifdef FX_TRANSPORT_FD
+
+static uint8_t fxFdSend(void *ctx, const uint8_t *data, uint16_t len)
+{
+	return fxFdWriteAll((int)(intptr_t)ctx, data, len, 0);
+}
+
+static uint8_t fxFdSendVectored(void *ctx, const FxIoVec *iov, uint8_t count)
+{
+	int fd = (int)(intptr_t)ctx;
+	struct iovec v[256];
+	ssize_t n;
+	uint8_t i;
+
+	for(i = 0; i < count; i++)
+	{
+		v[i].iov_base = (void *)iov[i].data;
+		v[i].iov_len = iov[i].len;
+	}
+
+	do { n = writev(fd, v, count); } while(n < 0 && errno == EINTR);
+	if(n < 0) { return 0; }
+
+	//Complete the buffer cut short, if any:
+	for(i = 0; i < count && (size_t)n >= iov[i].len; i++) { n -= iov[i].len; }
+	if(i < count && n > 0)
+	{
+		if(fxFdWriteAll(fd, iov[i].data + n, iov[i].len - n, 1)) { return i; }
+		i++;
+	}
+
+	return i;
+}
+
+static uint8_t fxFdReady(void *ctx)
+{
+	struct pollfd p;
+
+	p.fd = (int)(intptr_t)ctx;
+	p.events = POLLOUT;
+	p.revents = 0;
+	return (poll(&p, 1, 0) == 1 && (p.revents & POLLOUT));
+}
+
+//Writes everything. Returns 1 on error, or if the descriptor is full and
+//nothing was written yet (started = 0).
+static uint8_t fxFdWriteAll(int fd, const uint8_t *data, uint16_t len, uint8_t started)
+{
+	struct pollfd p;
+	ssize_t n;
+
+	while(len)
+	{
+		n = write(fd, data, len);
+		if(n < 0)
+		{
+			if(errno == EINTR) { continue; }
+			if((errno != EAGAIN && errno != EWOULDBLOCK) || !started) { return 1; }
+
+			p.fd = fd;
+			p.events = POLLOUT;
+			poll(&p, 1, -1);
+			continue;
+		}
+
+		data += n;
+		len -= n;
+		started = 1;
+	}
+
+	return 0;
+}
+
+#endif	//FX_TRANSPORT_FD
+
+#ifdef __cplusplus
+}
+#endif
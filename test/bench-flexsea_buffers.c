@@ -0,0 +1,391 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <flexsea_buffers.h>
+#include <flexsea_simd.h>
+#include "flexsea-comm_bench-all.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define BENCH_ITERATIONS		20000
+
+static uint8_t cbStorage[CB_BUF_LEN];
+
+//****************************************************************************
+// Reference implementation(s):
+//****************************************************************************
+
+//Byte-at-a-time search, as circ_buff_search() used to do it
+static int32_t search_scalar(circularBuffer_t* cb, uint8_t value, uint16_t start)
+{
+	int size = circ_buff_get_size(cb);
+	if(start >= size) return -1;
+	int i = start;
+	int index = circ_buff_index_of(cb, 0) + start;
+
+	while(i < size && index < CB_BUF_LEN)
+	{
+		if(cb->bytes[index] == value) return i;
+		i++;
+		index++;
+	}
+
+	index %= CB_BUF_LEN;
+
+	while(i < size)
+	{
+		if(cb->bytes[index] == value) return i;
+		i++;
+		index++;
+	}
+
+	return -1;
+}
+
+//Layout and byte access of the original buffer (size field, modulo on every
+//access). Kept out of line, like the library call it is compared with.
+typedef struct {
+	uint8_t bytes[CB_BUF_LEN];
+	int head;
+	int size;
+} legacyBuffer_t;
+
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+static uint8_t peak_modulo(legacyBuffer_t* lb, uint16_t offset)
+{
+	if(offset >= lb->size) return 0;
+	return lb->bytes[((lb->head + offset) % CB_BUF_LEN)];
+}
+
+//Byte-at-a-time checksum, as the framing code used to do it
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+static uint8_t checksum_scalar(const uint8_t *p, uint32_t len)
+{
+	uint8_t checksum = 0;
+	uint32_t i;
+	for(i = 0; i < len; i++) { checksum += p[i]; }
+	return checksum;
+}
+
+//Byte-at-a-time escaping and checksum, as comm_gen_str() used to do it
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+static uint32_t escape_scalar(uint8_t *dst, const uint8_t *src, uint32_t len, uint8_t *checksum)
+{
+	uint32_t i, o = 0;
+	uint8_t sum = 0;
+	for(i = 0; i < len; i++)
+	{
+		if((src[i] == HEADER) || (src[i] == FOOTER) || (src[i] == ESCAPE))
+		{
+			dst[o++] = ESCAPE;
+			sum += ESCAPE;
+		}
+		dst[o++] = src[i];
+		sum += src[i];
+	}
+	*checksum = sum;
+	return o;
+}
+
+//Unescape loop of unpack_payload_cb() / copyEscapedString()
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+static uint32_t unescape_scalar(uint8_t *dst, const uint8_t *src, uint32_t len)
+{
+	uint32_t k, o = 0;
+	int skip = 0;
+	for(k = 0; k < len; k++)
+	{
+		if(src[k] == ESCAPE && skip == 0)
+		{
+			skip = 1;
+		}
+		else
+		{
+			skip = 0;
+			dst[o++] = src[k];
+		}
+	}
+	return o;
+}
+
+//****************************************************************************
+// Benchmark(s):
+//****************************************************************************
+
+//Worst case for the header hunt: a full buffer without any HEADER byte, and
+//the data wraps around the end of the array.
+static void bench_circ_buff_search(void)
+{
+	static circularBuffer_t cb;
+	uint8_t noise[CB_BUF_LEN];
+	int i;
+	double t0;
+
+	srand(1);
+	for(i = 0; i < CB_BUF_LEN; i++)
+	{
+		do { noise[i] = rand(); } while(noise[i] == HEADER);
+	}
+
+	circ_buff_attach(&cb, cbStorage, CB_BUF_LEN);
+	circ_buff_write(&cb, noise, CB_BUF_LEN / 3);
+	circ_buff_move_head(&cb, CB_BUF_LEN / 3);
+	circ_buff_write(&cb, noise, CB_BUF_LEN);
+
+	t0 = bench_now_ns();
+	for(i = 0; i < BENCH_ITERATIONS; i++)
+	{
+		bench_sink += search_scalar(&cb, HEADER, 0);
+	}
+	bench_report("circ_buff_search scalar (900B, no match)", \
+				(bench_now_ns() - t0) / BENCH_ITERATIONS, CB_BUF_LEN);
+
+	t0 = bench_now_ns();
+	for(i = 0; i < BENCH_ITERATIONS; i++)
+	{
+		bench_sink += circ_buff_search(&cb, HEADER, 0);
+	}
+	bench_report("circ_buff_search (900B, no match)", \
+				(bench_now_ns() - t0) / BENCH_ITERATIONS, CB_BUF_LEN);
+}
+
+//Per-byte cost of random access into a full, wrapped buffer. Build with
+//CB_BUF_LEN_LOG2 defined to measure the power-of-two (mask) configuration.
+static void bench_circ_buff_peak(void)
+{
+	static circularBuffer_t cb;
+	static legacyBuffer_t lb;
+	static uint8_t data[CB_BUF_LEN];
+	int i, j;
+	uint32_t sum = 0;
+	double t0;
+
+	circ_buff_attach(&cb, cbStorage, CB_BUF_LEN);
+	circ_buff_write(&cb, data, CB_BUF_LEN / 3);
+	circ_buff_move_head(&cb, CB_BUF_LEN / 3);
+	circ_buff_write(&cb, data, CB_BUF_LEN);
+	memcpy(lb.bytes, cb.bytes, CB_BUF_LEN);
+	lb.head = circ_buff_index_of(&cb, 0);
+	lb.size = CB_BUF_LEN;
+
+	t0 = bench_now_ns();
+	for(i = 0; i < BENCH_ITERATIONS / 10; i++)
+	{
+		for(j = 0; j < CB_BUF_LEN; j++) { sum += peak_modulo(&lb, j); }
+	}
+	bench_report("peak per byte, modulo", \
+				(bench_now_ns() - t0) / ((double)BENCH_ITERATIONS / 10 * CB_BUF_LEN), 1);
+
+	t0 = bench_now_ns();
+	for(i = 0; i < BENCH_ITERATIONS / 10; i++)
+	{
+		for(j = 0; j < CB_BUF_LEN; j++) { sum += circ_buff_peak(&cb, j); }
+	}
+	#ifdef CB_BUF_LEN_LOG2
+	bench_report("peak per byte, power-of-two mask", \
+				(bench_now_ns() - t0) / ((double)BENCH_ITERATIONS / 10 * CB_BUF_LEN), 1);
+	#else
+	bench_report("peak per byte, two-lap positions", \
+				(bench_now_ns() - t0) / ((double)BENCH_ITERATIONS / 10 * CB_BUF_LEN), 1);
+	#endif
+
+	bench_sink += sum;
+}
+
+//Typical frame payload lengths, up to a full multi frame
+static void bench_checksum8(void)
+{
+	static const uint32_t lens[] = {4, 8, 12, 16, 32, 48, 64, 100, 150};
+	static uint8_t data[160];
+	char name[48];
+	unsigned k;
+	int i;
+	double t0;
+
+	srand(2);
+	for(i = 0; i < (int)sizeof(data); i++) { data[i] = rand(); }
+
+	for(k = 0; k < sizeof(lens) / sizeof(lens[0]); k++)
+	{
+		t0 = bench_now_ns();
+		for(i = 0; i < BENCH_ITERATIONS * 10; i++)
+		{
+			bench_sink += checksum_scalar(data + (i & 7), lens[k]);
+		}
+		sprintf(name, "checksum scalar (%uB)", (unsigned)lens[k]);
+		bench_report(name, (bench_now_ns() - t0) / (BENCH_ITERATIONS * 10), lens[k]);
+
+		t0 = bench_now_ns();
+		for(i = 0; i < BENCH_ITERATIONS * 10; i++)
+		{
+			bench_sink += fx_checksum8(data + (i & 7), lens[k]);
+		}
+		sprintf(name, "fx_checksum8 (%uB)", (unsigned)lens[k]);
+		bench_report(name, (bench_now_ns() - t0) / (BENCH_ITERATIONS * 10), lens[k]);
+	}
+}
+
+//Telemetry sized payloads: escape free, random (~1% special bytes) and
+//escape heavy (1 in 8)
+static void bench_escape(void)
+{
+	static const uint32_t lens[] = {40, 150};
+	static const char *kinds[] = {"clean", "random", "1/8 esc"};
+	static uint8_t data[160], out[320];
+	char name[48];
+	unsigned k, kind;
+	int i;
+	uint8_t chk;
+	double t0;
+
+	srand(3);
+	for(kind = 0; kind < 3; kind++)
+	{
+		for(i = 0; i < (int)sizeof(data); i++)
+		{
+			do { data[i] = rand(); } while(kind == 0 && \
+					(data[i] == HEADER || data[i] == FOOTER || data[i] == ESCAPE));
+			if(kind == 2 && !(rand() & 7)) { data[i] = HEADER; }
+		}
+
+		for(k = 0; k < sizeof(lens) / sizeof(lens[0]); k++)
+		{
+			t0 = bench_now_ns();
+			for(i = 0; i < BENCH_ITERATIONS * 10; i++)
+			{
+				bench_sink += escape_scalar(out, data + (i & 7), lens[k], &chk) + chk;
+			}
+			sprintf(name, "escape scalar (%uB, %s)", (unsigned)lens[k], kinds[kind]);
+			bench_report(name, (bench_now_ns() - t0) / (BENCH_ITERATIONS * 10), lens[k]);
+
+			t0 = bench_now_ns();
+			for(i = 0; i < BENCH_ITERATIONS * 10; i++)
+			{
+				uint32_t n = lens[k];
+				bench_sink += fx_escape(out, sizeof(out), data + (i & 7), &n, &chk) + chk;
+			}
+			sprintf(name, "fx_escape (%uB, %s)", (unsigned)lens[k], kinds[kind]);
+			bench_report(name, (bench_now_ns() - t0) / (BENCH_ITERATIONS * 10), lens[k]);
+		}
+	}
+}
+
+//Same payloads as bench_escape(), escaped, then decoded
+static void bench_unescape(void)
+{
+	static const uint32_t lens[] = {40, 150};
+	static const char *kinds[] = {"clean", "random", "1/8 esc"};
+	static uint8_t data[160], packed[400], out[400];
+	char name[48];
+	unsigned k, kind;
+	int i;
+	uint8_t chk, esc;
+	double t0;
+
+	srand(3);
+	for(kind = 0; kind < 3; kind++)
+	{
+		for(i = 0; i < (int)sizeof(data); i++)
+		{
+			do { data[i] = rand(); } while(kind == 0 && \
+					(data[i] == HEADER || data[i] == FOOTER || data[i] == ESCAPE));
+			if(kind == 2 && !(rand() & 7)) { data[i] = HEADER; }
+		}
+
+		for(k = 0; k < sizeof(lens) / sizeof(lens[0]); k++)
+		{
+			uint32_t n = lens[k];
+			uint32_t packedLen = fx_escape(packed, sizeof(packed), data, &n, &chk);
+
+			t0 = bench_now_ns();
+			for(i = 0; i < BENCH_ITERATIONS * 10; i++)
+			{
+				bench_sink += unescape_scalar(out, packed, packedLen) + out[i & 0x1F];
+			}
+			sprintf(name, "unescape scalar (%uB, %s)", (unsigned)lens[k], kinds[kind]);
+			bench_report(name, (bench_now_ns() - t0) / (BENCH_ITERATIONS * 10), packedLen);
+
+			t0 = bench_now_ns();
+			for(i = 0; i < BENCH_ITERATIONS * 10; i++)
+			{
+				esc = 0;
+				bench_sink += fx_unescape(out, packed, packedLen, &esc) + out[i & 0x1F];
+			}
+			sprintf(name, "fx_unescape (%uB, %s)", (unsigned)lens[k], kinds[kind]);
+			bench_report(name, (bench_now_ns() - t0) / (BENCH_ITERATIONS * 10), packedLen);
+		}
+	}
+}
+
+#ifdef CIRC_BUFF_MIRROR
+//Frame (read + checksum) that straddles the end of the array: split copies
+//vs a single span in the mirrored mapping
+static void bench_wrapped_frame(circularBuffer_t *cb, const char *name)
+{
+	static uint8_t data[COMM_PERIPH_ARR_LEN], out[COMM_PERIPH_ARR_LEN];
+	int i, cap = circ_buff_get_capacity(cb);
+	uint32_t sum = 0;
+	double t0;
+
+	//Frame starts 60 bytes before the end:
+	while(circ_buff_index_of(cb, 0) != cap - 60)
+	{
+		int n = cap - 60 - circ_buff_index_of(cb, 0);
+		if(n <= 0 || n > COMM_PERIPH_ARR_LEN) n = COMM_PERIPH_ARR_LEN;
+		circ_buff_write(cb, data, n);
+		circ_buff_move_head(cb, n);
+	}
+	circ_buff_write(cb, data, COMM_PERIPH_ARR_LEN);
+
+	t0 = bench_now_ns();
+	for(i = 0; i < BENCH_ITERATIONS * 10; i++)
+	{
+		circ_buff_read_section(cb, out, 0, COMM_PERIPH_ARR_LEN);
+		sum += circ_buff_checksum(cb, 2, COMM_PERIPH_ARR_LEN - 2) + out[i & 0x3F];
+	}
+	bench_report(name, (bench_now_ns() - t0) / (BENCH_ITERATIONS * 10), \
+				2 * COMM_PERIPH_ARR_LEN);
+	bench_sink += sum;
+}
+
+static void bench_circ_buff_mirrored(void)
+{
+	static circularBuffer_t cb;
+	static uint8_t storage[4096];
+
+	circ_buff_attach(&cb, storage, sizeof(storage));
+	bench_wrapped_frame(&cb, "wrapped frame read+checksum, split");
+
+	if(circ_buff_attach_mirrored(&cb, 4096) == 0)
+	{
+		bench_wrapped_frame(&cb, "wrapped frame read+checksum, mirrored");
+		circ_buff_detach_mirrored(&cb);
+	}
+}
+#endif	//CIRC_BUFF_MIRROR
+
+void bench_flexsea_buffers(void)
+{
+	bench_circ_buff_search();
+	bench_circ_buff_peak();
+	bench_checksum8();
+	bench_escape();
+	bench_unescape();
+	#ifdef CIRC_BUFF_MIRROR
+	bench_circ_buff_mirrored();
+	#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
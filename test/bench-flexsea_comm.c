@@ -0,0 +1,446 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <flexsea.h>
+#include <flexsea_comm.h>
+#include <flexsea_comm_multi.h>
+#include <flexsea_multi_circbuff.h>
+#include <flexsea_interface.h>
+#include <flexsea_board.h>
+#include <flexsea_transport.h>
+#include "flexsea-comm_bench-all.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#ifdef FX_TRANSPORT_FD
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+//Encode, decode and dispatch paths, legacy and multi frames. Every workload
+//is generated from a fixed seed (same bytes on every run):
+//	clean: payloads without special bytes
+//	escape-heavy: 1 payload byte in 4 needs an ESCAPE
+//	noise: up to 16 random bytes between the frames
+//	burst: 16 frames per write, then a full drain (vs. 32-byte writes, or one
+//	multi packet)
+
+#define BENCH_PASSES			100
+#define BENCH_FRAMES			256			//Frames per stream
+#define BENCH_STREAM_LEN		(BENCH_FRAMES * (UNPACKED_BUFF_SIZE + 16))
+#define BENCH_CHUNK				32			//Bytes per write (UART, DMA half)
+#define BENCH_BURST				16			//Frames per write (burst)
+#define BENCH_MULTI_CB_LEN		16384		//Bursts of 400B packets
+#define BENCH_CMD				10			//Any free command code
+
+enum {WL_CLEAN, WL_ESCAPES, WL_NOISE, WL_BURST, WL_NUM};
+static const char * const workloadNames[WL_NUM] = {"clean", "escape-heavy", "noise", "burst"};
+
+//A stream of frames, as received on the wire
+typedef struct {
+	uint8_t bytes[BENCH_STREAM_LEN];
+	uint32_t len;
+	uint16_t frames;
+	uint16_t end[BENCH_FRAMES];		//End of each frame (burst writes)
+} benchStream_t;
+
+static benchStream_t stream;
+static uint8_t cbStorage[CB_BUF_LEN];
+static uint8_t multiStorage[BENCH_MULTI_CB_LEN];
+static MultiCommPeriph multiPeriph;
+static MultiWrapper multiOut;
+static uint32_t handled = 0;
+
+//****************************************************************************
+// Workload(s):
+//****************************************************************************
+
+static uint8_t is_special(uint8_t b)
+{
+	return (b == HEADER || b == FOOTER || b == ESCAPE);
+}
+
+static void gen_payload(uint8_t *p, uint16_t len, uint8_t workload)
+{
+	static const uint8_t specials[3] = {HEADER, FOOTER, ESCAPE};
+	uint16_t i;
+
+	for(i = 0; i < len; i++)
+	{
+		p[i] = rand() & 0xFF;
+		if(is_special(p[i])) { p[i] = 0x55; }
+		if(workload == WL_ESCAPES && (rand() & 3) == 0) { p[i] = specials[rand() % 3]; }
+	}
+}
+
+static void gen_noise(benchStream_t *s, uint8_t workload)
+{
+	uint16_t n;
+
+	if(workload != WL_NOISE) { return; }
+	for(n = rand() % 17; n > 0; n--) { s->bytes[s->len++] = rand() & 0xFF; }
+}
+
+//Legacy frames, 8 to 20 bytes of payload
+static void build_legacy_stream(benchStream_t *s, uint8_t workload)
+{
+	uint8_t payload[PACKAGED_PAYLOAD_LEN], cstr[COMM_STR_BUF_LEN];
+
+	srand(2000 + workload);
+	s->len = 0;
+	for(s->frames = 0; s->frames < BENCH_FRAMES; s->frames++)
+	{
+		uint8_t len = 8 + rand() % 13;
+		gen_payload(payload, len, workload);
+		comm_gen_str(payload, cstr, len);
+		gen_noise(s, workload);
+		memcpy(s->bytes + s->len, cstr, cstr[1] + 4);
+		s->len += cstr[1] + 4;
+		s->end[s->frames] = s->len;
+	}
+}
+
+//Multi packets (one per frame group) addressed to this board
+static void build_multi_stream(benchStream_t *s, uint8_t workload, uint16_t payloadLen)
+{
+	uint8_t i;
+
+	srand(3000 + workload);
+	s->len = 0;
+	for(s->frames = 0; s->frames < BENCH_FRAMES; s->frames++)
+	{
+		MultiWrapper *p = &multiOut;
+		setMsgInfo(p->unpacked, 0, getBoardID(), BENCH_CMD, RX_PTYPE_READ, 0);
+		gen_payload(p->unpacked + MP_DATA1, payloadLen, workload);
+		p->unpackedIdx = MULTI_PACKET_OVERHEAD + payloadLen;
+		p->currentMultiPacket = s->frames & 0x03;
+		packMultiPacket(p);
+
+		gen_noise(s, workload);
+		for(i = 0; i < MAX_FRAMES_PER_MULTI_PACKET && (p->frameMap & (1 << i)); i++)
+		{
+			uint16_t n = p->packed[i][1] + MULTI_NUM_OVERHEAD_BYTES_FRAME;
+			memcpy(s->bytes + s->len, p->packed[i], n);
+			s->len += n;
+		}
+		s->end[s->frames] = s->len;
+	}
+}
+
+//Next write: a fixed size chunk (framesPerWrite = 0), or a group of frames.
+//Returns its length.
+static uint16_t next_write(benchStream_t *s, uint8_t framesPerWrite, uint32_t pos, uint16_t *frame)
+{
+	uint32_t end = pos + BENCH_CHUNK;
+
+	if(framesPerWrite)
+	{
+		*frame += framesPerWrite;
+		if(*frame > s->frames) { *frame = s->frames; }
+		end = s->end[*frame - 1];
+	}
+
+	if(end > s->len) { end = s->len; }
+	return end - pos;
+}
+
+//Replaces the system's handler (flexsea-system isn't linked in)
+static void bench_multi_handler(uint8_t *msgBuf, MultiPacketInfo *info, uint8_t *responseBuf, \
+								uint16_t* responseLen)
+{
+	(void)info;
+	(void)responseBuf;
+	(void)responseLen;
+	handled += msgBuf[0];
+}
+
+//Sanity check: a decoder that misses frames looks fast
+static void bench_check(const char *name, uint32_t decoded, uint32_t expected)
+{
+	if(decoded != expected)
+	{
+		printf("%s: %lu frames decoded, %lu expected\n", name, (unsigned long)decoded, \
+				(unsigned long)expected);
+	}
+}
+
+//****************************************************************************
+// Benchmark(s):
+//****************************************************************************
+
+static void bench_comm_gen_str(uint8_t workload)
+{
+	uint8_t payload[BENCH_FRAMES][PACKAGED_PAYLOAD_LEN], len[BENCH_FRAMES];
+	uint8_t cstr[COMM_STR_BUF_LEN];
+	uint32_t bytes = 0, pass, i;
+	char name[64];
+	BenchTimer t;
+
+	srand(1000 + workload);
+	for(i = 0; i < BENCH_FRAMES; i++)
+	{
+		len[i] = 8 + rand() % 13;
+		gen_payload(payload[i], len[i], workload);
+		bytes += len[i];
+	}
+
+	bench_start(&t);
+	for(pass = 0; pass < BENCH_PASSES; pass++)
+	{
+		for(i = 0; i < BENCH_FRAMES; i++)
+		{
+			bench_sink += comm_gen_str(payload[i], cstr, len[i]);
+		}
+	}
+	snprintf(name, sizeof(name), "comm_gen_str, %s", workloadNames[workload]);
+	bench_stop(&t, name, BENCH_PASSES * BENCH_FRAMES, (double)bytes / BENCH_FRAMES);
+}
+
+//Method 0: unpack_payload_cb() (rescans from the head), 1: unpack_payload_stream(),
+//2: unpack_payload_stream_batch() + unpack_payload_frame()
+static void bench_legacy_decode(uint8_t workload, uint8_t method)
+{
+	static const char * const methods[3] = {"unpack_payload_cb", "unpack_payload_stream", \
+											"unpack_payload_stream_batch"};
+	uint8_t packed[PACKAGED_PAYLOAD_LEN], unpacked[PACKAGED_PAYLOAD_LEN];
+	CommFrame frames[COMM_RX_BATCH];
+	circularBuffer_t cb;
+	CommDecoder d;
+	uint32_t decoded = 0, pass, pos;
+	uint16_t n, frame;
+	uint8_t i, nf;
+	char name[64];
+	BenchTimer t;
+
+	build_legacy_stream(&stream, workload);
+	circ_buff_attach(&cb, cbStorage, CB_BUF_LEN);
+	memset(&d, 0, sizeof(d));
+
+	bench_start(&t);
+	for(pass = 0; pass < BENCH_PASSES; pass++)
+	{
+		circ_buff_init(&cb);
+		resetCommDecoder(&d);
+		for(pos = 0, frame = 0; pos < stream.len; pos += n)
+		{
+			n = next_write(&stream, (workload == WL_BURST) ? BENCH_BURST : 0, pos, &frame);
+			circ_buff_write(&cb, stream.bytes + pos, n);
+
+			if(method == 0)
+			{
+				uint16_t end;
+				while((end = unpack_payload_cb(&cb, packed, unpacked)))
+				{
+					circ_buff_move_head(&cb, end);
+					decoded++;
+				}
+			}
+			else if(method == 1)
+			{
+				uint16_t end;
+				while((end = unpack_payload_stream(&cb, &d, packed, unpacked)))
+				{
+					circ_buff_move_head(&cb, end);
+					decoded++;
+				}
+			}
+			else
+			{
+				//One sweep gets every complete frame: call again only if
+				//the batch was full (as tryParseRxBatch() would, next time)
+				do
+				{
+					nf = unpack_payload_stream_batch(&cb, &d, frames, COMM_RX_BATCH);
+					for(i = 0; i < nf; i++)
+					{
+						unpack_payload_frame(&cb, &frames[i], packed, unpacked);
+					}
+					if(nf) { circ_buff_move_head(&cb, COMM_FRAME_END(frames[nf - 1])); }
+					decoded += nf;
+				}while(nf == COMM_RX_BATCH);
+			}
+		}
+	}
+	snprintf(name, sizeof(name), "%s, %s", methods[method], workloadNames[workload]);
+	bench_stop(&t, name, BENCH_PASSES * BENCH_FRAMES, (double)stream.len / BENCH_FRAMES);
+
+	bench_sink += unpacked[0];
+	if(workload != WL_NOISE) { bench_check(name, decoded, BENCH_PASSES * BENCH_FRAMES); }
+}
+
+static void bench_pack_multi(uint8_t workload, uint16_t payloadLen)
+{
+	MultiWrapper *p = &multiOut;
+	uint32_t i;
+	char name[64];
+	BenchTimer t;
+
+	srand(4000 + workload);
+	memset(p, 0, sizeof(MultiWrapper));
+	setMsgInfo(p->unpacked, 0, getBoardID(), BENCH_CMD, RX_PTYPE_READ, 0);
+	gen_payload(p->unpacked + MP_DATA1, payloadLen, workload);
+	p->unpackedIdx = MULTI_PACKET_OVERHEAD + payloadLen;
+
+	bench_start(&t);
+	for(i = 0; i < BENCH_PASSES * BENCH_FRAMES; i++)
+	{
+		bench_sink += packMultiPacket(p);
+	}
+	snprintf(name, sizeof(name), "packMultiPacket %uB, %s", payloadLen, workloadNames[workload]);
+	bench_stop(&t, name, BENCH_PASSES * BENCH_FRAMES, p->unpackedIdx);
+}
+
+//Multi reception: unpack only (dispatch = 0), or the complete
+//receiveFxPacketByPeriph() path down to the command handler (dispatch = 1).
+//Packets are written whole, as USB delivers them.
+static void bench_multi_receive(uint8_t workload, uint16_t payloadLen, uint8_t dispatch)
+{
+	MultiCommPeriph *cp = &multiPeriph;
+	uint32_t decoded = 0, pass, pos;
+	uint16_t n, frame;
+	char name[80];
+	BenchTimer t;
+
+	build_multi_stream(&stream, workload, payloadLen);
+	circ_buff_attach(&cp->circularBuff, multiStorage, BENCH_MULTI_CB_LEN);
+	flexsea_multipayload_ptr[BENCH_CMD][RX_PTYPE_REPLY] = bench_multi_handler;
+	handled = 0;
+
+	bench_start(&t);
+	for(pass = 0; pass < BENCH_PASSES; pass++)
+	{
+		initMultiPeriph(cp, PORT_USB, SLAVE);
+		for(pos = 0, frame = 0; pos < stream.len; pos += n)
+		{
+			n = next_write(&stream, (workload == WL_BURST) ? BENCH_BURST : 1, pos, &frame);
+			copyIntoMultiPacket(cp, stream.bytes + pos, n);
+
+			if(dispatch)
+			{
+				decoded += receiveFxPacketByPeriph(cp);
+				continue;
+			}
+
+			//receiveFxPacketByPeriph() without the parsing
+			cp->bytesReadyFlag = 0;
+			while(unpack_multi_payload_cb_cached(&cp->circularBuff, &cp->in, &cp->parsingCachedIndex))
+			{
+				advanceMultiInput(cp, cp->parsingCachedIndex);
+				if(cp->in.isMultiComplete) { cp->in.isMultiComplete = 0; decoded++; }
+			}
+			advanceMultiInput(cp, cp->parsingCachedIndex);
+		}
+	}
+	snprintf(name, sizeof(name), "%s %uB, %s", dispatch ? "receiveFxPacketByPeriph" : \
+			"unpack_multi_payload_cb_cached", payloadLen, workloadNames[workload]);
+	bench_stop(&t, name, BENCH_PASSES * BENCH_FRAMES, (double)stream.len / BENCH_FRAMES);
+
+	flexsea_multipayload_ptr[BENCH_CMD][RX_PTYPE_REPLY] = NULL;
+	bench_sink += handled;
+	if(workload != WL_NOISE) { bench_check(name, decoded, BENCH_PASSES * BENCH_FRAMES); }
+}
+
+//Stack only: the transport takes the bytes and does nothing
+static uint8_t bench_null_send(void *ctx, const uint8_t *data, uint16_t len)
+{
+	(void)ctx;
+	bench_sink += data[len - 1];
+	return 0;
+}
+
+//transmitFxPacket() until the packet is sent (or transmitFxPacketBurst()
+//once), over a null transport or a socketpair (sockets = 1, read back as it
+//goes)
+static void bench_transmit(uint16_t payloadLen, uint8_t sockets, uint8_t burst)
+{
+	FxTransport t = {bench_null_send, NULL, NULL, 0, NULL};
+	MultiCommPeriph *cp = &comm_multi_periph[PORT_USB];
+	uint8_t rx[UNPACKED_BUFF_SIZE * 2];
+	uint32_t i;
+	char name[64];
+	BenchTimer bt;
+
+	#ifdef FX_TRANSPORT_FD
+	int sv[2] = {-1, -1};
+	if(sockets)
+	{
+		if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) { return; }
+		fcntl(sv[1], F_SETFL, O_NONBLOCK);
+		fxTransportFd(&t, sv[0]);
+	}
+	#else
+	if(sockets) { return; }
+	#endif
+
+	fxTransportBind(PORT_USB, &t);
+	srand(5000);
+	setMsgInfo(cp->out.unpacked, 0, getBoardID(), BENCH_CMD, RX_PTYPE_READ, 0);
+	gen_payload(cp->out.unpacked + MP_DATA1, payloadLen, WL_CLEAN);
+	cp->out.unpackedIdx = MULTI_PACKET_OVERHEAD + payloadLen;
+
+	bench_start(&bt);
+	for(i = 0; i < BENCH_PASSES * BENCH_FRAMES; i++)
+	{
+		packMultiPacket(&cp->out);
+		if(burst) { transmitFxPacketBurst(PORT_USB, NULL); }
+		else { while(transmitFxPacket(PORT_USB) == 0) {} }
+
+		#ifdef FX_TRANSPORT_FD
+		if(sockets) { while(read(sv[1], rx, sizeof(rx)) > 0) {} }
+		#endif
+	}
+	snprintf(name, sizeof(name), "pack + transmitFxPacket%s %uB, %s", \
+			burst ? "Burst" : "", payloadLen, sockets ? "socketpair" : "null");
+	bench_stop(&bt, name, BENCH_PASSES * BENCH_FRAMES, cp->out.unpackedIdx);
+
+	fxTransportBind(PORT_USB, NULL);
+	bench_sink += rx[0];
+	#ifdef FX_TRANSPORT_FD
+	if(sockets) { close(sv[0]); close(sv[1]); }
+	#endif
+}
+
+//****************************************************************************
+// Public function, called by flexsea_comm_bench():
+//****************************************************************************
+
+void bench_flexsea_comm(void)
+{
+	uint8_t w, m;
+
+	for(w = WL_CLEAN; w <= WL_ESCAPES; w++) { bench_comm_gen_str(w); }
+
+	for(m = 0; m < 3; m++)
+	{
+		for(w = 0; w < WL_NUM; w++) { bench_legacy_decode(w, m); }
+	}
+
+	for(w = WL_CLEAN; w <= WL_ESCAPES; w++)
+	{
+		bench_pack_multi(w, 40);
+		bench_pack_multi(w, 400);
+	}
+
+	for(m = 0; m < 2; m++)
+	{
+		for(w = 0; w < WL_NUM; w++)
+		{
+			bench_multi_receive(w, 40, m);
+			bench_multi_receive(w, 400, m);
+		}
+	}
+
+	for(m = 0; m < 2; m++)
+	{
+		bench_transmit(40, m, 0);
+		bench_transmit(400, m, 0);
+		bench_transmit(400, m, 1);
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif
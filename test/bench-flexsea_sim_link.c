@@ -0,0 +1,183 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <flexsea.h>
+#include <flexsea_board.h>
+#include <flexsea_interface.h>
+#include <flexsea_sim_link.h>
+#include "flexsea-comm_bench-all.h"
+#include <string.h>
+#include <stdio.h>
+
+//Requests sent back to back over a simulated link, in simulated time. For
+//each link and impairment:
+//	goodput: payload parsed by the receiver per (simulated) second
+//	lost: packets that never made it
+//	latency: average time from packing a request to parsing it
+//	resync: average time between the last packet before a loss and the first
+//	one after it
+
+#define BENCH_SIM_PACKETS		1000
+#define BENCH_SIM_STEP_US		10			//Default main loop period
+#define BENCH_SIM_CB_LEN		4096
+#define BENCH_SIM_CMD			10
+
+typedef struct {
+	const char *name;
+	const SimLinkConfig *link;
+	double writeLoss;
+	double bitErrorRate;
+	double insertRate;
+	uint32_t loopUs;			//Main loop period
+	uint8_t perLoop;			//Packets the main loop tries to send
+	uint8_t mode;
+} benchSimCase_t;
+
+//How the main loop transmits:
+enum {
+	BENCH_SIM_FRAME = 0,		//transmitFxPacket(): one frame
+	BENCH_SIM_BURST,			//transmitFxPacketBurst(): all of them
+	BENCH_SIM_COALESCE			//Burst into a coalescer, flushed every loop
+};
+
+static uint8_t storageA[BENCH_SIM_CB_LEN], storageB[BENCH_SIM_CB_LEN];
+static MultiCommPeriph periphA, periphB;
+static SimLink link;
+static uint64_t arrival[BENCH_SIM_PACKETS];		//0: never arrived
+static uint64_t packed[BENCH_SIM_PACKETS];
+
+//****************************************************************************
+// Helper function(s):
+//****************************************************************************
+
+//Receiver: the sequence number is in the first 2 bytes
+static void bench_sim_handler(uint8_t *msgBuf, MultiPacketInfo *info, uint8_t *responseBuf, \
+							uint16_t* responseLen)
+{
+	uint16_t seq = msgBuf[0] | (msgBuf[1] << 8);
+	(void)info;
+	(void)responseBuf;
+	(void)responseLen;
+	if(seq < BENCH_SIM_PACKETS && !arrival[seq]) { arrival[seq] = link.now; }
+}
+
+static void bench_sim_pack(uint16_t seq, uint16_t len)
+{
+	MultiWrapper *p = &periphA.out;
+	uint16_t i;
+
+	setMsgInfo(p->unpacked, 0, getBoardID(), BENCH_SIM_CMD, RX_PTYPE_READ, 0);
+	p->unpacked[MP_DATA1] = seq & 0xFF;
+	p->unpacked[MP_DATA1 + 1] = seq >> 8;
+	for(i = 2; i < len; i++) { p->unpacked[MP_DATA1 + i] = (seq + i) & 0x7F; }
+	p->unpackedIdx = MULTI_PACKET_OVERHEAD + len;
+	p->currentMultiPacket = seq & 0x03;
+	packMultiPacket(p);
+}
+
+static void bench_sim_run(const benchSimCase_t *c, uint16_t len)
+{
+	SimLinkConfig config = *c->link;
+	FxTransport t, usb;
+	FxCoalescer coalescer;
+	uint64_t lastGood = 0, resync = 0, latency = 0;
+	uint32_t parsed = 0, gaps = 0;
+	uint16_t sent = 0, seq;
+	uint8_t missing = 0, k;
+	char name[64];
+
+	config.writeLoss = c->writeLoss;
+	config.bitErrorRate = c->bitErrorRate;
+	config.insertRate = c->insertRate;
+
+	circ_buff_attach(&periphA.circularBuff, storageA, BENCH_SIM_CB_LEN);
+	circ_buff_attach(&periphB.circularBuff, storageB, BENCH_SIM_CB_LEN);
+	initMultiPeriph(&periphA, PORT_USB, MASTER);
+	initMultiPeriph(&periphB, PORT_USB, SLAVE);
+	memset(&periphA.out, 0, sizeof(MultiWrapper));
+	simLinkInit(&link, &periphA, &periphB, &config);
+	memset(arrival, 0, sizeof(arrival));
+
+	simLinkTransport(&link, &periphA, &usb);
+	fxCoalescerInit(&coalescer, &usb, FX_USB_COALESCE_THRESHOLD, 0);
+	if(c->mode == BENCH_SIM_COALESCE) { fxCoalescerTransport(&coalescer, &t); }
+	else { t = usb; }
+
+	while(sent < BENCH_SIM_PACKETS || !periphA.out.isMultiComplete || link.ch[0].count || \
+			coalescer.len)
+	{
+		for(k = 0; k < c->perLoop; k++)
+		{
+			if(sent < BENCH_SIM_PACKETS && (periphA.out.isMultiComplete || !periphA.out.frameMap))
+			{
+				packed[sent] = link.now;
+				bench_sim_pack(sent++, len);
+			}
+
+			if(c->mode == BENCH_SIM_FRAME)
+			{
+				if(transmitFxPacketByPeriph(&periphA, &t)) { break; }
+			}
+			else if(transmitFxPacketBurstByPeriph(&periphA, &t, NULL)) { break; }
+		}
+
+		fxCoalescerPoll(&coalescer, link.now / 1000);
+		simLinkAdvance(&link, c->loopUs);
+		receiveFxPacketByPeriph(&periphB);
+	}
+
+	for(seq = 0; seq < BENCH_SIM_PACKETS; seq++)
+	{
+		if(!arrival[seq]) { missing = 1; continue; }
+
+		if(missing && parsed) { resync += arrival[seq] - lastGood; gaps++; }
+		missing = 0;
+		lastGood = arrival[seq];
+		latency += arrival[seq] - packed[seq];
+		parsed++;
+	}
+
+	snprintf(name, sizeof(name), "sim %s (%uB)", c->name, len);
+	printf("%-48s %10.1f kB/s %6.2f %% lost %9.1f us resync %9.1f us latency\n", \
+			name, parsed ? 1e6 * parsed * len / link.now : 0, \
+			100.0 * (BENCH_SIM_PACKETS - parsed) / BENCH_SIM_PACKETS, \
+			gaps ? resync / 1000.0 / gaps : 0, \
+			parsed ? latency / 1000.0 / parsed : 0);
+}
+
+//****************************************************************************
+// Public function, called by flexsea_comm_bench():
+//****************************************************************************
+
+void bench_flexsea_sim_link(void)
+{
+	const benchSimCase_t cases[] = {
+		{"RS-485", &simLinkRs485, 0, 0, 0, BENCH_SIM_STEP_US, 1, BENCH_SIM_FRAME},
+		{"RS-485 BER 1e-5", &simLinkRs485, 0, 1e-5, 0, BENCH_SIM_STEP_US, 1, BENCH_SIM_FRAME},
+		{"RS-485 1% loss, noise", &simLinkRs485, 0.01, 0, 1e-4, BENCH_SIM_STEP_US, 1, \
+			BENCH_SIM_FRAME},
+		{"USB FS", &simLinkUsbFs, 0, 0, 0, BENCH_SIM_STEP_US, 1, BENCH_SIM_FRAME},
+		{"USB FS BER 1e-5", &simLinkUsbFs, 0, 1e-5, 0, BENCH_SIM_STEP_US, 1, BENCH_SIM_FRAME},
+		{"USB FS, 1 kHz loop", &simLinkUsbFs, 0, 0, 0, 1000, 1, BENCH_SIM_FRAME},
+		{"USB FS, 1 kHz loop, burst", &simLinkUsbFs, 0, 0, 0, 1000, 1, BENCH_SIM_BURST},
+		{"USB FS, 1 kHz loop, 8/loop, burst", &simLinkUsbFs, 0, 0, 0, 1000, 8, BENCH_SIM_BURST},
+		{"USB FS, 1 kHz loop, 8/loop, coalesced", &simLinkUsbFs, 0, 0, 0, 1000, 8, \
+			BENCH_SIM_COALESCE}
+	};
+	uint8_t i;
+
+	flexsea_multipayload_ptr[BENCH_SIM_CMD][RX_PTYPE_REPLY] = bench_sim_handler;
+
+	for(i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		bench_sim_run(&cases[i], 40);
+		bench_sim_run(&cases[i], 400);
+	}
+
+	flexsea_multipayload_ptr[BENCH_SIM_CMD][RX_PTYPE_REPLY] = NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,127 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "flexsea-comm_bench-all.h"
+
+//****************************************************************************
+// Variables used for these benchmarks:
+//****************************************************************************
+
+volatile uint32_t bench_sink = 0;
+
+//Heap allocations made so far (glibc only, see below)
+volatile uint32_t bench_allocs = 0;
+
+//Machine-readable copy of the results (FLEXSEA_BENCH_CSV=<file>)
+static FILE *benchCsv = NULL;
+
+//****************************************************************************
+// Helper function(s):
+//****************************************************************************
+
+//glibc: count the allocations by wrapping malloc() & co. The stack itself
+//should never allocate, any count here is a regression.
+#if defined(__GLIBC__) && !defined(BENCH_NO_ALLOC_COUNT)
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) { bench_allocs++; return __libc_malloc(size); }
+void *calloc(size_t n, size_t size) { bench_allocs++; return __libc_calloc(n, size); }
+void *realloc(void *ptr, size_t size) { bench_allocs++; return __libc_realloc(ptr, size); }
+#define BENCH_ALLOC_COUNT
+#endif
+
+//Host only: monotonic time in nanoseconds
+double bench_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void bench_print(const char *name, double nsPerIteration, double bytesPerIteration, \
+						double allocsPerIteration)
+{
+	double mbPerSec = 0;
+	if(nsPerIteration > 0) { mbPerSec = bytesPerIteration * 1e3 / nsPerIteration; }
+
+	if(allocsPerIteration < 0)
+	{
+		printf("%-48s %10.1f ns %10.1f MB/s\n", name, nsPerIteration, mbPerSec);
+	}
+	else
+	{
+		printf("%-48s %10.1f ns %10.1f MB/s %8.2f allocs\n", name, nsPerIteration, \
+				mbPerSec, allocsPerIteration);
+	}
+
+	if(benchCsv)
+	{
+		fprintf(benchCsv, "\"%s\",%.2f,%.2f,", name, nsPerIteration, mbPerSec);
+		if(allocsPerIteration >= 0) { fprintf(benchCsv, "%.3f", allocsPerIteration); }
+		fprintf(benchCsv, "\n");
+	}
+}
+
+void bench_report(const char *name, double nsPerIteration, double bytesPerIteration)
+{
+	bench_print(name, nsPerIteration, bytesPerIteration, -1);
+}
+
+void bench_start(BenchTimer *t)
+{
+	t->allocs = bench_allocs;
+	t->t0 = bench_now_ns();
+}
+
+//Reports the time, throughput and allocations per iteration since bench_start()
+void bench_stop(BenchTimer *t, const char *name, uint32_t iterations, double bytesPerIteration)
+{
+	double ns = bench_now_ns() - t->t0;
+	double allocs = -1;
+
+	#ifdef BENCH_ALLOC_COUNT
+	allocs = (double)(bench_allocs - t->allocs) / iterations;
+	#endif
+
+	bench_print(name, ns / iterations, bytesPerIteration, allocs);
+}
+
+//****************************************************************************
+// Main benchmark function:
+//****************************************************************************
+
+//Call this function to benchmark the 'flexsea-comm' stack (host only). The
+//workloads are seeded: results can be compared from one build to the next.
+int flexsea_comm_bench(void)
+{
+	const char *csv = getenv("FLEXSEA_BENCH_CSV");
+	if(csv)
+	{
+		benchCsv = fopen(csv, "w");
+		if(benchCsv) { fprintf(benchCsv, "name,ns_per_op,mb_per_s,allocs_per_op\n"); }
+	}
+
+	//One call per file here:
+	bench_flexsea_buffers();
+	bench_flexsea_comm();
+	bench_flexsea_sim_link();
+
+	if(benchCsv)
+	{
+		fclose(benchCsv);
+		benchCsv = NULL;
+	}
+
+	fflush(stdout);
+	return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
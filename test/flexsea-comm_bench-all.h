@@ -0,0 +1,38 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef BENCH_ALL_FX_COMM_H
+#define BENCH_ALL_FX_COMM_H
+
+#include <stdint.h>
+#include "../inc/flexsea.h"
+
+int flexsea_comm_bench(void);
+
+//Helpers shared by the individual benchmark files:
+typedef struct
+{
+	double t0;
+	uint32_t allocs;
+}BenchTimer;
+
+double bench_now_ns(void);
+void bench_report(const char *name, double nsPerIteration, double bytesPerIteration);
+void bench_start(BenchTimer *t);
+void bench_stop(BenchTimer *t, const char *name, uint32_t iterations, double bytesPerIteration);
+
+//Prototypes for public functions defined in individual benchmark files:
+void bench_flexsea_buffers(void);
+void bench_flexsea_comm(void);
+void bench_flexsea_sim_link(void);
+
+//Keeps the optimizer from discarding results:
+extern volatile uint32_t bench_sink;
+extern volatile uint32_t bench_allocs;
+
+#endif	//BENCH_ALL_FX_COMM_H
+
+#ifdef __cplusplus
+}
+#endif
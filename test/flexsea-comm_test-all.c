@@ -29,6 +29,8 @@ int flexsea_comm_test(void)
 	test_flexsea_comm();
 	test_flexsea_payload();
 	test_flexsea_buffers();
+	test_flexsea_sim_link();
+	test_flexsea_transport();
 
 	return UNITY_END();
 }
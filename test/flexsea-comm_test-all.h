@@ -16,6 +16,8 @@ void test_flexsea(void);
 void test_flexsea_buffers(void);
 void test_flexsea_comm(void);
 void test_flexsea_payload(void);
+void test_flexsea_sim_link(void);
+void test_flexsea_transport(void);
 
 #endif	//TEST_ALL_FX_COMM_H
 
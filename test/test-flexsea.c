@@ -3,6 +3,12 @@ extern "C" {
 #endif
 
 #include "flexsea-comm_test-all.h"
+#include "../inc/flexsea_log.h"
+#include <string.h>
+#if defined(FX_LOG_DEFERRED) && defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 //Definitions and variables used by some/all tests:
 //...
@@ -79,10 +85,191 @@ void test_SPLIT_REBUILD_32(void)
 	}
 }
 
+//Functions under test: fx_log_format() & fx_log_decode()
+void test_log_decode(void)
+{
+	FxLogRecord r[2];
+	char text[96];
+
+	memset(r, 0, sizeof(r));
+	r[0].timestamp = 1234;
+	r[0].id = FXLOG_CB_OVERWRITTEN;
+	r[0].seq = 7;
+	r[0].args[0] = 42;
+	r[1].timestamp = 1300;
+	r[1].id = FXLOG_MULTI_TOO_LONG;
+	r[1].seq = 9;
+
+	TEST_ASSERT_TRUE(fx_log_format(&r[0], text, sizeof(text)) > 0);
+	TEST_ASSERT_EQUAL(0, strcmp(text, "[1234] CB has been overwritten (42 bytes)"));
+
+	#ifdef BOARD_TYPE_FLEXSEA_PLAN
+
+	//Binary log to text, with the gap in the sequence:
+	FILE *in = tmpfile(), *out = tmpfile();
+	char decoded[256] = {0};
+	TEST_ASSERT_TRUE(in != NULL && out != NULL);
+	fwrite(r, sizeof(FxLogRecord), 2, in);
+	rewind(in);
+	TEST_ASSERT_EQUAL(2, fx_log_decode(in, out));
+	rewind(out);
+	TEST_ASSERT_TRUE(fread(decoded, 1, sizeof(decoded) - 1, out) > 0);
+	TEST_ASSERT_EQUAL(0, strcmp(decoded, "[1234] CB has been overwritten (42 bytes)\n" \
+						"(1 records lost)\n[1300] Multi packet too long, frame dropped\n"));
+	fclose(in);
+	fclose(out);
+
+	#endif
+}
+
+#ifdef FX_LOG_DEFERRED
+
+//Functions under test: fx_log_id(), fx_log_read(), fx_log_process() &
+//fx_log_dropped(). Only built with FX_LOG_DEFERRED.
+void test_log_ring(void)
+{
+	static FxLogRecord r[FX_LOG_RING_LEN];
+	uint32_t dropped = 0;
+	uint16_t i = 0, n = 0, last = 0;
+
+	//The rest of the stack logs too: start from an empty ring
+	while(fx_log_read(r, FX_LOG_RING_LEN)) {}
+	dropped = fx_log_dropped();
+
+	//Fill it, and 3 more:
+	for(i = 0; i < FX_LOG_RING_LEN + 3; i++)
+	{
+		fx_log_id(FXLOG_CB_OVERWRITTEN, (uint32_t)i);
+	}
+	TEST_ASSERT_EQUAL(dropped + 3, fx_log_dropped());
+
+	//The first FX_LOG_RING_LEN are kept, in order:
+	n = fx_log_read(r, FX_LOG_RING_LEN);
+	TEST_ASSERT_EQUAL(FX_LOG_RING_LEN, n);
+	for(i = 0; i < n; i++)
+	{
+		TEST_ASSERT_EQUAL(FXLOG_CB_OVERWRITTEN, r[i].id);
+		TEST_ASSERT_EQUAL(i, r[i].args[0]);
+		TEST_ASSERT_EQUAL((uint16_t)(r[0].seq + i), r[i].seq);
+	}
+	TEST_ASSERT_EQUAL(0, fx_log_read(r, 1));
+
+	//The drops show as a gap in the sequence:
+	last = r[n - 1].seq;
+	fx_log_id(FXLOG_MULTI_TOO_LONG);
+	TEST_ASSERT_EQUAL(1, fx_log_read(r, FX_LOG_RING_LEN));
+	TEST_ASSERT_EQUAL(FXLOG_MULTI_TOO_LONG, r[0].id);
+	TEST_ASSERT_EQUAL((uint16_t)(last + 1 + 3), r[0].seq);
+
+	//Drain in steps from the idle loop hook:
+	for(i = 0; i < 10; i++) { fx_log_id(FXLOG_CB_OVERWRITTEN, (uint32_t)i); }
+	TEST_ASSERT_EQUAL(4, fx_log_process(4));
+	TEST_ASSERT_EQUAL(6, fx_log_process(FX_LOG_RING_LEN));
+	TEST_ASSERT_EQUAL(0, fx_log_process(FX_LOG_RING_LEN));
+	TEST_ASSERT_EQUAL(dropped + 3, fx_log_dropped());
+}
+
+#ifdef __linux__
+
+//Producers log (thread << 16) | count while the main thread reads. Nothing
+//is lost or duplicated (kept + dropped), and each producer's records come out
+//in order.
+#define LOG_PRODUCERS		4
+#define LOG_PER_PRODUCER	20000
+
+static void* log_producer(void *arg)
+{
+	uint32_t t = (uint32_t)(uintptr_t)arg, i;
+
+	for(i = 0; i < LOG_PER_PRODUCER; i++)
+	{
+		fx_log_id(FXLOG_CB_OVERWRITTEN, (t << 16) | i);
+		if((i & 63) == 0) { sched_yield(); }
+	}
+
+	return NULL;
+}
+
+void test_log_ring_producers(void)
+{
+	pthread_t producer[LOG_PRODUCERS];
+	static FxLogRecord r[FX_LOG_RING_LEN];
+	int32_t next[LOG_PRODUCERS];
+	uint32_t dropped = 0, kept = 0, t = 0;
+	int i = 0, n = 0, errors = 0;
+
+	while(fx_log_read(r, FX_LOG_RING_LEN)) {}
+	dropped = fx_log_dropped();
+	for(t = 0; t < LOG_PRODUCERS; t++) { next[t] = -1; }
+
+	for(t = 0; t < LOG_PRODUCERS; t++)
+	{
+		TEST_ASSERT_EQUAL(0, pthread_create(&producer[t], NULL, log_producer, \
+							(void *)(uintptr_t)t));
+	}
+
+	while(kept + fx_log_dropped() - dropped < LOG_PRODUCERS * LOG_PER_PRODUCER)
+	{
+		n = fx_log_read(r, FX_LOG_RING_LEN);
+		for(i = 0; i < n; i++)
+		{
+			t = r[i].args[0] >> 16;
+			if(r[i].id != FXLOG_CB_OVERWRITTEN || t >= LOG_PRODUCERS || \
+				(int32_t)(r[i].args[0] & 0xFFFF) <= next[t])
+			{
+				errors++;
+				continue;
+			}
+			next[t] = r[i].args[0] & 0xFFFF;
+		}
+		kept += n;
+		if(!n) { sched_yield(); }
+	}
+
+	for(t = 0; t < LOG_PRODUCERS; t++) { pthread_join(producer[t], NULL); }
+	TEST_ASSERT_EQUAL_MESSAGE(0, errors, "Records out of order or corrupted");
+	TEST_ASSERT_EQUAL(0, fx_log_read(r, FX_LOG_RING_LEN));
+	TEST_ASSERT_EQUAL(LOG_PRODUCERS * LOG_PER_PRODUCER, kept + fx_log_dropped() - dropped);
+	TEST_ASSERT_TRUE(kept > 0);
+}
+
+#endif	//__linux__
+
+#ifdef FX_LOG_THREAD
+
+//Functions under test: fx_log_start_thread() & fx_log_stop_thread()
+void test_log_thread(void)
+{
+	FxLogRecord r;
+	int i = 0;
+
+	while(fx_log_read(&r, 1)) {}
+	TEST_ASSERT_EQUAL(0, fx_log_start_thread(1));
+	for(i = 0; i < 10; i++) { fx_log_id(FXLOG_MULTI_TOO_LONG); }
+	fx_log_stop_thread();
+
+	//Stopping processes what was pending
+	TEST_ASSERT_EQUAL(0, fx_log_read(&r, 1));
+}
+
+#endif	//FX_LOG_THREAD
+
+#endif	//FX_LOG_DEFERRED
+
 void test_flexsea(void)
 {
 	RUN_TEST(test_SPLIT_REBUILD_16);
 	RUN_TEST(test_SPLIT_REBUILD_32);
+	RUN_TEST(test_log_decode);
+	#ifdef FX_LOG_DEFERRED
+	RUN_TEST(test_log_ring);
+	#ifdef __linux__
+	RUN_TEST(test_log_ring_producers);
+	#endif
+	#ifdef FX_LOG_THREAD
+	RUN_TEST(test_log_thread);
+	#endif
+	#endif
 
 	fflush(stdout);
 }
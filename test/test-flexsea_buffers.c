@@ -2,6 +2,8 @@
 extern "C" {
 #endif
 #include <flexsea_buffers.h>
+#include <flexsea_simd.h>
+#include <flexsea_comm_multi.h>
 #include "flexsea-comm_test-all.h"
 #include <stdio.h>
 #include <string.h>
@@ -9,12 +11,20 @@ extern "C" {
 #include <time.h>
 #include <stdlib.h>
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+//Storage of the circular buffers under test
+static uint8_t cbStorage[CB_BUF_LEN];
+
 void test_buffer_circular(void)
 {
 	int i;
 
 	circularBuffer_t cb;
-	circ_buff_init(&cb);
+	circ_buff_attach(&cb, cbStorage, CB_BUF_LEN);
 	uint8_t buf[CB_BUF_LEN];
 
 	uint8_t v;
@@ -54,11 +64,10 @@ void test_buffer_circular(void)
 	TEST_ASSERT_EQUAL(lastVal, buf[CB_BUF_LEN-1]);
 
 	circ_buff_init(&cb);
-	//random tests
+	//random tests. head and tail are compared as array indexes.
 	srand(time(NULL));
-	int lastSize = 0, lastHead = -1, lastTail = 0, firstTime = 1;
 	expectedSize = 0;
-	int expectedHead = -1, expectedTail = 0;
+	int expectedHead = 0, expectedTail = 0;
 	for(i = 0; i < 5000; i++)
 	{
 		int shouldWrite = rand() % 2;
@@ -71,72 +80,81 @@ void test_buffer_circular(void)
 			{
 				TEST_ASSERT_EQUAL_MESSAGE(1, result, "Expected to fail on write of size larger than buffer");
 			}
+			else if(expectedSize + l > CB_BUF_LEN)
+			{
+				#ifdef CIRC_BUFF_SPSC
+				TEST_ASSERT_EQUAL_MESSAGE(3, result, "Expected write rejection");
+				#else
+				expectedTail = (expectedTail + l) % CB_BUF_LEN;
+				expectedHead = expectedTail;
+				expectedSize = CB_BUF_LEN;
+				TEST_ASSERT_EQUAL_MESSAGE(2, result, "Expected overwrite");
+				#endif
+			}
 			else
 			{
-				expectedSize += l;
 				expectedTail = (expectedTail + l) % CB_BUF_LEN;
-				if(expectedSize > CB_BUF_LEN)
-				{
-					expectedHead = expectedTail;
-					expectedSize = CB_BUF_LEN;
-					TEST_ASSERT_EQUAL_MESSAGE(2, result, "Expected overwrite");
-				}
-				else
-				{
-					expectedHead = expectedHead < 0 ? 0 : expectedHead;
-					TEST_ASSERT_EQUAL_MESSAGE(0, result, "Expected write success");
-				}
+				expectedSize += l;
+				TEST_ASSERT_EQUAL_MESSAGE(0, result, "Expected write success");
 			}
 		}
 		else
 		{
 			result = circ_buff_move_head(&cb, l);
 			if(l > CB_BUF_LEN)
-			{ //expect to fail
+			{ //expect to fail, buffer is emptied
 
 				TEST_ASSERT_EQUAL_MESSAGE(2, result, "Expected move more than max error");
-				expectedHead = -1;
-				expectedTail = 0;
+				expectedHead = expectedTail;
+				expectedSize = 0;
+			}
+			else if(l > expectedSize)
+			{
+				TEST_ASSERT_EQUAL_MESSAGE(1, result, "Expected move more than buffered error");
+				expectedHead = expectedTail;
 				expectedSize = 0;
 			}
 			else
 			{
-				if(lastSize - l >= 0)
-				{
-					TEST_ASSERT_EQUAL_MESSAGE(0, result, "Expected move success");
-				}
-				else
-					TEST_ASSERT_EQUAL_MESSAGE(1, result, "Expected move more than buffered error");
-
+				TEST_ASSERT_EQUAL_MESSAGE(0, result, "Expected move success");
+				expectedHead = (expectedHead + l) % CB_BUF_LEN;
 				expectedSize -= l;
-				if(expectedSize < 1)
-				{
-					expectedHead = -1;
-					expectedTail = 0;
-					expectedSize = 0;
-				}
-				else
-				{
-					expectedHead = (expectedHead + l) % CB_BUF_LEN;
-				}
 			}
 		}
 
-		TEST_ASSERT_EQUAL_MESSAGE(expectedHead, cb.head, "Heads did not match");
-		TEST_ASSERT_EQUAL_MESSAGE(expectedTail, cb.tail, "Tails did not match");
-		TEST_ASSERT_EQUAL_MESSAGE(expectedSize, cb.size, "Sizes did not match");
-		lastSize = expectedSize;
-		lastHead = expectedHead;
-		lastTail = expectedTail;
-		firstTime = 0;
+		TEST_ASSERT_EQUAL_MESSAGE(expectedHead, circ_buff_index_of(&cb, 0), "Heads did not match");
+		TEST_ASSERT_EQUAL_MESSAGE(expectedTail, cb.tail % CB_BUF_LEN, "Tails did not match");
+		TEST_ASSERT_EQUAL_MESSAGE(expectedSize, circ_buff_get_size(&cb), "Sizes did not match");
+		TEST_ASSERT_EQUAL_MESSAGE(CB_BUF_LEN - expectedSize, circ_buff_get_space(&cb), "Space did not match");
 	}
 }
 
+//The tests below expect the oldest bytes to be overwritten. CIRC_BUFF_SPSC
+//only rejects, so the oldest bytes are consumed before the write instead.
+static void overwrite_oldest(circularBuffer_t *cb)
+{
+	#ifdef CIRC_BUFF_SPSC
+	(void)cb;
+	#else
+	circ_buff_set_policy(cb, CB_OVERWRITE_OLDEST);
+	#endif
+}
+
+static void write_overwriting(circularBuffer_t *cb, uint8_t *data, int len)
+{
+	#ifdef CIRC_BUFF_SPSC
+	int space = circ_buff_get_space(cb);
+	if(len > space) { circ_buff_move_head(cb, len - space); }
+	#endif
+	circ_buff_write(cb, data, len);
+}
+
 void test_buffer_circular_alphabet(void)
 {
 	circularBuffer_t buf;
 	circularBuffer_t* cb = &buf;
-	circ_buff_init(cb);
+	circ_buff_attach(cb, cbStorage, CB_BUF_LEN);
+	overwrite_oldest(cb);
 
 	srand(time(NULL));
 	const int ALPHABET_LEN = 31;
@@ -150,7 +168,7 @@ void test_buffer_circular_alphabet(void)
 
 	for(i = 0; i < 1000; i++)
 	{
-		circ_buff_write(cb, alphabet, ALPHABET_LEN);
+		write_overwriting(cb, alphabet, ALPHABET_LEN);
 	}
 
 	uint8_t outputBuf[CB_BUF_LEN];
@@ -169,7 +187,7 @@ void test_buffer_circular_write_erase(void)
 {
 	circularBuffer_t buf;
 	circularBuffer_t* cb = &buf;
-	circ_buff_init(cb);
+	circ_buff_attach(cb, cbStorage, CB_BUF_LEN);
 
 	srand(time(NULL));
 	const int ALPHABET_LEN = 31;
@@ -225,7 +243,8 @@ void test_buffer_circular_search(void)
 {
 	circularBuffer_t circBuf;
 	circularBuffer_t* cb = &circBuf;
-	circ_buff_init(cb);
+	circ_buff_attach(cb, cbStorage, CB_BUF_LEN);
+	overwrite_oldest(cb);
 	srand(time(NULL));
 
 	uint8_t buf[CB_BUF_LEN];
@@ -238,11 +257,11 @@ void test_buffer_circular_search(void)
 	for(i = 0; i < 100; i++)
 	{
 		length = rand() % CB_BUF_LEN;
-		circ_buff_write(cb, buf, length);
+		write_overwriting(cb, buf, length);
 	}
 
 	//Write the actual values we will compare to
-	circ_buff_write(cb, buf, CB_BUF_LEN);
+	write_overwriting(cb, buf, CB_BUF_LEN);
 
 	int expectedIndex, actualIndex, lastIndex;
 	uint8_t value = 0, lastValue = 0;
@@ -263,11 +282,218 @@ void test_buffer_circular_search(void)
 	} while(value > lastValue);
 }
 
+void test_buffer_circular_zero_copy(void)
+{
+	circularBuffer_t circBuf;
+	circularBuffer_t* cb = &circBuf;
+	uint8_t *ptr;
+	uint16_t len;
+	uint32_t written = 0, consumed = 0;
+	int i, n, errors = 0;
+
+	circ_buff_attach(cb, cbStorage, CB_BUF_LEN);
+	srand(time(NULL));
+
+	//Empty: nothing to peek, the whole array can be written
+	circ_buff_peek_contiguous(cb, &ptr, &len);
+	TEST_ASSERT_EQUAL(0, len);
+	circ_buff_acquire_write(cb, &ptr, &len);
+	TEST_ASSERT_EQUAL(CB_BUF_LEN, len);
+	TEST_ASSERT_TRUE(ptr == cb->bytes);
+	TEST_ASSERT_EQUAL(3, circ_buff_commit_write(cb, CB_BUF_LEN + 1));
+
+	for(i = 0; i < 5000; i++)
+	{
+		if(rand() % 2)
+		{
+			circ_buff_acquire_write(cb, &ptr, &len);
+			TEST_ASSERT_TRUE(len <= circ_buff_get_space(cb));
+			n = len ? rand() % (len + 1) : 0;
+			int k;
+			for(k = 0; k < n; k++) { ptr[k] = (uint8_t)(written + k); }
+			TEST_ASSERT_EQUAL(0, circ_buff_commit_write(cb, n));
+			written += n;
+		}
+		else
+		{
+			circ_buff_peek_contiguous(cb, &ptr, &len);
+			TEST_ASSERT_TRUE(len <= circ_buff_get_size(cb));
+			n = len ? rand() % (len + 1) : 0;
+			int k;
+			for(k = 0; k < n; k++) { errors += (ptr[k] != (uint8_t)(consumed + k)); }
+			TEST_ASSERT_EQUAL(0, circ_buff_consume(cb, n));
+			consumed += n;
+		}
+		TEST_ASSERT_EQUAL(written - consumed, circ_buff_get_size(cb));
+	}
+	TEST_ASSERT_EQUAL_MESSAGE(0, errors, "Zero-copy spans mismatch");
+}
+
+void test_buffer_find_byte(void)
+{
+	uint8_t buf[CB_BUF_LEN];
+	int i, start, len;
+	srand(time(NULL));
+
+	for(i = 0; i < CB_BUF_LEN; i++)
+	{
+		do { buf[i] = rand(); } while(buf[i] == HEADER);
+	}
+
+	//Every alignment and every tail length the wide loops can leave behind:
+	for(start = 0; start < 40; start++)
+	{
+		for(len = 0; len < 100; len++)
+		{
+			TEST_ASSERT_EQUAL(-1, fx_find_byte(buf + start, len, HEADER));
+			for(i = 0; i < len; i++)
+			{
+				buf[start + i] = HEADER;
+				TEST_ASSERT_EQUAL(i, fx_find_byte(buf + start, len, HEADER));
+				buf[start + i] = 0;
+			}
+		}
+	}
+
+	//Two matches: the first one wins
+	buf[100] = HEADER;
+	buf[101] = HEADER;
+	TEST_ASSERT_EQUAL(100, fx_find_byte(buf, CB_BUF_LEN, HEADER));
+	TEST_ASSERT_EQUAL(101, fx_find_byte(buf + 101, CB_BUF_LEN - 101, HEADER) + 101);
+}
+
+void test_buffer_checksum8(void)
+{
+	static uint8_t buf[4 * CB_BUF_LEN];
+	int i, start, len;
+	srand(time(NULL));
+
+	for(i = 0; i < (int)sizeof(buf); i++) { buf[i] = rand(); }
+
+	//Every alignment, short to long (SWAR blocks), against the byte loop:
+	for(start = 0; start < 40; start++)
+	{
+		for(len = 0; len < (int)sizeof(buf) - start; len += (len < 200 ? 1 : 97))
+		{
+			uint8_t expected = 0;
+			for(i = 0; i < len; i++) { expected += buf[start + i]; }
+			TEST_ASSERT_EQUAL(expected, fx_checksum8(buf + start, len));
+		}
+	}
+
+	//Worst case for the lane sums:
+	memset(buf, 0xFF, sizeof(buf));
+	TEST_ASSERT_EQUAL((uint8_t)(0xFF * sizeof(buf)), fx_checksum8(buf, sizeof(buf)));
+}
+
+//Reference: byte loop, same stopping rule
+static uint32_t escape_scalar(uint8_t *dst, uint32_t dstLen, const uint8_t *src, \
+								uint32_t *srcLen, uint8_t *checksum)
+{
+	uint32_t i, o = 0;
+	*checksum = 0;
+	for(i = 0; i < *srcLen; i++)
+	{
+		int special = (src[i] == HEADER || src[i] == FOOTER || src[i] == ESCAPE);
+		if(o + 1 + special > dstLen) break;
+		if(special) { dst[o++] = ESCAPE; *checksum += ESCAPE; }
+		dst[o++] = src[i];
+		*checksum += src[i];
+	}
+	*srcLen = i;
+	return o;
+}
+
+void test_buffer_escape(void)
+{
+	static const uint8_t specials[] = {HEADER, FOOTER, ESCAPE};
+	uint8_t src[200], dst[400], expected[400];
+	int i, density, start, len, dstLen;
+	srand(time(NULL));
+
+	//From escape free to escape only payloads, every alignment, output limits
+	//that cut the data anywhere (including between a byte and its escape):
+	for(density = 0; density <= 100; density += 10)
+	{
+		for(i = 0; i < (int)sizeof(src); i++)
+		{
+			src[i] = (rand() % 100 < density) ? specials[rand() % 3] : rand();
+		}
+
+		for(start = 0; start < 33; start++)
+		{
+			for(len = 0; len < (int)sizeof(src) - start; len += 1 + rand() % 7)
+			{
+				for(dstLen = 0; dstLen <= 2 * len; dstLen += 1 + rand() % 5)
+				{
+					uint32_t n = len, nRef = len, o, oRef;
+					uint8_t chk, chkRef;
+					memset(dst, 0xAA, sizeof(dst));
+					oRef = escape_scalar(expected, dstLen, src + start, &nRef, &chkRef);
+					o = fx_escape(dst, dstLen, src + start, &n, &chk);
+
+					TEST_ASSERT_EQUAL(oRef, o);
+					TEST_ASSERT_EQUAL(nRef, n);
+					TEST_ASSERT_EQUAL(chkRef, chk);
+					if(o) { TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, dst, o); }
+					TEST_ASSERT_EQUAL(0xAA, dst[dstLen]);	//Nothing past dstLen
+				}
+			}
+		}
+	}
+}
+
+void test_buffer_unescape(void)
+{
+	uint8_t src[200], packed[400], inPlace[400], dst[400];
+	int i, density, len, split;
+	srand(time(NULL));
+
+	for(density = 0; density <= 100; density += 10)
+	{
+		for(i = 0; i < (int)sizeof(src); i++)
+		{
+			src[i] = (rand() % 100 < density) ? ESCAPE + 4 * (rand() % 2) : rand();
+		}
+
+		for(len = 0; len < (int)sizeof(src); len += 1 + rand() % 5)
+		{
+			uint32_t n = len, packedLen;
+			uint8_t chk, escaped = 0;
+			packedLen = escape_scalar(packed, sizeof(packed), src, &n, &chk);
+
+			//Separate destination:
+			memset(dst, 0xAA, sizeof(dst));
+			TEST_ASSERT_EQUAL(len, fx_unescape(dst, packed, packedLen, &escaped));
+			TEST_ASSERT_EQUAL(0, escaped);
+			if(len) { TEST_ASSERT_EQUAL_UINT8_ARRAY(src, dst, len); }
+
+			//In place:
+			memcpy(inPlace, packed, packedLen);
+			TEST_ASSERT_EQUAL(len, fx_unescape(inPlace, inPlace, packedLen, &escaped));
+			if(len) { TEST_ASSERT_EQUAL_UINT8_ARRAY(src, inPlace, len); }
+
+			//Two spans (wrapped frame), cut anywhere, even after an ESCAPE:
+			for(split = 0; split <= (int)packedLen; split += 1 + rand() % 3)
+			{
+				uint32_t o;
+				escaped = 0;
+				o = fx_unescape(dst, packed, split, &escaped);
+				o += fx_unescape(dst + o, packed + split, packedLen - split, &escaped);
+				TEST_ASSERT_EQUAL(len, o);
+				TEST_ASSERT_EQUAL(0, escaped);
+				if(len) { TEST_ASSERT_EQUAL_UINT8_ARRAY(src, dst, len); }
+			}
+		}
+	}
+}
+
 void test_buffer_circular_checksum(void)
 {
 	circularBuffer_t circBuf;
 	circularBuffer_t* cb = &circBuf;
-	circ_buff_init(cb);
+	circ_buff_attach(cb, cbStorage, CB_BUF_LEN);
+	overwrite_oldest(cb);
 	srand(time(NULL));
 
 	uint8_t buf[CB_BUF_LEN];
@@ -285,7 +511,7 @@ void test_buffer_circular_checksum(void)
 		{
 			start = rand() % CB_BUF_LEN;
 			length = rand() % (CB_BUF_LEN - start);
-			circ_buff_write(cb, buf, length);
+			write_overwriting(cb, buf, length);
 		}
 
 		uint8_t *d = cb->bytes;
@@ -299,13 +525,383 @@ void test_buffer_circular_checksum(void)
 	}
 }
 
+#if defined(__linux__)
+
+//One thread writes a known sequence while the test thread parses it. No
+//locks: head and tail are the only shared state.
+#define SPSC_STRESS_BYTES	2000000
+
+static circularBuffer_t spscBuf;
+
+static void* spsc_producer(void *arg)
+{
+	uint8_t chunk[64];
+	unsigned int seed = 1;
+	uint32_t sent = 0;
+	int i, n;
+	(void)arg;
+
+	while(sent < SPSC_STRESS_BYTES)
+	{
+		n = 1 + rand_r(&seed) % sizeof(chunk);
+		if(n > (int)(SPSC_STRESS_BYTES - sent)) { n = SPSC_STRESS_BYTES - sent; }
+		if(circ_buff_get_space(&spscBuf) < n)
+		{
+			sched_yield();
+			continue;
+		}
+
+		for(i = 0; i < n; i++) { chunk[i] = (uint8_t)(sent + i); }
+		if(circ_buff_write(&spscBuf, chunk, n) == 0) { sent += n; }
+	}
+
+	return NULL;
+}
+
+void test_buffer_circular_spsc_stress(void)
+{
+	pthread_t producer;
+	uint8_t readBuf[CB_BUF_LEN];
+	unsigned int seed = 2;
+	uint32_t received = 0;
+	int i, n, size, errors = 0;
+
+	circ_buff_attach(&spscBuf, cbStorage, CB_BUF_LEN);
+	TEST_ASSERT_EQUAL(0, pthread_create(&producer, NULL, spsc_producer, NULL));
+
+	while(received < SPSC_STRESS_BYTES && !errors)
+	{
+		size = circ_buff_get_size(&spscBuf);
+		if(size == 0)
+		{
+			sched_yield();
+			continue;
+		}
+
+		n = 1 + rand_r(&seed) % size;
+		circ_buff_read(&spscBuf, readBuf, n);
+		for(i = 0; i < n; i++)
+		{
+			errors += (readBuf[i] != (uint8_t)(received + i));
+		}
+		errors += (circ_buff_peak(&spscBuf, 0) != (uint8_t)received);
+		circ_buff_move_head(&spscBuf, n);
+		received += n;
+	}
+
+	pthread_join(producer, NULL);
+	TEST_ASSERT_EQUAL_MESSAGE(0, errors, "Corrupted bytes");
+	TEST_ASSERT_EQUAL(SPSC_STRESS_BYTES, received);
+	TEST_ASSERT_EQUAL(0, circ_buff_get_size(&spscBuf));
+}
+
+#endif	//__linux__
+
+//Caller provided storage: small rings, and the per-port table
+void test_buffer_circular_capacity(void)
+{
+	circularBuffer_t circBuf, detached;
+	circularBuffer_t* cb = &circBuf;
+	uint8_t small[16], out[16];
+	uint8_t data[16] = {0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15};
+
+	TEST_ASSERT_EQUAL(1, circ_buff_attach(cb, NULL, 16));
+	TEST_ASSERT_EQUAL(1, circ_buff_attach(cb, small, 0));
+	TEST_ASSERT_EQUAL(0, circ_buff_attach(cb, small, 16));
+	TEST_ASSERT_EQUAL(16, circ_buff_get_capacity(cb));
+	TEST_ASSERT_EQUAL(16, circ_buff_get_space(cb));
+
+	TEST_ASSERT_EQUAL(1, circ_buff_write(cb, data, 17));
+	TEST_ASSERT_EQUAL(0, circ_buff_write(cb, data, 10));
+	TEST_ASSERT_EQUAL(0, circ_buff_move_head(cb, 8));
+
+	//Wraps around the end of the 16 bytes:
+	TEST_ASSERT_EQUAL(0, circ_buff_write(cb, data + 10, 6));
+	TEST_ASSERT_EQUAL(0, circ_buff_write(cb, data, 4));
+	TEST_ASSERT_EQUAL(12, circ_buff_get_size(cb));
+	TEST_ASSERT_EQUAL(-1, circ_buff_search(cb, 0xAA, 0));
+	TEST_ASSERT_EQUAL(8, circ_buff_search(cb, 0, 0));
+	TEST_ASSERT_EQUAL(0, circ_buff_read(cb, out, 12));
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(data + 8, out, 8);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(data, out + 8, 4);
+
+	//Re-init keeps the storage:
+	TEST_ASSERT_EQUAL(0, circ_buff_init(cb));
+	TEST_ASSERT_EQUAL(0, circ_buff_get_size(cb));
+	TEST_ASSERT_TRUE(cb->bytes == small);
+
+	//Not attached: refused, nothing touched
+	memset(&detached, 0, sizeof(detached));
+	TEST_ASSERT_EQUAL(1, circ_buff_init(&detached));
+	TEST_ASSERT_EQUAL(1, circ_buff_init(NULL));
+
+	//Ports are sized by PORT_RX_BUF_SIZES:
+	TEST_ASSERT_TRUE(rx_buf_circ[PORT_USB].bytes != NULL);
+	TEST_ASSERT_TRUE(circ_buff_get_capacity(&rx_buf_circ[PORT_USB]) > 0);
+}
+
+//CIRC_BUFF_INIT() with the per-port sizes, as in flexsea_buffers.c. With
+//CB_BUF_LEN_LOG2 this only compiles if they are all powers of two.
+#define TEST_RX_STORAGE(port, len)		uint8_t bytes_##port[len];
+#define TEST_RX_INIT(port, len)			[port] = CIRC_BUFF_INIT(testRxStorage.bytes_##port, len),
+#define TEST_RX_CHECK(port, len)		test_buffer_circular_port(&testRxCirc[port], \
+											testRxStorage.bytes_##port, len);
+
+static struct { PORT_RX_BUF_SIZES(TEST_RX_STORAGE) } testRxStorage;
+static circularBuffer_t testRxCirc[NUMBER_OF_PORTS] = { PORT_RX_BUF_SIZES(TEST_RX_INIT) };
+
+static void test_buffer_circular_port(circularBuffer_t *cb, uint8_t *storage, uint16_t len)
+{
+	uint8_t in[3] = {1, 2, 3}, out[3] = {0, 0, 0};
+	uint16_t i;
+
+	TEST_ASSERT_TRUE(cb->bytes == storage);
+	TEST_ASSERT_EQUAL(len, circ_buff_get_capacity(cb));
+	TEST_ASSERT_EQUAL(0, circ_buff_get_size(cb));
+	#ifdef CB_BUF_LEN_LOG2
+	TEST_ASSERT_EQUAL(0, len & (len - 1));
+	#endif
+
+	//Usable as is, across the wrap
+	for(i = 0; i < len; i += 3)
+	{
+		TEST_ASSERT_EQUAL(0, circ_buff_write(cb, in, 3));
+		TEST_ASSERT_EQUAL(0, circ_buff_read(cb, out, 3));
+		TEST_ASSERT_EQUAL_UINT8_ARRAY(in, out, 3);
+		TEST_ASSERT_EQUAL(0, circ_buff_move_head(cb, 3));
+		in[0]++;
+	}
+	TEST_ASSERT_EQUAL(0, circ_buff_get_size(cb));
+}
+
+void test_buffer_circular_static_init(void)
+{
+	PORT_RX_BUF_SIZES(TEST_RX_CHECK)
+}
+
+//Same answers as circ_buff_search(), SOF index or not. Bursts of HEADERs
+//overflow the index and exercise the gaps.
+void test_buffer_circular_search_sof(void)
+{
+	circularBuffer_t circBuf;
+	circularBuffer_t* cb = &circBuf;
+	uint8_t buf[CB_BUF_LEN], *ptr;
+	uint16_t len;
+	int i, k, n, start;
+
+	circ_buff_attach(cb, cbStorage, CB_BUF_LEN);
+	srand(time(NULL));
+
+	for(i = 0; i < 3000; i++)
+	{
+		int burst = (rand() % 8) == 0;
+		n = rand() % (CB_BUF_LEN / 4);
+		for(k = 0; k < n; k++)
+		{
+			buf[k] = (burst || (rand() % 40) == 0) ? HEADER : (uint8_t)(rand() % HEADER);
+		}
+
+		switch(rand() % 4)
+		{
+			case 0:
+				circ_buff_write(cb, buf, n);
+				break;
+			case 1:
+				circ_buff_acquire_write(cb, &ptr, &len);
+				n = n < len ? n : len;
+				memcpy(ptr, buf, n);
+				circ_buff_commit_write(cb, n);
+				break;
+			default:
+				circ_buff_move_head(cb, rand() % (CB_BUF_LEN / 3));
+				break;
+		}
+
+		//Walk the whole buffer, one header at a time:
+		start = rand() % 8;
+		do
+		{
+			int32_t expected = circ_buff_search(cb, HEADER, start);
+			TEST_ASSERT_EQUAL(expected, circ_buff_search_sof(cb, start));
+			start = expected + 1;
+		} while(start > 0);
+	}
+}
+
+static int watermarkCalls = 0, watermarkSize = 0;
+static void watermarkCallback(circularBuffer_t *cb, int size)
+{
+	(void)cb;
+	watermarkCalls++;
+	watermarkSize = size;
+}
+
+void test_buffer_circular_policies(void)
+{
+	circularBuffer_t circBuf;
+	circularBuffer_t* cb = &circBuf;
+	uint8_t small[16], *ptr;
+	uint16_t len;
+	uint8_t data[10] = {HEADER,1,2,3,4,5,HEADER,7,8,9};
+
+	circ_buff_attach(cb, small, 16);
+	TEST_ASSERT_EQUAL(CB_DEFAULT_POLICY, cb->policy);
+
+	//Reject: the old bytes stay, the new ones are counted
+	TEST_ASSERT_EQUAL(0, circ_buff_set_policy(cb, CB_REJECT_NEW));
+	TEST_ASSERT_EQUAL(0, circ_buff_write(cb, data, 10));
+	TEST_ASSERT_EQUAL(3, circ_buff_write(cb, data, 10));
+	TEST_ASSERT_EQUAL(10, circ_buff_get_size(cb));
+	TEST_ASSERT_EQUAL(1, cb->stats.overflows);
+	TEST_ASSERT_EQUAL(10, cb->stats.rejectedBytes);
+	TEST_ASSERT_EQUAL(0, cb->stats.droppedBytes);
+
+	#ifndef CIRC_BUFF_SPSC
+
+	//Overwrite: just enough old bytes go
+	TEST_ASSERT_EQUAL(0, circ_buff_set_policy(cb, CB_OVERWRITE_OLDEST));
+	TEST_ASSERT_EQUAL(CB_OVERWROTE, circ_buff_write(cb, data, 10));
+	TEST_ASSERT_EQUAL(16, circ_buff_get_size(cb));
+	TEST_ASSERT_EQUAL(4, cb->stats.droppedBytes);
+	TEST_ASSERT_EQUAL(4, circ_buff_peak(cb, 0));
+
+	//Drop to frame: we need 4 bytes, the next HEADER is 6 bytes in
+	circ_buff_init(cb);
+	TEST_ASSERT_EQUAL(0, circ_buff_set_policy(cb, CB_DROP_TO_FRAME));
+	circ_buff_write(cb, data, 10);
+	TEST_ASSERT_EQUAL(CB_OVERWROTE, circ_buff_write(cb, data, 10));
+	TEST_ASSERT_EQUAL(14, circ_buff_get_size(cb));
+	TEST_ASSERT_EQUAL(6, cb->stats.droppedBytes);
+	TEST_ASSERT_EQUAL(HEADER, circ_buff_peak(cb, 0));
+	TEST_ASSERT_EQUAL(HEADER, circ_buff_peak(cb, 4));
+
+	//No frame start left: everything goes
+	circ_buff_move_head(cb, 14);
+	circ_buff_write(cb, data + 1, 5);
+	circ_buff_write(cb, data + 1, 5);
+	TEST_ASSERT_EQUAL(CB_OVERWROTE, circ_buff_write(cb, data + 1, 9));
+	TEST_ASSERT_EQUAL(9, circ_buff_get_size(cb));
+
+	#else
+
+	TEST_ASSERT_EQUAL(1, circ_buff_set_policy(cb, CB_OVERWRITE_OLDEST));
+
+	#endif	//CIRC_BUFF_SPSC
+
+	//High watermark: one call per crossing
+	circ_buff_init(cb);
+	TEST_ASSERT_EQUAL(0, cb->stats.overflows);
+	circ_buff_set_high_watermark(cb, 12, watermarkCallback);
+	watermarkCalls = 0;
+	circ_buff_write(cb, data, 10);
+	TEST_ASSERT_EQUAL(0, watermarkCalls);
+	circ_buff_write(cb, data, 3);
+	circ_buff_write(cb, data, 1);
+	TEST_ASSERT_EQUAL(1, watermarkCalls);
+	TEST_ASSERT_EQUAL(13, watermarkSize);
+	circ_buff_move_head(cb, 8);
+	circ_buff_write(cb, data, 8);
+	TEST_ASSERT_EQUAL(2, watermarkCalls);
+	TEST_ASSERT_EQUAL(2, cb->stats.highWatermarks);
+	TEST_ASSERT_EQUAL(14, cb->stats.peakSize);
+
+	//Same accounting for the zero-copy producer
+	circ_buff_init(cb);
+	watermarkCalls = 0;
+	circ_buff_acquire_write(cb, &ptr, &len);
+	memcpy(ptr, data, 10);
+	circ_buff_commit_write(cb, 10);
+	TEST_ASSERT_EQUAL(0, watermarkCalls);
+	circ_buff_acquire_write(cb, &ptr, &len);
+	memcpy(ptr, data, 5);
+	circ_buff_commit_write(cb, 5);
+	TEST_ASSERT_EQUAL(1, watermarkCalls);
+	TEST_ASSERT_EQUAL(15, watermarkSize);
+	TEST_ASSERT_EQUAL(1, cb->stats.highWatermarks);
+	TEST_ASSERT_EQUAL(15, cb->stats.peakSize);
+}
+
+#ifdef CIRC_BUFF_MIRROR
+//Double mapped storage: the same API, but every span is contiguous
+void test_buffer_circular_mirrored(void)
+{
+	circularBuffer_t circBuf;
+	circularBuffer_t* cb = &circBuf;
+	uint8_t data[200], out[200], *ptr;
+	uint16_t len;
+	int i, cap;
+
+	TEST_ASSERT_EQUAL(0, circ_buff_attach_mirrored(cb, 1000));
+	cap = circ_buff_get_capacity(cb);
+	TEST_ASSERT_TRUE(cap >= 1000);
+
+	for(i = 0; i < 200; i++) { data[i] = (uint8_t)(i * 7); }
+
+	//Park head and tail 50 bytes before the end of the pages:
+	for(i = 0; i < cap - 50; i += 100)
+	{
+		int n = (cap - 50 - i) < 100 ? (cap - 50 - i) : 100;
+		circ_buff_write(cb, data, n);
+		circ_buff_move_head(cb, n);
+	}
+
+	TEST_ASSERT_EQUAL(0, circ_buff_write(cb, data, 200));
+	TEST_ASSERT_EQUAL(cap - 50, circ_buff_index_of(cb, 0));
+
+	//The whole frame is one span, and the mirror aliases the start:
+	circ_buff_peek_contiguous(cb, &ptr, &len);
+	TEST_ASSERT_EQUAL(200, len);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(data, ptr, 200);
+	TEST_ASSERT_TRUE(cb->bytes[cap + 10] == cb->bytes[10]);
+
+	TEST_ASSERT_EQUAL(0, circ_buff_read_section(cb, out, 40, 100));
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(data + 40, out, 100);
+	TEST_ASSERT_EQUAL(99, circ_buff_search(cb, (uint8_t)(99 * 7), 0));
+
+	uint8_t checksum = 0;
+	for(i = 10; i < 150; i++) { checksum += data[i]; }
+	TEST_ASSERT_EQUAL(checksum, circ_buff_checksum(cb, 10, 150));
+
+	circ_buff_detach_mirrored(cb);
+	TEST_ASSERT_TRUE(cb->bytes == NULL);
+
+	//Plan's USB periph is mirrored once, storage given by the caller is kept:
+	MultiCommPeriph *usb = &comm_multi_periph[PORT_USB];
+	initMultiPeriph(usb, PORT_USB, SLAVE);
+	TEST_ASSERT_EQUAL(2 * (uint32_t)usb->circularBuff.capacity, usb->circularBuff.mapped);
+	ptr = usb->circularBuff.bytes;
+	initMultiPeriph(usb, PORT_USB, SLAVE);
+	TEST_ASSERT_TRUE(usb->circularBuff.bytes == ptr);
+
+	MultiCommPeriph other;
+	circ_buff_attach(&other.circularBuff, data, sizeof(data));
+	initMultiPeriph(&other, PORT_USB, SLAVE);
+	TEST_ASSERT_TRUE(other.circularBuff.bytes == data);
+}
+#endif	//CIRC_BUFF_MIRROR
+
 void test_flexsea_buffers(void)
 {
 	RUN_TEST(test_buffer_circular);
 	RUN_TEST(test_buffer_circular_alphabet);
 	RUN_TEST(test_buffer_circular_write_erase);
 	RUN_TEST(test_buffer_circular_search);
+	RUN_TEST(test_buffer_find_byte);
+	RUN_TEST(test_buffer_checksum8);
+	RUN_TEST(test_buffer_escape);
+	RUN_TEST(test_buffer_unescape);
+	RUN_TEST(test_buffer_circular_zero_copy);
+	RUN_TEST(test_buffer_circular_capacity);
+	RUN_TEST(test_buffer_circular_static_init);
+	RUN_TEST(test_buffer_circular_policies);
+	RUN_TEST(test_buffer_circular_search_sof);
+	#ifdef CIRC_BUFF_MIRROR
+	RUN_TEST(test_buffer_circular_mirrored);
+	#endif
 	RUN_TEST(test_buffer_circular_checksum);
+	#if defined(__linux__)
+	RUN_TEST(test_buffer_circular_spsc_stress);
+	#endif
 
 	fflush(stdout);
 }
@@ -6,11 +6,18 @@ extern "C" {
 #include "../inc/flexsea.h"
 #include "flexsea-comm_test-all.h"
 #include <flexsea_comm.h>
+#include <flexsea_payload.h>
 #include <flexsea_sys_def.h>
+#include <flexsea_comm_multi.h>
+#include <flexsea_multi_circbuff.h>
+#include <flexsea_multi_frame_packet_def.h>
 
 #include <time.h>
 #include <stdlib.h>
 
+//Storage of the circular buffers under test
+static uint8_t cbStorage[CB_BUF_LEN];
+
 //Definitions and variables used by some/all tests:
 uint8_t fakePayload[PAYLOAD_BUF_LEN];
 uint8_t fakeCommStr[COMM_STR_BUF_LEN];
@@ -210,7 +217,7 @@ void test_circ_unpack(void)
 	memset(fakeCommStr, 0, COMM_STR_BUF_LEN);
 
 	circularBuffer_t cb;
-	circ_buff_init(&cb);
+	circ_buff_attach(&cb, cbStorage, CB_BUF_LEN);
 
 	//Positive tests, it should find a comm str
 	int preOffsetMax;
@@ -273,12 +280,371 @@ void test_circ_unpack(void)
 	}
 }
 
+//Random payload that fits in a comm_str, including bytes that need escaping
+int fillFakeShortPayload(uint8_t* fakePayload)
+{
+	int index, len = 4 + rand() % 16;
+	for(index = 0; index < len; index++)
+	{
+		fakePayload[index] = (rand() % 4) ? rand() : HEADER + rand() % 2;
+	}
+	return len;
+}
+
+void test_circ_unpack_stream(void)
+{
+	circularBuffer_t cb;
+	CommDecoder decoder;
+	uint8_t tPacked[COMM_PERIPH_ARR_LEN];
+	uint8_t tUnpacked[COMM_PERIPH_ARR_LEN];
+	uint8_t noise[16];
+	int i, j, len, frameLen, noiseLen, written, chunk, result;
+
+	srand(time(NULL));
+	circ_buff_attach(&cb, cbStorage, CB_BUF_LEN);
+	resetCommDecoder(&decoder);
+
+	//Noise, then a frame fed in random chunks: nothing until the last byte
+	for(i = 0; i < 200; i++)
+	{
+		len = fillFakeShortPayload(fakePayload);
+		frameLen = comm_gen_str(fakePayload, fakeCommStr, len) + 1;
+		TEST_ASSERT_TRUE(frameLen > 1);
+
+		noiseLen = rand() % sizeof(noise);
+		for(j = 0; j < noiseLen; j++)
+		{
+			do { noise[j] = rand(); } while(noise[j] == HEADER);
+		}
+		circ_buff_write(&cb, noise, noiseLen);
+
+		written = 0;
+		result = 0;
+		while(written < frameLen)
+		{
+			TEST_ASSERT_EQUAL_MESSAGE(0, result, "Frame found before it was complete");
+			chunk = 1 + rand() % (frameLen - written);
+			circ_buff_write(&cb, fakeCommStr + written, chunk);
+			written += chunk;
+			result = unpack_payload_stream(&cb, &decoder, tPacked, tUnpacked);
+		}
+
+		TEST_ASSERT_EQUAL(noiseLen + frameLen, result);
+		for(j = 0; j < len; j++)
+		{
+			TEST_ASSERT_EQUAL_MESSAGE(fakePayload[j], tUnpacked[j], "Unpacked strings mismatch");
+		}
+		for(j = 0; j < frameLen; j++)
+		{
+			TEST_ASSERT_EQUAL_MESSAGE(fakeCommStr[j], tPacked[j], "Packed strings mismatch");
+		}
+		circ_buff_move_head(&cb, result);
+	}
+
+	//Bad checksum, then a valid frame: the valid one is found in one call
+	len = fillFakeShortPayload(fakePayload);
+	frameLen = comm_gen_str(fakePayload, fakeCommStr, len) + 1;
+	fakeCommStr[frameLen - 2] += 1;
+	circ_buff_write(&cb, fakeCommStr, frameLen);
+	fakeCommStr[frameLen - 2] -= 1;
+	circ_buff_write(&cb, fakeCommStr, frameLen);
+	result = unpack_payload_stream(&cb, &decoder, tPacked, tUnpacked);
+	TEST_ASSERT_EQUAL(2 * frameLen, result);
+	TEST_ASSERT_EQUAL(result, unpack_payload_cb(&cb, tPacked, tUnpacked));
+}
+
+void test_circ_unpack_batch(void)
+{
+	circularBuffer_t cb;
+	CommDecoder decoder;
+	CommFrame frames[8];
+	uint8_t payloads[6][COMM_STR_BUF_LEN], lens[6];
+	uint8_t tPacked[COMM_PERIPH_ARR_LEN];
+	uint8_t tUnpacked[COMM_PERIPH_ARR_LEN];
+	uint8_t noise[8];
+	int i, j, k, frameLen, ends[6], total = 0, n;
+
+	srand(time(NULL));
+	circ_buff_attach(&cb, cbStorage, CB_BUF_LEN);
+	resetCommDecoder(&decoder);
+
+	//A burst: 5 frames with noise between them, and the start of a 6th one
+	for(i = 0; i < 6; i++)
+	{
+		for(j = 0; j < (int)sizeof(noise); j++)
+		{
+			do { noise[j] = rand(); } while(noise[j] == HEADER);
+		}
+		circ_buff_write(&cb, noise, rand() % sizeof(noise));
+		total = circ_buff_get_size(&cb);
+
+		lens[i] = fillFakeShortPayload(payloads[i]);
+		frameLen = comm_gen_str(payloads[i], fakeCommStr, lens[i]) + 1;
+		circ_buff_write(&cb, fakeCommStr, (i < 5) ? frameLen : frameLen - 1);
+		ends[i] = total + frameLen;
+	}
+
+	n = unpack_payload_cb_batch(&cb, frames, 8);
+	TEST_ASSERT_EQUAL(5, n);
+	TEST_ASSERT_EQUAL(n, unpack_payload_stream_batch(&cb, &decoder, frames, 8));
+	for(i = 0; i < n; i++)
+	{
+		TEST_ASSERT_EQUAL(ends[i], COMM_FRAME_END(frames[i]));
+		unpack_payload_frame(&cb, &frames[i], tPacked, tUnpacked);
+		for(k = 0; k < lens[i]; k++)
+		{
+			TEST_ASSERT_EQUAL_MESSAGE(payloads[i][k], tUnpacked[k], "Unpacked strings mismatch");
+		}
+	}
+
+	//max is honored. Everything found is then consumed with one head move.
+	TEST_ASSERT_EQUAL(2, unpack_payload_cb_batch(&cb, frames, 2));
+	TEST_ASSERT_EQUAL(ends[1], COMM_FRAME_END(frames[1]));
+	circ_buff_move_head(&cb, ends[4]);
+
+	//The 6th frame completes later. Without new bytes, nothing changes.
+	TEST_ASSERT_EQUAL(0, unpack_payload_stream_batch(&cb, &decoder, frames, 8));
+	TEST_ASSERT_EQUAL(0, unpack_payload_stream_batch(&cb, &decoder, frames, 8));
+	circ_buff_write(&cb, &fakeCommStr[frameLen - 1], 1);
+	TEST_ASSERT_EQUAL(1, unpack_payload_stream_batch(&cb, &decoder, frames, 8));
+	TEST_ASSERT_EQUAL(ends[5] - ends[4], COMM_FRAME_END(frames[0]));
+}
+
+void test_frame_view(void)
+{
+	circularBuffer_t cb;
+	CommFrame frames[2];
+	CommFrameView view;
+	PacketWrapper pw;
+	uint8_t tPacked[COMM_PERIPH_ARR_LEN];
+	uint8_t tUnpacked[COMM_PERIPH_ARR_LEN];
+	int i, len, frameLen;
+
+	srand(time(NULL));
+	circ_buff_attach(&cb, cbStorage, CB_BUF_LEN);
+	memset(&pw, 0, sizeof(pw));
+
+	//Escape free and contiguous: the view points into the ring
+	len = 4 + rand() % 16;
+	for(i = 0; i < len; i++)
+	{
+		do { fakePayload[i] = rand(); } while(fakePayload[i] >= ESCAPE);
+	}
+	frameLen = comm_gen_str(fakePayload, fakeCommStr, len) + 1;
+	circ_buff_write(&cb, fakeCommStr, frameLen);
+	TEST_ASSERT_EQUAL(1, unpack_payload_cb_batch(&cb, frames, 2));
+	TEST_ASSERT_EQUAL(1, comm_frame_view(&cb, &frames[0], &view, tPacked, tUnpacked));
+	TEST_ASSERT_TRUE(view.cb == &cb);
+	TEST_ASSERT_TRUE(view.packed >= cb.bytes && view.packed < cb.bytes + CB_BUF_LEN);
+	TEST_ASSERT_EQUAL(frameLen, view.packedLen);
+	TEST_ASSERT_EQUAL(len, view.payloadLen);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(fakeCommStr, view.packed, frameLen);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(fakePayload, view.payload, len);
+	circ_buff_move_head(&cb, COMM_FRAME_END(frames[0]));
+
+	//With escapes: copied & unescaped
+	fakePayload[len / 2] = HEADER;
+	frameLen = comm_gen_str(fakePayload, fakeCommStr, len) + 1;
+	circ_buff_write(&cb, fakeCommStr, frameLen);
+	TEST_ASSERT_EQUAL(1, unpack_payload_cb_batch(&cb, frames, 2));
+	TEST_ASSERT_EQUAL(0, comm_frame_view(&cb, &frames[0], &view, tPacked, tUnpacked));
+	TEST_ASSERT_TRUE(view.cb == NULL && view.packed == tPacked && view.payload == tUnpacked);
+	TEST_ASSERT_EQUAL(len, view.payloadLen);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(fakePayload, view.payload, len);
+	circ_buff_move_head(&cb, COMM_FRAME_END(frames[0]));
+
+	//Contiguous, but less than PACKET_WRAPPER_LEN bytes readable after the
+	//payload (the handlers don't check its length): copied
+	fakePayload[len / 2] = 0;
+	frameLen = comm_gen_str(fakePayload, fakeCommStr, len) + 1;
+	while(circ_buff_index_of(&cb, 0) != CB_BUF_LEN - PACKET_WRAPPER_LEN)
+	{
+		circ_buff_write(&cb, fakePayload, 1);
+		circ_buff_move_head(&cb, 1);
+	}
+	circ_buff_write(&cb, fakeCommStr, frameLen);
+	TEST_ASSERT_EQUAL(1, unpack_payload_cb_batch(&cb, frames, 2));
+	TEST_ASSERT_EQUAL(0, comm_frame_view(&cb, &frames[0], &view, tPacked, tUnpacked));
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(fakePayload, view.payload, len);
+	circ_buff_move_head(&cb, COMM_FRAME_END(frames[0]));
+
+	//Payload too short for the header: not parsed
+	view.payloadLen = P_DATA1 - 1;
+	TEST_ASSERT_EQUAL(PARSE_DEFAULT, payload_parse_view(&pw, &view));
+
+	//Wrapping around the end of the array: copied
+	while(circ_buff_index_of(&cb, 0) != CB_BUF_LEN - frameLen / 2)
+	{
+		circ_buff_write(&cb, fakePayload, 1);
+		circ_buff_move_head(&cb, 1);
+	}
+	circ_buff_write(&cb, fakeCommStr, frameLen);
+	TEST_ASSERT_EQUAL(1, unpack_payload_cb_batch(&cb, frames, 2));
+	TEST_ASSERT_EQUAL(0, comm_frame_view(&cb, &frames[0], &view, tPacked, tUnpacked));
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(fakeCommStr, view.packed, frameLen);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(fakePayload, view.payload, len);
+}
+
+void test_packet_lengths(void)
+{
+	circularBuffer_t cb;
+	CommPeriph cp;
+	PacketWrapper in, out;
+	uint8_t tPacked[COMM_PERIPH_ARR_LEN];
+	uint8_t tUnpacked[COMM_PERIPH_ARR_LEN];
+	int i, len, frameLen;
+
+	srand(time(NULL));
+	circ_buff_attach(&cb, cbStorage, CB_BUF_LEN);
+	initCommPeriph(&cp, PORT_USB, SLAVE, tUnpacked, tPacked, &cb, &in, &out);
+
+	len = 4 + rand() % 16;
+	for(i = 0; i < len; i++) { fakePayload[i] = rand(); }
+	fakePayload[len / 2] = ESCAPE;
+	frameLen = comm_gen_str(fakePayload, fakeCommStr, len) + 1;
+	circ_buff_write(&cb, fakeCommStr, frameLen);
+
+	TEST_ASSERT_EQUAL(frameLen, unpack_payload_periph(&cp.rx));
+
+	//Only the frame (and at most BYTES of payload) is moved around
+	memset(in.unpaked, 0xAA, PACKET_WRAPPER_LEN);
+	memset(out.unpaked, 0x55, PACKET_WRAPPER_LEN);
+	fillPacketFromCommPeriph(&cp, &in);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(fakeCommStr, in.packed, frameLen);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(fakePayload, in.unpaked, len);
+	TEST_ASSERT_EQUAL(0xAA, in.unpaked[frameLen - 4]);
+
+	copyPacket(&in, &out, DOWNSTREAM);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(fakeCommStr, out.packed, frameLen);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(fakePayload, out.unpaked, len);
+	TEST_ASSERT_EQUAL(0x55, out.unpaked[frameLen - 4]);
+
+	//A wrapper filled by hand (no frame in packed[]) is copied whole
+	memset(in.packed, 0, PACKET_WRAPPER_LEN);
+	for(i = 0; i < PACKET_WRAPPER_LEN; i++) { in.unpaked[i] = i; }
+	copyPacket(&in, &out, DOWNSTREAM);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(in.unpaked, out.unpaked, PACKET_WRAPPER_LEN);
+}
+
+void test_comm_stats(void)
+{
+	circularBuffer_t cb;
+	CommPeriph cp;
+	PacketWrapper in, out;
+	CommCounters c;
+	uint8_t tPacked[COMM_PERIPH_ARR_LEN];
+	uint8_t tUnpacked[COMM_PERIPH_ARR_LEN];
+	uint8_t garbage[5] = {1, 2, 3, 4, 5};
+	int i, len, lenA, lenB, lenC;
+
+	srand(time(NULL));
+	circ_buff_attach(&cb, cbStorage, CB_BUF_LEN);
+	initCommPeriph(&cp, PORT_USB, SLAVE, tUnpacked, tPacked, &cb, &in, &out);
+
+	//Garbage, frame A (one escape), frame B (bad checksum), frame C:
+	len = 4 + rand() % 16;
+	for(i = 0; i < len; i++)
+	{
+		do { fakePayload[i] = rand(); } while(fakePayload[i] >= ESCAPE);
+	}
+	circ_buff_write(&cb, garbage, sizeof(garbage));
+	fakePayload[0] = FOOTER;
+	lenA = comm_gen_str(fakePayload, fakeCommStr, len) + 1;
+	circ_buff_write(&cb, fakeCommStr, lenA);
+	fakePayload[0] = 0;
+	lenB = comm_gen_str(fakePayload, fakeCommStr, len) + 1;
+	fakeCommStr[lenB - 2]++;
+	circ_buff_write(&cb, fakeCommStr, lenB);
+	lenC = comm_gen_str(fakePayload, fakeCommStr, len) + 1;
+	circ_buff_write(&cb, fakeCommStr, lenC);
+
+	for(i = 0; i < 3; i++)
+	{
+		uint16_t n = unpack_payload_periph(&cp.rx);
+		if(n) { circ_buff_move_head(&cb, n); }
+	}
+
+	TEST_ASSERT_EQUAL(0, commStatsSnapshot(&cp.rx.stats, &cb, &c));
+	TEST_ASSERT_EQUAL(2, c.frames);
+	TEST_ASSERT_EQUAL(lenA + lenC, c.bytes);
+	TEST_ASSERT_EQUAL(1, c.escapes);
+	TEST_ASSERT_EQUAL(1, c.checksumErrors);
+	TEST_ASSERT_EQUAL(0, c.framingErrors);
+	TEST_ASSERT_EQUAL(sizeof(garbage) + lenB, c.resyncBytes);
+	TEST_ASSERT_EQUAL(0, c.overflowBytes);
+
+	//Nothing counted on the TX side:
+	TEST_ASSERT_EQUAL(0, commStatsSnapshot(&cp.tx.stats, NULL, &c));
+	TEST_ASSERT_EQUAL(0, c.frames);
+}
+
+//Frame 'frameId' (of 0..last) of multi packet 'packetId', 'bytes' of data.
+//Returns its length.
+static uint16_t fakeMultiFrame(uint8_t *frame, uint8_t packetId, uint8_t frameId, \
+								uint8_t last, uint8_t bytes)
+{
+	uint8_t checksum = 0;
+	uint16_t i;
+
+	frame[0] = MULTI_SOF;
+	frame[1] = bytes;
+	frame[2] = MULTI_GENINFO(packetId, frameId, last);
+	for(i = 0; i < bytes; i++)
+	{
+		frame[MULTI_DATA_OFFSET + i] = 0x11;
+		checksum += 0x11;
+	}
+	frame[MULTI_DATA_OFFSET + bytes] = checksum;
+	frame[MULTI_DATA_OFFSET + bytes + 1] = MULTI_EOF;
+	return bytes + MULTI_NUM_OVERHEAD_BYTES_FRAME;
+}
+
+void test_multi_oversize_frame(void)
+{
+	static uint8_t storage[1024];
+	static MultiWrapper in;
+	circularBuffer_t cb;
+	uint8_t frame[300];
+	uint16_t n, len;
+	uint8_t i;
+
+	memset(&in, 0, sizeof(in));
+	circ_buff_attach(&cb, storage, sizeof(storage));
+
+	//3 frames of 250 bytes don't fit in unpacked[]: the last one is dropped
+	for(i = 0; i < 3; i++)
+	{
+		len = fakeMultiFrame(frame, 1, i, 2, 250);
+		circ_buff_write(&cb, frame, len);
+		n = unpack_multi_payload_cb(&cb, &in);
+		TEST_ASSERT_EQUAL(len, n);
+		circ_buff_move_head(&cb, n);
+	}
+
+	TEST_ASSERT_EQUAL(0, in.isMultiComplete);
+	TEST_ASSERT_EQUAL(0, in.frameMap);
+	TEST_ASSERT_EQUAL(1, in.stats.counters.multiDrops);
+
+	//The next packet is received normally
+	len = fakeMultiFrame(frame, 2, 0, 0, 10);
+	circ_buff_write(&cb, frame, len);
+	TEST_ASSERT_EQUAL(len, unpack_multi_payload_cb(&cb, &in));
+	TEST_ASSERT_EQUAL(1, in.isMultiComplete);
+	TEST_ASSERT_EQUAL(10, in.unpackedIdx);
+}
+
 void test_flexsea_comm(void)
 {
 	RUN_TEST(test_comm_gen_str_simple);
 	RUN_TEST(test_comm_gen_str_tooLong1);
 	RUN_TEST(test_comm_gen_str_tooLong2);
 	RUN_TEST(test_circ_unpack);
+	RUN_TEST(test_circ_unpack_stream);
+	RUN_TEST(test_circ_unpack_batch);
+	RUN_TEST(test_frame_view);
+	RUN_TEST(test_packet_lengths);
+	RUN_TEST(test_comm_stats);
+	RUN_TEST(test_multi_oversize_frame);
 
 	fflush(stdout);
 }
@@ -0,0 +1,181 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+#include "../inc/flexsea.h"
+#include "flexsea-comm_test-all.h"
+#include <flexsea_board.h>
+#include <flexsea_interface.h>
+#include <flexsea_sim_link.h>
+
+#define SIM_TEST_CMD			10
+#define SIM_TEST_CB_LEN			2048
+
+static uint8_t storageA[SIM_TEST_CB_LEN], storageB[SIM_TEST_CB_LEN];
+static MultiCommPeriph periphA, periphB;
+static SimLink link;
+static uint16_t received = 0;
+static uint8_t lastByte = 0;
+
+static void sim_test_handler(uint8_t *msgBuf, MultiPacketInfo *info, uint8_t *responseBuf, \
+							uint16_t* responseLen)
+{
+	(void)info;
+	(void)responseBuf;
+	(void)responseLen;
+	received++;
+	lastByte = msgBuf[0];
+}
+
+static void sim_test_init(const SimLinkConfig *config)
+{
+	circ_buff_attach(&periphA.circularBuff, storageA, SIM_TEST_CB_LEN);
+	circ_buff_attach(&periphB.circularBuff, storageB, SIM_TEST_CB_LEN);
+	initMultiPeriph(&periphA, PORT_USB, MASTER);
+	initMultiPeriph(&periphB, PORT_USB, SLAVE);
+	simLinkInit(&link, &periphA, &periphB, config);
+	flexsea_multipayload_ptr[SIM_TEST_CMD][RX_PTYPE_REPLY] = sim_test_handler;
+	received = 0;
+}
+
+//Packs a request with 'len' bytes of data (first one: 'first') in A's out
+static void sim_test_pack(uint8_t first, uint16_t len)
+{
+	uint16_t i;
+
+	setMsgInfo(periphA.out.unpacked, 0, getBoardID(), SIM_TEST_CMD, RX_PTYPE_READ, 0);
+	for(i = 0; i < len; i++) { periphA.out.unpacked[MP_DATA1 + i] = first + i; }
+	periphA.out.unpackedIdx = MULTI_PACKET_OVERHEAD + len;
+	periphA.out.currentMultiPacket = first & 0x03;
+	packMultiPacket(&periphA.out);
+}
+
+//Sends 'packets' requests from A to B, one frame per 10us step. Returns the
+//number B parsed.
+static uint16_t sim_test_exchange(uint16_t packets, uint16_t len)
+{
+	uint16_t sent = 0, steps;
+
+	for(steps = 0; steps < 60000; steps++)
+	{
+		if(periphA.out.isMultiComplete || !periphA.out.frameMap)
+		{
+			if(sent == packets && link.ch[0].count == 0) { break; }
+			if(sent < packets) { sim_test_pack(sent++, len); }
+		}
+
+		simLinkTransmit(&link, &periphA);
+		simLinkAdvance(&link, 10);
+		receiveFxPacketByPeriph(&periphB);
+	}
+
+	return received;
+}
+
+void test_sim_link_delivery(void)
+{
+	//4 frames, 10 bits per byte at 921600 baud:
+	const uint16_t len = 500;
+	uint32_t wire = 0, i;
+
+	sim_test_init(&simLinkRs485);
+	sim_test_pack(7, len);
+	for(i = 0; i < MAX_FRAMES_PER_MULTI_PACKET; i++)
+	{
+		if(periphA.out.frameMap & (1 << i)) { wire += SIZE_OF_MULTIFRAME(periphA.out.packed[i]); }
+	}
+
+	//One frame per call, and only when the line is free:
+	TEST_ASSERT_EQUAL(0, simLinkTransmit(&link, &periphA));
+	TEST_ASSERT_EQUAL(1, simLinkTransmit(&link, &periphA));
+	while(!periphA.out.isMultiComplete)
+	{
+		simLinkAdvance(&link, 1);
+		simLinkTransmit(&link, &periphA);
+	}
+
+	//Nothing before the last byte is on the wire:
+	simLinkRun(&link, (uint64_t)wire * 10850 - 20000);
+	receiveFxPacketByPeriph(&periphB);
+	TEST_ASSERT_EQUAL(0, received);
+
+	simLinkRun(&link, (uint64_t)wire * 10850 + 10000);
+	receiveFxPacketByPeriph(&periphB);
+	TEST_ASSERT_EQUAL(1, received);
+	TEST_ASSERT_EQUAL(7, lastByte);
+	TEST_ASSERT_EQUAL(wire, link.ch[0].stats.bytesDelivered);
+	TEST_ASSERT_EQUAL(0, link.ch[1].stats.writes);
+
+	//Nothing left to send:
+	TEST_ASSERT_EQUAL((uint8_t)-1, simLinkTransmit(&link, &periphA));
+}
+
+void test_sim_link_impairments(void)
+{
+	SimLinkConfig config = simLinkRs485;
+	SimLinkStats first;
+	uint16_t parsed;
+
+	//Everything lost:
+	config.writeLoss = 1;
+	sim_test_init(&config);
+	TEST_ASSERT_EQUAL(0, sim_test_exchange(10, 40));
+	TEST_ASSERT_EQUAL(10, link.ch[0].stats.writes);
+	TEST_ASSERT_EQUAL(10, link.ch[0].stats.writesLost);
+	TEST_ASSERT_EQUAL(0, link.ch[0].stats.bytesDelivered);
+
+	//Bit errors and inserted bytes: some packets lost, the others get through
+	config.writeLoss = 0;
+	config.bitErrorRate = 1e-4;
+	config.insertRate = 1e-3;
+	config.seed = 1234;
+	sim_test_init(&config);
+	parsed = sim_test_exchange(200, 40);
+	first = link.ch[0].stats;
+	TEST_ASSERT_TRUE(first.bitsFlipped > 0);
+	TEST_ASSERT_TRUE(first.bytesInserted > 0);
+	TEST_ASSERT_TRUE(parsed < 200);
+	TEST_ASSERT_TRUE(parsed > 150);
+	TEST_ASSERT_EQUAL(first.bytesSent + first.bytesInserted, first.bytesDelivered);
+
+	//Same seed, same run:
+	sim_test_init(&config);
+	TEST_ASSERT_EQUAL(parsed, sim_test_exchange(200, 40));
+	TEST_ASSERT_EQUAL(first.bitsFlipped, link.ch[0].stats.bitsFlipped);
+	TEST_ASSERT_EQUAL(first.bytesInserted, link.ch[0].stats.bytesInserted);
+
+	flexsea_multipayload_ptr[SIM_TEST_CMD][RX_PTYPE_REPLY] = NULL;
+}
+
+//Frames cut anywhere (DMA chunks, coalesced USB transfers), even in their
+//header, are put back together
+void test_sim_link_split_frames(void)
+{
+	SimLinkConfig config = simLinkRs485;
+	uint16_t chunk;
+
+	for(chunk = 1; chunk <= 7; chunk++)
+	{
+		config.rxChunk = chunk;
+		sim_test_init(&config);
+		TEST_ASSERT_EQUAL_MESSAGE(40, sim_test_exchange(40, 40), "40B packets");
+		sim_test_init(&config);
+		TEST_ASSERT_EQUAL_MESSAGE(10, sim_test_exchange(10, 300), "300B packets");
+	}
+
+	flexsea_multipayload_ptr[SIM_TEST_CMD][RX_PTYPE_REPLY] = NULL;
+}
+
+void test_flexsea_sim_link(void)
+{
+	RUN_TEST(test_sim_link_delivery);
+	RUN_TEST(test_sim_link_impairments);
+	RUN_TEST(test_sim_link_split_frames);
+
+	fflush(stdout);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,410 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+#include "../inc/flexsea.h"
+#include "flexsea-comm_test-all.h"
+#include <flexsea_board.h>
+#include <flexsea_comm_multi.h>
+#include <flexsea_interface.h>
+#include <flexsea_transport.h>
+
+#ifdef FX_TRANSPORT_FD
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+//Fake transport: records what it sends, busy after 'budget' transfers
+static uint8_t fakeWire[4096];
+static uint16_t fakeWireLen = 0, fakeTransfers = 0, fakeBudget = 0;
+
+static uint8_t fake_send(void *ctx, const uint8_t *data, uint16_t len)
+{
+	(void)ctx;
+	memcpy(fakeWire + fakeWireLen, data, len);
+	fakeWireLen += len;
+	fakeTransfers++;
+	return 0;
+}
+
+static uint8_t fake_send_vectored(void *ctx, const FxIoVec *iov, uint8_t count)
+{
+	uint8_t i;
+	(void)ctx;
+	for(i = 0; i < count; i++)
+	{
+		memcpy(fakeWire + fakeWireLen, iov[i].data, iov[i].len);
+		fakeWireLen += iov[i].len;
+	}
+	fakeTransfers++;
+	return count;
+}
+
+static uint8_t fake_ready(void *ctx)
+{
+	(void)ctx;
+	return fakeTransfers < fakeBudget;
+}
+
+//Packs 'len' bytes in the out wrapper of p. Returns the number of frames.
+static uint8_t transport_test_pack(MultiCommPeriph *p, uint16_t len)
+{
+	uint16_t i;
+	uint8_t n = 0;
+
+	setMsgInfo(p->out.unpacked, 0, getBoardID(), 10, RX_PTYPE_READ, 0);
+	for(i = 0; i < len; i++) { p->out.unpacked[MP_DATA1 + i] = i & 0x7F; }
+	p->out.unpackedIdx = MULTI_PACKET_OVERHEAD + len;
+	packMultiPacket(&p->out);
+
+	for(i = 0; i < MAX_FRAMES_PER_MULTI_PACKET; i++) { n += (p->out.frameMap >> i) & 1; }
+	return n;
+}
+
+void test_transport_bind(void)
+{
+	FxTransport t = {fake_send, NULL, fake_ready, 0, NULL};
+	MultiCommPeriph *cp = &comm_multi_periph[PORT_USB];
+	uint16_t expected = 0;
+	uint8_t frames, i;
+
+	fakeWireLen = fakeTransfers = 0;
+	fakeBudget = 2;
+	fxTransportBind(PORT_USB, &t);
+	frames = transport_test_pack(cp, 500);
+	TEST_ASSERT_EQUAL(4, frames);
+
+	//One frame per call, until the transport is busy:
+	TEST_ASSERT_EQUAL(0, transmitFxPacket(PORT_USB));
+	TEST_ASSERT_EQUAL(0, transmitFxPacket(PORT_USB));
+	TEST_ASSERT_EQUAL(1, transmitFxPacket(PORT_USB));
+	fakeBudget = 10;
+	TEST_ASSERT_EQUAL(0, transmitFxPacket(PORT_USB));
+	TEST_ASSERT_EQUAL(0, transmitFxPacket(PORT_USB));
+	TEST_ASSERT_EQUAL((uint8_t)-1, transmitFxPacket(PORT_USB));
+	TEST_ASSERT_EQUAL(1, cp->out.isMultiComplete);
+
+	for(i = 0; i < frames; i++)
+	{
+		TEST_ASSERT_EQUAL_UINT8_ARRAY(cp->out.packed[i], fakeWire + expected, \
+									SIZE_OF_MULTIFRAME(cp->out.packed[i]));
+		expected += SIZE_OF_MULTIFRAME(cp->out.packed[i]);
+	}
+	TEST_ASSERT_EQUAL(expected, fakeWireLen);
+
+	//Unbound: the frames stay pending
+	fxTransportBind(PORT_USB, NULL);
+	transport_test_pack(cp, 40);
+	TEST_ASSERT_EQUAL(!FX_TRANSPORT_UNBOUND_SENT, transmitFxPacket(PORT_USB));
+	cp->out.frameMap = 0;
+}
+
+void test_transport_vectored(void)
+{
+	FxTransport t = {fake_send, NULL, fake_ready, 0, NULL};
+	uint8_t a[10], b[20], c[30];
+	FxIoVec iov[3] = {{a, sizeof(a)}, {b, sizeof(b)}, {c, sizeof(c)}};
+
+	//No vectored send: one transfer per buffer, while ready
+	fakeWireLen = fakeTransfers = 0;
+	fakeBudget = 2;
+	TEST_ASSERT_EQUAL(2, fxTransportSendVectored(&t, iov, 3));
+	TEST_ASSERT_EQUAL(30, fakeWireLen);
+
+	//Vectored: one transfer, limited to maxChunk (buffers are never split)
+	t.sendVectored = fake_send_vectored;
+	t.maxChunk = 40;
+	fakeWireLen = fakeTransfers = 0;
+	TEST_ASSERT_EQUAL(2, fxTransportSendVectored(&t, iov, 3));
+	TEST_ASSERT_EQUAL(30, fakeWireLen);
+	TEST_ASSERT_EQUAL(1, fakeTransfers);
+	TEST_ASSERT_EQUAL(1, fxTransportSendVectored(&t, iov + 2, 1));
+	TEST_ASSERT_EQUAL(60, fakeWireLen);
+
+	//Too long for a single transfer:
+	t.maxChunk = 20;
+	TEST_ASSERT_EQUAL(0, fxTransportSendVectored(&t, iov + 2, 1));
+}
+
+void test_transport_burst(void)
+{
+	FxTransport t = {fake_send, fake_send_vectored, fake_ready, 0, NULL};
+	MultiCommPeriph *cp = &comm_multi_periph[PORT_USB];
+	uint16_t expected = 0;
+	uint8_t frames, sent, i;
+
+	//All the frames in one transfer:
+	fakeWireLen = fakeTransfers = 0;
+	fakeBudget = 10;
+	fxTransportBind(PORT_USB, &t);
+	frames = transport_test_pack(cp, 500);
+	TEST_ASSERT_EQUAL(0, transmitFxPacketBurst(PORT_USB, &sent));
+	TEST_ASSERT_EQUAL(frames, sent);
+	TEST_ASSERT_EQUAL(1, fakeTransfers);
+	TEST_ASSERT_EQUAL(1, cp->out.isMultiComplete);
+	for(i = 0; i < frames; i++)
+	{
+		TEST_ASSERT_EQUAL_UINT8_ARRAY(cp->out.packed[i], fakeWire + expected, \
+									SIZE_OF_MULTIFRAME(cp->out.packed[i]));
+		expected += SIZE_OF_MULTIFRAME(cp->out.packed[i]);
+	}
+	TEST_ASSERT_EQUAL(expected, fakeWireLen);
+	TEST_ASSERT_EQUAL((uint8_t)-1, transmitFxPacketBurst(PORT_USB, &sent));
+	TEST_ASSERT_EQUAL(0, sent);
+
+	//Frame by frame, busy after 2: partial progress
+	t.sendVectored = NULL;
+	fxTransportBind(PORT_USB, &t);
+	fakeWireLen = fakeTransfers = 0;
+	fakeBudget = 2;
+	transport_test_pack(cp, 500);
+	TEST_ASSERT_EQUAL(1, transmitFxPacketBurst(PORT_USB, &sent));
+	TEST_ASSERT_EQUAL(2, sent);
+	TEST_ASSERT_EQUAL(0, cp->out.isMultiComplete);
+	fakeBudget = 10;
+	TEST_ASSERT_EQUAL(0, transmitFxPacketBurst(PORT_USB, &sent));
+	TEST_ASSERT_EQUAL(frames - 2, sent);
+	TEST_ASSERT_EQUAL(expected, fakeWireLen);
+
+	fxTransportBind(PORT_USB, NULL);
+}
+
+void test_transport_coalesce(void)
+{
+	FxTransport lower = {fake_send, NULL, fake_ready, 0, NULL}, t;
+	FxCoalescer co;
+	MultiCommPeriph *cp = &comm_multi_periph[PORT_USB];
+	uint8_t expected[FX_COALESCE_BUF_LEN * 2];
+	uint16_t frameLen, i, n = 0;
+
+	fakeWireLen = fakeTransfers = 0;
+	fakeBudget = 100;
+	fxCoalescerInit(&co, &lower, 150, 500);
+	TEST_ASSERT_EQUAL(2 * FX_USB_PACKET_SIZE, co.threshold);
+	fxCoalescerTransport(&co, &t);
+	fxCoalescerPoll(&co, 0);
+
+	//Frames are kept until 128 bytes wait, then whole USB packets go:
+	for(i = 0; i < 3; i++)
+	{
+		transport_test_pack(cp, 40);
+		frameLen = SIZE_OF_MULTIFRAME(cp->out.packed[0]);
+		memcpy(expected + n, cp->out.packed[0], frameLen);
+		n += frameLen;
+		TEST_ASSERT_EQUAL(0, transmitFxPacketBurstByPeriph(cp, &t, NULL));
+	}
+	TEST_ASSERT_TRUE(n > 128 && n < 192);
+	TEST_ASSERT_EQUAL(1, fakeTransfers);
+	TEST_ASSERT_EQUAL(128, fakeWireLen);
+	TEST_ASSERT_EQUAL(n - 128, co.len);
+
+	//The rest goes at the deadline:
+	TEST_ASSERT_EQUAL(0, fxCoalescerPoll(&co, 499));
+	TEST_ASSERT_EQUAL(1, fakeTransfers);
+	TEST_ASSERT_EQUAL(0, fxCoalescerPoll(&co, 500));
+	TEST_ASSERT_EQUAL(2, fakeTransfers);
+	TEST_ASSERT_EQUAL(0, co.len);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, fakeWire, n);
+	TEST_ASSERT_EQUAL(n, co.bytes);
+
+	//Lower transport busy: fills up, then the frames stay pending
+	fakeBudget = fakeTransfers;
+	for(i = 0; i < 100; i++)
+	{
+		transport_test_pack(cp, 40);
+		if(transmitFxPacketBurstByPeriph(cp, &t, NULL)) { break; }
+	}
+	TEST_ASSERT_TRUE(i < 100);
+	TEST_ASSERT_TRUE(co.len + SIZE_OF_MULTIFRAME(cp->out.packed[0]) > FX_COALESCE_BUF_LEN);
+	TEST_ASSERT_EQUAL(1, fxCoalescerPoll(&co, 2000));
+	fakeBudget = 100;
+	TEST_ASSERT_EQUAL(0, transmitFxPacketBurstByPeriph(cp, &t, NULL));
+	TEST_ASSERT_EQUAL(0, fxCoalescerFlush(&co));
+	TEST_ASSERT_EQUAL(0, co.len);
+	TEST_ASSERT_EQUAL(co.bytes, fakeWireLen);
+}
+
+//Packs 'len' bytes (first one: 'first') as packet 'id' in w, like a reply
+static void transport_test_build(MultiWrapper *w, uint8_t id, uint8_t first, uint16_t len)
+{
+	uint16_t i;
+
+	setMsgInfo(w->unpacked, 0, getBoardID(), 10, RX_PTYPE_READ, 0);
+	for(i = 0; i < len; i++) { w->unpacked[MP_DATA1 + i] = (first + i) & 0x7F; }
+	w->unpackedIdx = MULTI_PACKET_OVERHEAD + len;
+	w->currentMultiPacket = id;
+}
+
+//Appends the frames of w to buf, returns the new length
+static uint16_t transport_test_frames(MultiWrapper *w, uint8_t *buf, uint16_t n)
+{
+	uint8_t i;
+
+	packMultiPacket(w);
+	for(i = 0; i < MAX_FRAMES_PER_MULTI_PACKET; i++)
+	{
+		if(!(w->frameMap & (1 << i))) { continue; }
+		memcpy(buf + n, w->packed[i], SIZE_OF_MULTIFRAME(w->packed[i]));
+		n += SIZE_OF_MULTIFRAME(w->packed[i]);
+	}
+	return n;
+}
+
+void test_transport_queue(void)
+{
+	FxTransport t = {fake_send, NULL, fake_ready, 0, NULL};
+	MultiCommPeriph *cp = &comm_multi_periph[PORT_USB];
+	static MultiWrapper ref, fwd;
+	static uint8_t expected[sizeof(fakeWire)];
+	uint16_t n = 0, i;
+	uint8_t sent;
+
+	initMultiPeriph(cp, PORT_USB, SLAVE);
+	fxTransportBind(PORT_USB, &t);
+	fakeWireLen = fakeTransfers = 0;
+	fakeBudget = 100;
+
+	//Idle port: packed straight in out, ready to go
+	transport_test_build(&cp->out, 1, 0, 500);
+	TEST_ASSERT_EQUAL(0, queueMultiPacket(cp, &cp->out));
+	TEST_ASSERT_EQUAL(0, cp->outQueue.count);
+	TEST_ASSERT_EQUAL(0, transmitFxPacket(PORT_USB));
+	transport_test_build(&ref, 1, 0, 500);
+	n = transport_test_frames(&ref, expected, n);
+
+	//The next reply is built and packed while the first one is being sent,
+	//then a packet forwarded from another port:
+	transport_test_build(&cp->out, 2, 50, 40);
+	TEST_ASSERT_EQUAL(0, queueMultiPacket(cp, &cp->out));
+	transport_test_build(&fwd, 3, 90, 300);
+	TEST_ASSERT_EQUAL(0, queueMultiPacket(cp, &fwd));
+	TEST_ASSERT_EQUAL(2, cp->outQueue.count);
+	transport_test_build(&ref, 2, 50, 40);
+	n = transport_test_frames(&ref, expected, n);
+	transport_test_build(&ref, 3, 90, 300);
+	n = transport_test_frames(&ref, expected, n);
+
+	//Full: dropped
+	TEST_ASSERT_EQUAL(1, queueMultiPacket(cp, &fwd));
+	TEST_ASSERT_EQUAL(1, cp->outQueue.dropped);
+
+	//Everything goes out, in order and intact:
+	for(i = 0; i < 20 && transmitFxPacket(PORT_USB) == 0; i++) {}
+	TEST_ASSERT_EQUAL(0, cp->outQueue.count);
+	TEST_ASSERT_EQUAL(n, fakeWireLen);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, fakeWire, n);
+
+	//Burst: the packet being sent and the queued ones, in one call
+	fakeWireLen = 0;
+	transport_test_build(&cp->out, 0, 0, 300);
+	queueMultiPacket(cp, &cp->out);
+	transport_test_build(&cp->out, 1, 0, 300);
+	queueMultiPacket(cp, &cp->out);
+	transport_test_build(&cp->out, 2, 0, 40);
+	queueMultiPacket(cp, &cp->out);
+	TEST_ASSERT_EQUAL(0, transmitFxPacketBurst(PORT_USB, &sent));
+	TEST_ASSERT_EQUAL(3 + 3 + 1, sent);
+	TEST_ASSERT_EQUAL((uint8_t)-1, transmitFxPacketBurst(PORT_USB, &sent));
+
+	fxTransportBind(PORT_USB, NULL);
+}
+
+static void transport_test_handler(uint8_t *msgBuf, MultiPacketInfo *info, uint8_t *responseBuf, \
+									uint16_t* responseLen)
+{
+	(void)info;
+	memset(responseBuf, msgBuf[0], 30);
+	*responseLen = 30;
+}
+
+//Two requests parsed in one call: both replies go out
+void test_transport_replies(void)
+{
+	FxTransport t = {fake_send, NULL, fake_ready, 0, NULL};
+	MultiCommPeriph *cp = &comm_multi_periph[PORT_USB];
+	static MultiWrapper req;
+	uint8_t requests[2 * PACKET_WRAPPER_LEN];
+	uint16_t n;
+
+	initMultiPeriph(cp, PORT_USB, SLAVE);
+	fxTransportBind(PORT_USB, &t);
+	flexsea_multipayload_ptr[10][RX_PTYPE_READ] = transport_test_handler;
+	flexsea_multipayload_ptr[10][RX_PTYPE_REPLY] = transport_test_handler;
+	fakeWireLen = fakeTransfers = 0;
+	fakeBudget = 100;
+
+	transport_test_build(&req, 0, 0x11, 10);
+	n = transport_test_frames(&req, requests, 0);
+	transport_test_build(&req, 1, 0x22, 10);
+	n = transport_test_frames(&req, requests, n);
+	copyIntoMultiPacket(cp, requests, n);
+
+	TEST_ASSERT_EQUAL(2, receiveFxPacket(PORT_USB));
+	TEST_ASSERT_EQUAL(1, cp->outQueue.count);
+	while(transmitFxPacket(PORT_USB) == 0) {}
+
+	//One frame each, the first reply intact:
+	TEST_ASSERT_EQUAL(2, fakeTransfers);
+	n = SIZE_OF_MULTIFRAME(fakeWire);
+	TEST_ASSERT_EQUAL(0x11, fakeWire[MULTI_DATA_OFFSET + MP_DATA1]);
+	TEST_ASSERT_EQUAL(0x22, fakeWire[n + MULTI_DATA_OFFSET + MP_DATA1]);
+
+	flexsea_multipayload_ptr[10][RX_PTYPE_READ] = NULL;
+	flexsea_multipayload_ptr[10][RX_PTYPE_REPLY] = NULL;
+	fxTransportBind(PORT_USB, NULL);
+}
+
+#ifdef FX_TRANSPORT_FD
+
+void test_transport_fd(void)
+{
+	FxTransport t;
+	MultiCommPeriph *cp = &comm_multi_periph[PORT_USB];
+	uint8_t rx[1024];
+	int sv[2];
+	ssize_t n;
+	uint16_t expected = 0;
+	uint8_t frames, i;
+
+	TEST_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+	fxTransportFd(&t, sv[0]);
+	fxTransportBind(PORT_USB, &t);
+
+	frames = transport_test_pack(cp, 300);
+	while(transmitFxPacket(PORT_USB) == 0) {}
+
+	n = read(sv[1], rx, sizeof(rx));
+	for(i = 0; i < frames; i++)
+	{
+		TEST_ASSERT_EQUAL_UINT8_ARRAY(cp->out.packed[i], rx + expected, \
+									SIZE_OF_MULTIFRAME(cp->out.packed[i]));
+		expected += SIZE_OF_MULTIFRAME(cp->out.packed[i]);
+	}
+	TEST_ASSERT_EQUAL(expected, n);
+
+	fxTransportBind(PORT_USB, NULL);
+	close(sv[0]);
+	close(sv[1]);
+}
+
+#endif	//FX_TRANSPORT_FD
+
+void test_flexsea_transport(void)
+{
+	RUN_TEST(test_transport_bind);
+	RUN_TEST(test_transport_vectored);
+	RUN_TEST(test_transport_burst);
+	RUN_TEST(test_transport_coalesce);
+	RUN_TEST(test_transport_queue);
+	RUN_TEST(test_transport_replies);
+	#ifdef FX_TRANSPORT_FD
+	RUN_TEST(test_transport_fd);
+	#endif
+
+	fflush(stdout);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,80 @@
+/****************************************************************************
+	[Project] FlexSEA: Flexible & Scalable Electronics Architecture
+	[Sub-project] 'flexsea-comm' Communication stack
+	Copyright (C) 2016 Dephy, Inc. <http://dephy.com/>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************
+	[Lead developper] Jean-Francois (JF) Duval, jfduval at dephy dot com.
+	[Origin] Based on Jean-Francois Duval's work at the MIT Media Lab
+	Biomechatronics research group <http://biomech.media.mit.edu/>
+	[Contributors]
+*****************************************************************************
+	[This file] flexsea_log_decode: binary log to text (host tool)
+*****************************************************************************
+	[Change log] (Convention: YYYY-MM-DD | author | comment)
+	* 2026-10-17 | agent | Initial release
+	*
+****************************************************************************/
+
+//Turns a binary log (FxLogRecord dump, see fx_log_read()) into text. It has
+//to be built from the same flexsea-comm version as the firmware:
+//	gcc -DBOARD_TYPE_FLEXSEA_PLAN -I../inc -I<log.h dir> flexsea_log_decode.c
+//		../src/flexsea_log.c -o flexsea_log_decode -lpthread
+//Usage: flexsea_log_decode <log.bin> [log.txt]
+
+#include <stdio.h>
+#include "flexsea_log.h"
+
+int main(int argc, char *argv[])
+{
+	FILE *in = NULL, *out = stdout;
+	int n = 0;
+
+	if(argc < 2)
+	{
+		fprintf(stderr, "Usage: %s <log.bin> [log.txt]\n", argv[0]);
+		return 1;
+	}
+
+	in = fopen(argv[1], "rb");
+	if(!in)
+	{
+		fprintf(stderr, "Can't open %s\n", argv[1]);
+		return 1;
+	}
+
+	if(argc > 2)
+	{
+		out = fopen(argv[2], "w");
+		if(!out)
+		{
+			fprintf(stderr, "Can't open %s\n", argv[2]);
+			fclose(in);
+			return 1;
+		}
+	}
+
+	n = fx_log_decode(in, out);
+	fclose(in);
+	if(out != stdout) { fclose(out); }
+
+	if(n < 0)
+	{
+		fprintf(stderr, "Unknown message ids, wrong flexsea-comm version?\n");
+		return 2;
+	}
+
+	return 0;
+}